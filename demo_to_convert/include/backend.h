@@ -0,0 +1,48 @@
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include "types.h"
+#include "SLABCP2112.h"
+
+// Device API under the SMBus layer, same signatures as SLABHIDtoSMBus so
+// the DLL exports can be used as they are
+typedef struct
+{
+    const char *name;
+
+    HID_SMBUS_STATUS (WINAPI *GetNumDevices)(DWORD *numDevices, WORD vid, WORD pid);
+    HID_SMBUS_STATUS (WINAPI *GetString)(DWORD deviceNum, WORD vid, WORD pid, char *deviceString, DWORD options);
+    HID_SMBUS_STATUS (WINAPI *GetOpenedString)(HID_SMBUS_DEVICE device, char *deviceString, DWORD options);
+    HID_SMBUS_STATUS (WINAPI *Open)(HID_SMBUS_DEVICE *device, DWORD deviceNum, WORD vid, WORD pid);
+    HID_SMBUS_STATUS (WINAPI *Close)(HID_SMBUS_DEVICE device);
+    HID_SMBUS_STATUS (WINAPI *IsOpened)(HID_SMBUS_DEVICE device, BOOL *opened);
+    HID_SMBUS_STATUS (WINAPI *ReadRequest)(HID_SMBUS_DEVICE device, BYTE slaveAddress, WORD numBytesToRead);
+    HID_SMBUS_STATUS (WINAPI *AddressReadRequest)(HID_SMBUS_DEVICE device, BYTE slaveAddress, WORD numBytesToRead, BYTE targetAddressSize, BYTE targetAddress[16]);
+    HID_SMBUS_STATUS (WINAPI *ForceReadResponse)(HID_SMBUS_DEVICE device, WORD numBytesToRead);
+    HID_SMBUS_STATUS (WINAPI *GetReadResponse)(HID_SMBUS_DEVICE device, HID_SMBUS_S0 *status, BYTE *buffer, BYTE bufferSize, BYTE *numBytesRead);
+    HID_SMBUS_STATUS (WINAPI *WriteRequest)(HID_SMBUS_DEVICE device, BYTE slaveAddress, BYTE *buffer, BYTE numBytesToWrite);
+    HID_SMBUS_STATUS (WINAPI *TransferStatusRequest)(HID_SMBUS_DEVICE device);
+    HID_SMBUS_STATUS (WINAPI *GetTransferStatusResponse)(HID_SMBUS_DEVICE device, HID_SMBUS_S0 *status, HID_SMBUS_S1 *detailedStatus, WORD *numRetries, WORD *bytesRead);
+    HID_SMBUS_STATUS (WINAPI *CancelTransfer)(HID_SMBUS_DEVICE device);
+    HID_SMBUS_STATUS (WINAPI *CancelIo)(HID_SMBUS_DEVICE device);
+    HID_SMBUS_STATUS (WINAPI *SetTimeouts)(HID_SMBUS_DEVICE device, DWORD responseTimeout);
+    HID_SMBUS_STATUS (WINAPI *GetTimeouts)(HID_SMBUS_DEVICE device, DWORD *responseTimeout);
+    HID_SMBUS_STATUS (WINAPI *SetSmbusConfig)(HID_SMBUS_DEVICE device, DWORD bitRate, BYTE address, BOOL autoReadRespond, WORD writeTimeout, WORD readTimeout, BOOL sclLowTimeout, WORD transferRetries);
+    HID_SMBUS_STATUS (WINAPI *GetSmbusConfig)(HID_SMBUS_DEVICE device, DWORD *bitRate, BYTE *address, BOOL *autoReadRespond, WORD *writeTimeout, WORD *readTimeout, BOOL *sclLowTimeout, WORD *transferRetries);
+    HID_SMBUS_STATUS (WINAPI *Reset)(HID_SMBUS_DEVICE device);
+    HID_SMBUS_STATUS (WINAPI *SetGpioConfig)(HID_SMBUS_DEVICE device, BYTE direction, BYTE mode, BYTE function, BYTE clkDiv);
+    HID_SMBUS_STATUS (WINAPI *GetGpioConfig)(HID_SMBUS_DEVICE device, BYTE *direction, BYTE *mode, BYTE *function, BYTE *clkDiv);
+    HID_SMBUS_STATUS (WINAPI *ReadLatch)(HID_SMBUS_DEVICE device, BYTE *latchValue);
+    HID_SMBUS_STATUS (WINAPI *WriteLatch)(HID_SMBUS_DEVICE device, BYTE latchValue, BYTE latchMask);
+    HID_SMBUS_STATUS (WINAPI *GetPartNumber)(HID_SMBUS_DEVICE device, BYTE *partNumber, BYTE *version);
+} SMBUS_BACKEND;
+
+// SLABHIDtoSMBus.dll, the default
+extern const SMBUS_BACKEND backendDll;
+
+// Pick the backend from -sim <adapters>, -simslave <address>, -simpec, -latency <us>,
+// -record <file>, -replay <file> and -realtime. The options are removed from argv, returns
+// the remaining argc or -1 when a trace cannot be opened.
+INT Backend_ParseArgs(INT argc, char *argv[]);
+
+#endif // BACKEND_H
@@ -0,0 +1,84 @@
+#ifndef BINLOG_H
+#define BINLOG_H
+
+#include <stdio.h>
+#include "telemetry.h"
+#include "csvlog.h"
+
+// File identification, "CBLG" on disk
+#define BINLOG_MAGIC                0x474C4243
+#define BINLOG_VERSION              1
+
+// Layout limits
+#define BINLOG_HEADER_SIZE          512
+#define BINLOG_MAX_CHANNELS         TELEMETRY_MAX_WORDS
+#define BINLOG_NAME_LEN             16
+#define BINLOG_BUFFER_SIZE          65536
+
+// One decoded column of the log; format is a CSVLOG_FORMAT
+typedef struct
+{
+    BYTE        word;                           // Index into the record's raw words
+    BYTE        format;
+    BYTE        slaveAddress;
+    BYTE        reg;
+    float       divisor;
+    float       offset;
+    char        name[BINLOG_NAME_LEN];
+} BINLOG_CHANNEL;
+
+// Fixed-size file header, all fields little-endian
+typedef struct
+{
+    UINT32          magic;
+    UINT16          version;
+    UINT16          headerSize;                 // Records start at this offset
+    UINT16          recordSize;                 // Every record has this size
+    UINT16          numWords;                   // Raw words per record
+    UINT16          numChannels;
+    UINT16          reserved0;
+    UINT32          periodMs;
+    UINT32          reserved1;
+    BINLOG_CHANNEL  channels[BINLOG_MAX_CHANNELS];
+    BYTE            reserved2[BINLOG_HEADER_SIZE - 24 - BINLOG_MAX_CHANNELS * sizeof(BINLOG_CHANNEL)];
+} BINLOG_HEADER;
+
+_Static_assert(sizeof(BINLOG_HEADER) == BINLOG_HEADER_SIZE, "BINLOG_HEADER must stay 512 bytes");
+
+// Record layout, recordSize rounds this up to 8 bytes
+//   UINT64  timestampUs
+//   UINT32  sequence
+//   UINT16  validMask
+//   UINT16  raw[numWords]
+#define BINLOG_RECORD_FIXED         14
+#define BINLOG_RECORD_SIZE(words)   ((BINLOG_RECORD_FIXED + 2 * (words) + 7) & ~7)
+
+// Append-only binary telemetry log
+typedef struct
+{
+    // Set by the caller before BinLog_Open
+    const char              *path;
+    const BINLOG_CHANNEL    *channels;
+    INT                     numChannels;
+    INT                     numWords;
+    DWORD                   periodMs;
+    DWORD                   flushIntervalMs;    // Flush buffered records older than this, 0 = size only
+
+    // Owned by the logger
+    FILE                    *fp;
+    WORD                    recordSize;
+    BYTE                    buffer[BINLOG_BUFFER_SIZE];
+    DWORD                   used;
+    DWORD                   lastFlushTick;
+} BIN_LOG;
+
+INT BinLog_Open(BIN_LOG *log);
+INT BinLog_WriteSample(BIN_LOG *log, const TELEMETRY_SAMPLE *sample);
+INT BinLog_Poll(BIN_LOG *log);
+INT BinLog_Flush(BIN_LOG *log);
+void BinLog_Close(BIN_LOG *log);
+
+INT BinLog_ReadHeader(FILE *fp, BINLOG_HEADER *header);
+void BinLog_DecodeRecord(const BINLOG_HEADER *header, const BYTE *record, TELEMETRY_SAMPLE *sample);
+
+#endif // BINLOG_H
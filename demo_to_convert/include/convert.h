@@ -0,0 +1,31 @@
+#ifndef CONVERT_H
+#define CONVERT_H
+
+#include <stddef.h>
+#include <windows.h>
+
+// Instruction set used by the block converters
+typedef enum
+{
+    CONVERT_SCALAR,
+    CONVERT_SSE2,
+    CONVERT_AVX2
+} CONVERT_PATH;
+
+// Best path supported by this CPU, picked on first use
+CONVERT_PATH Convert_GetPath(void);
+// Force a path, e.g. for benchmarking; an unsupported path falls back to scalar
+void Convert_SetPath(CONVERT_PATH path);
+
+// Signed fixed-point words: out = (INT16)raw / divisor + offset
+void Convert_LinearFixed(const WORD *raw, float *out, size_t count, float divisor, float offset);
+// PMBus LINEAR11: 5-bit signed exponent N, 11-bit signed mantissa Y, out = Y * 2^N
+void Convert_Linear11(const WORD *raw, float *out, size_t count);
+// PMBus LINEAR16: unsigned mantissa with the VOUT_MODE exponent, out = raw * 2^exponent
+void Convert_Linear16(const WORD *raw, float *out, size_t count, INT exponent);
+
+// Single-word reference conversions, identical results to the block versions
+float Convert_Linear11Word(WORD raw);
+float Convert_Linear16Word(WORD raw, INT exponent);
+
+#endif // CONVERT_H
@@ -0,0 +1,57 @@
+#ifndef CSVLOG_H
+#define CSVLOG_H
+
+#include <stdio.h>
+#include "telemetry.h"
+
+// Logger limits
+#define CSVLOG_BUFFER_SIZE          65536
+#define CSVLOG_MAX_COLUMNS          TELEMETRY_MAX_WORDS
+#define CSVLOG_MAX_ROW              ((CSVLOG_MAX_COLUMNS + 1) * 24 + 2)
+
+// How a raw word is rendered in its column
+typedef enum
+{
+    CSVLOG_FIXED2,                              // raw / divisor + offset, two decimals
+    CSVLOG_INT,                                 // Signed 16-bit decimal
+    CSVLOG_HEX                                  // "0x%x" of the word as an INT16
+} CSVLOG_FORMAT;
+
+// One output column, taken from TELEMETRY_SAMPLE.raw[word]
+typedef struct
+{
+    BYTE            word;
+    CSVLOG_FORMAT   format;
+    float           divisor;
+    float           offset;
+} CSVLOG_COLUMN;
+
+// Persistent CSV file with a reusable row buffer
+typedef struct
+{
+    // Set by the caller before CsvLog_Open
+    const char          *path;                  // e.g. "outputA.csv", rotated files get _NNN
+    const char          *header;                // Written at the top of every new file
+    const CSVLOG_COLUMN *columns;
+    INT                 numColumns;
+    DWORD               flushBytes;             // Flush once this much is buffered
+    DWORD               flushIntervalMs;        // Flush rows older than this, 0 = size only
+    ULONGLONG           rotateBytes;            // Start a new file past this size, 0 = never
+    BOOL                sparse;                 // Lead with time_us, leave words outside freshMask empty
+
+    // Owned by the logger
+    FILE                *fp;
+    char                buffer[CSVLOG_BUFFER_SIZE];
+    DWORD               used;
+    ULONGLONG           fileBytes;
+    DWORD               lastFlushTick;
+    DWORD               rotation;
+} CSV_LOG;
+
+INT CsvLog_Open(CSV_LOG *log);
+INT CsvLog_WriteSample(CSV_LOG *log, const TELEMETRY_SAMPLE *sample);
+INT CsvLog_Poll(CSV_LOG *log);
+INT CsvLog_Flush(CSV_LOG *log);
+void CsvLog_Close(CSV_LOG *log);
+
+#endif // CSVLOG_H
@@ -0,0 +1,33 @@
+#ifndef DEADBAND_H
+#define DEADBAND_H
+
+#include <windows.h>
+#include "telemetry.h"
+
+// Change detection between acquisition and the loggers. A word is passed
+// on when it moves more than its deadband from the value last passed on,
+// or when it becomes valid or invalid. A keyframe with every word goes
+// out on the first sample and then every keyframeMs.
+typedef struct
+{
+    // Set by the caller before Deadband_Init
+    const WORD  *deadbands;                     // Raw counts per word, NULL = any change
+    INT         numWords;
+    DWORD       keyframeMs;                     // 0 = only the first sample is a keyframe
+
+    // Owned by the filter
+    WORD        last[TELEMETRY_MAX_WORDS];      // Last value passed on per word
+    WORD        lastValid;
+    ULONGLONG   lastKeyframeUs;
+    BOOL        started;
+    ULONGLONG   samplesIn;
+    ULONGLONG   samplesOut;
+    ULONGLONG   wordsOut;
+} DEADBAND_FILTER;
+
+INT Deadband_Init(DEADBAND_FILTER *filter);
+// Narrows sample->freshMask to the words to log. Returns FALSE when
+// nothing changed and the sample can be dropped.
+BOOL Deadband_Filter(DEADBAND_FILTER *filter, TELEMETRY_SAMPLE *sample);
+
+#endif // DEADBAND_H
@@ -0,0 +1,53 @@
+#ifndef GPIO_H
+#define GPIO_H
+
+#include <windows.h>
+#include "smbus.h"
+#include "telemetry.h"
+
+// Words of an edge sample, the rest of raw is zero
+#define GPIO_WORD_LATCH             0           // Pin levels after the edge
+#define GPIO_WORD_CHANGED           1           // Pins that changed since the last read
+#define GPIO_WORD_MISSED            2           // Latch reads that failed before this one
+
+// Latch poller for input pins such as SMBALERT# and power-good.
+//
+// The CP2112 special functions are the TX/RX toggle outputs and the clock
+// output, none of them reports input changes, so edges are found by
+// reading the latch in a loop. Each read is one USB control transfer, so
+// the read time bounds how fast an edge is seen. Every edge goes into the
+// rings as a sample with the pins in raw[GPIO_WORD_LATCH], stamped on the
+// same clock as the acquisition samples when both use the same epoch.
+typedef struct
+{
+    // Set by the caller before Gpio_Start
+    HID_SMBUS_DEVICE    device;
+    BYTE                direction;              // Pin setup for SMBus_SetGpioConfig
+    BYTE                mode;
+    BYTE                function;
+    BYTE                clkDiv;
+    BYTE                watchMask;              // Pins whose edges are logged
+    BYTE                alertMask;              // Active-low pins that trigger reads on a falling edge
+    WORD                triggerMask;            // Registers of acq read on an alert
+    TELEMETRY_ACQUISITION *acq;                 // NULL when alerts trigger nothing
+    DWORD               pollIntervalMs;         // 0 reads the latch back to back
+    TELEMETRY_RING      *rings[TELEMETRY_MAX_CONSUMERS];
+    INT                 numRings;
+    WORD                source;                 // Copied into every sample, keep it apart from acq's
+    LONGLONG            epoch;                  // QPC count timestamps count from, 0 for Gpio_Start
+
+    // Owned by the polling thread
+    HANDLE              thread;
+    HANDLE              stopEvent;
+    BYTE                latch;                  // Pins at the last good read
+    volatile LONG       polls;
+    volatile LONG       edges;                  // Samples pushed
+    volatile LONG       alerts;                 // Triggers sent to acq
+    volatile LONG       errors;                 // Latch reads that failed
+} GPIO_WATCH;
+
+// Configure the pins, read them once and start polling
+INT Gpio_Start(GPIO_WATCH *watch);
+void Gpio_Stop(GPIO_WATCH *watch);
+
+#endif // GPIO_H
@@ -0,0 +1,145 @@
+#ifndef LVDC4816_H
+#define LVDC4816_H
+
+#include <math.h>
+#include "csvlog.h"
+#include "binlog.h"
+
+// Byte order of a multi-byte register
+#define LVDC4816_LE                 0
+#define LVDC4816_BE                 1
+
+// A block read moves on one command code per data word, so neighbouring
+// registers can be read in one transfer. Only the simulator is known to
+// behave this way, callers opt in with SMBus_SetSlaveCaps.
+#define LVDC4816_BYTES_PER_REGISTER 2
+
+// Read cache classes, SMBus_SetRegisterTtl values. Constant registers
+// only change when written, which drops the cached value.
+#define LVDC4816_TTL_VOLATILE       0
+#define LVDC4816_TTL_SLOW           1000
+#define LVDC4816_TTL_CONSTANT       INFINITE
+
+// LVDC4816 register map
+// X(name, address, width, endianness, divisor, offset, format, cache)
+// value = (INT16)raw / divisor + offset
+#define LVDC4816_REGISTERS(X) \
+    X(WRITE_PROTECT,    0x10,   1,  LE,  1.0f,    0.0f,  HEX,    CONSTANT) \
+    X(DUT_STATUS,       0x79,   2,  LE,  1.0f,    0.0f,  HEX,    VOLATILE) \
+    X(HV_VOLTAGE,       0x88,   2,  LE, 32.0f,    0.0f,  FIXED2, VOLATILE) \
+    X(LV_VOLTAGE,       0x8B,   2,  LE, 32.0f,    0.0f,  FIXED2, VOLATILE) \
+    X(I2_CURRENT,       0x8C,   2,  LE, 32.0f,    0.0f,  FIXED2, VOLATILE) \
+    X(TEMPERATURE1,     0x8D,   2,  LE, 32.0f,  -40.0f,  FIXED2, SLOW    ) \
+    X(TEMPERATURE2,     0x8E,   2,  LE, 32.0f,  -40.0f,  FIXED2, SLOW    ) \
+    X(I1_CURRENT,       0x90,   2,  LE, 32.0f,    0.0f,  FIXED2, VOLATILE) \
+    X(MFR_VERSION,      0x9B,   2,  LE,  1.0f,    0.0f,  HEX,    CONSTANT) \
+    X(I1_CNT,           0xCD,   2,  LE,  1.0f,    0.0f,  INT,    VOLATILE) \
+    X(HW_OCP,           0xEA,   2,  LE, 32.0f,    0.0f,  FIXED2, CONSTANT)
+
+// Telemetry snapshot in logged column order
+// X(register, column name, period ms, slack ms, deadband)
+// Period 0 reads the register once. A read may be pulled forward by up to
+// slack ms to share a bus pass with other due registers. The deadband is
+// in raw counts, changes within it are not logged in change-only mode.
+#define LVDC4816_TELEMETRY(X) \
+    X(HV_VOLTAGE,       "HV_V",         500,    100,     1) \
+    X(LV_VOLTAGE,       "LV_V",         500,    100,     1) \
+    X(I1_CURRENT,       "I1_A",          50,     10,     2) \
+    X(I2_CURRENT,       "I2_A",          50,     10,     2) \
+    X(TEMPERATURE1,     "Temp1_C",     2000,    500,    16) \
+    X(TEMPERATURE2,     "Temp2_C",     2000,    500,    16) \
+    X(I1_CNT,           "I1_CNT",       500,    100,     0) \
+    X(DUT_STATUS,       "DUT_Status",   100,     20,     0)
+
+// Register addresses: LVDC4816_REG_<name>
+#define LVDC4816_X_ADDRESS(name, address, width, endian, divisor, offset, format, cache) LVDC4816_REG_##name = address,
+enum { LVDC4816_REGISTERS(LVDC4816_X_ADDRESS) };
+
+// Register table indices: LVDC4816_ID_<name>
+#define LVDC4816_X_ID(name, address, width, endian, divisor, offset, format, cache) LVDC4816_ID_##name,
+enum { LVDC4816_REGISTERS(LVDC4816_X_ID) LVDC4816_NUM_REGISTERS };
+
+// Telemetry word indices: LVDC4816_TLM_<register>
+#define LVDC4816_X_TLM(reg, column, periodMs, slackMs, deadband) LVDC4816_TLM_##reg,
+enum { LVDC4816_TELEMETRY(LVDC4816_X_TLM) LVDC4816_NUM_TELEMETRY };
+
+// Runtime view of the register map
+typedef struct
+{
+    const char      *name;
+    BYTE            address;
+    BYTE            width;
+    BYTE            endian;
+    CSVLOG_FORMAT   format;
+    float           divisor;
+    float           offset;
+    DWORD           ttlMs;
+} LVDC4816_REG_INFO;
+
+extern const LVDC4816_REG_INFO lvdc4816Registers[LVDC4816_NUM_REGISTERS];
+extern const BYTE lvdc4816TelemetryRegs[LVDC4816_NUM_TELEMETRY];
+extern const TELEMETRY_RATE lvdc4816TelemetryRates[LVDC4816_NUM_TELEMETRY];
+extern const WORD lvdc4816TelemetryDeadbands[LVDC4816_NUM_TELEMETRY];
+extern const char *const lvdc4816TelemetryNames[LVDC4816_NUM_TELEMETRY];
+extern const char lvdc4816TelemetryHeader[];
+
+// Word from a read buffer, width and order are constants after inlining
+static inline WORD LVDC4816_RawWord(const BYTE *buffer, INT width, INT endian)
+{
+    if (width == 1)
+    {
+        return buffer[0];
+    }
+    return (endian == LVDC4816_LE) ? (WORD)((buffer[1] << 8) | buffer[0]) : (WORD)((buffer[0] << 8) | buffer[1]);
+}
+
+// Command byte plus data for SMBus_Write, returns the write length
+static inline BYTE LVDC4816_PackWord(BYTE *buffer, BYTE address, WORD raw, INT width, INT endian)
+{
+    buffer[0] = address;
+    if (width == 1)
+    {
+        buffer[1] = (BYTE)raw;
+        return 2;
+    }
+    buffer[1] = (BYTE)((endian == LVDC4816_LE) ? raw : raw >> 8);
+    buffer[2] = (BYTE)((endian == LVDC4816_LE) ? raw >> 8 : raw);
+    return 3;
+}
+
+// Per-register codecs with the map constants folded in:
+//   WORD  LVDC4816_Raw_<name>(const BYTE *buffer)
+//   float LVDC4816_Decode_<name>(WORD raw)
+//   WORD  LVDC4816_Encode_<name>(float value)
+//   BYTE  LVDC4816_Pack_<name>(float value, BYTE *buffer)
+#define LVDC4816_X_CODEC(name, address, width, endian, divisor, offset, format, cache) \
+    static inline WORD LVDC4816_Raw_##name(const BYTE *buffer) \
+    { \
+        return LVDC4816_RawWord(buffer, width, LVDC4816_##endian); \
+    } \
+    static inline float LVDC4816_Decode_##name(WORD raw) \
+    { \
+        return (INT16)raw / (divisor) + (offset); \
+    } \
+    static inline WORD LVDC4816_Encode_##name(float value) \
+    { \
+        return (WORD)lrintf((value - (offset)) * (divisor)); \
+    } \
+    static inline BYTE LVDC4816_Pack_##name(float value, BYTE *buffer) \
+    { \
+        return LVDC4816_PackWord(buffer, address, LVDC4816_Encode_##name(value), width, LVDC4816_##endian); \
+    }
+LVDC4816_REGISTERS(LVDC4816_X_CODEC)
+
+// Whole telemetry snapshot to engineering units, unrolled at compile time
+static inline void LVDC4816_DecodeTelemetry(const WORD *raw, float *values)
+{
+#define LVDC4816_X_DECODE(reg, column, periodMs, slackMs, deadband) values[LVDC4816_TLM_##reg] = LVDC4816_Decode_##reg(raw[LVDC4816_TLM_##reg]);
+    LVDC4816_TELEMETRY(LVDC4816_X_DECODE)
+#undef LVDC4816_X_DECODE
+}
+
+void LVDC4816_TelemetryColumns(CSVLOG_COLUMN *columns);
+void LVDC4816_TelemetryChannels(BINLOG_CHANNEL *channels, BYTE slaveAddress);
+
+#endif // LVDC4816_H
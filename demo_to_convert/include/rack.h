@@ -0,0 +1,41 @@
+#ifndef RACK_H
+#define RACK_H
+
+#include <windows.h>
+#include "smbus.h"
+#include "telemetry.h"
+
+// Adapters a rack can hold
+#define RACK_MAX_ADAPTERS           16
+
+// One CP2112 bridge and the acquisition thread polling it
+typedef struct
+{
+    HID_SMBUS_DEVICE_STR    serial;
+    HID_SMBUS_DEVICE        device;
+    BOOL                    opened;
+    TELEMETRY_ACQUISITION   acquisition;
+} RACK_ADAPTER;
+
+// Every CP2112 on the host, each polled by its own thread into one sink
+typedef struct
+{
+    // Set by the caller before Rack_Start
+    BYTE                    slaveAddress;
+    const BYTE              *registers;
+    INT                     numRegisters;
+    DWORD                   periodMs;
+    const TELEMETRY_RATE    *rates;             // Optional per-register periods
+    TELEMETRY_RING          *sink;              // Initialised with Telemetry_RingInitShared
+
+    // Filled by Rack_Open, sample.source is the index into adapters
+    RACK_ADAPTER            adapters[RACK_MAX_ADAPTERS];
+    INT                     numAdapters;
+} RACK;
+
+INT Rack_Open(RACK *rack);
+INT Rack_Start(RACK *rack);
+void Rack_Stop(RACK *rack);
+void Rack_Close(RACK *rack);
+
+#endif // RACK_H
@@ -0,0 +1,35 @@
+#ifndef SIMBUS_H
+#define SIMBUS_H
+
+#include <windows.h>
+#include "backend.h"
+
+// Simulated adapters and the slaves each of them can see
+#define SIM_MAX_DEVICES             16
+#define SIM_MAX_SLAVES              4
+
+// Behaviour of the simulated CP2112 adapters
+typedef struct
+{
+    DWORD   numDevices;             // Adapters reported by GetNumDevices
+    BYTE    slaveAddress;           // Where each adapter's LVDC4816 answers
+    DWORD   latencyUs;              // Added to every transfer, models the USB round trip
+    BOOL    busTiming;              // Add the wire time at the configured bit rate
+    BOOL    pec;                    // Slaves append a PEC to reads and expect one on writes
+} SIM_CONFIG;
+
+// In-memory CP2112 backend with an LVDC4816 register file behind every
+// adapter. Transfers complete after the configured latency, reads of
+// I1_CNT count up so consumers see changing data.
+extern const SMBUS_BACKEND backendSim;
+
+// Reset every adapter and its register file
+void Sim_Configure(const SIM_CONFIG *config);
+// Make another slave answer on one adapter, returns -1 when full
+INT Sim_AddSlave(DWORD deviceNum, BYTE slaveAddress);
+void Sim_SetRegister(DWORD deviceNum, BYTE slaveAddress, BYTE reg, WORD value);
+WORD Sim_GetRegister(DWORD deviceNum, BYTE slaveAddress, BYTE reg);
+// Levels seen on the input pins in mask of one adapter, outputs keep theirs
+void Sim_SetInputs(DWORD deviceNum, BYTE value, BYTE mask);
+
+#endif // SIMBUS_H
@@ -0,0 +1,69 @@
+#ifndef SMBASYNC_H
+#define SMBASYNC_H
+
+#include <windows.h>
+#include "smbus.h"
+
+typedef struct SMBUS_ASYNC_READ SMBUS_ASYNC_READ;
+
+// Runs on the I/O thread once the read has finished, keep it short
+typedef void (*SMBUS_ASYNC_CALLBACK)(SMBUS_ASYNC_READ *read);
+
+// One queued read. The caller keeps it alive from SMBAsync_Submit until
+// its completion has been delivered.
+struct SMBUS_ASYNC_READ
+{
+    // Set by the caller before SMBAsync_Submit
+    BYTE                    slaveAddress;
+    BYTE                    targetAddressSize;
+    BYTE                    targetAddress[HID_SMBUS_MAX_TARGET_ADDRESS_SIZE];
+    WORD                    numBytesToRead;
+    BYTE                    *buffer;
+    DWORD                   timeoutMs;          // Cancel the transfer after this, 0 = the queue default
+    SMBUS_ASYNC_CALLBACK    callback;           // NULL posts to the completion queue instead
+    void                    *context;
+
+    // Filled by the queue
+    DWORD                   token;
+    INT                     result;             // Bytes read, or -1 on failure, timeout or cancel
+    SMBUS_ASYNC_READ        *next;
+};
+
+// Reads for one adapter, run in turn by an I/O thread that owns the device
+// while started. Waiting requests are served round-robin by slave address,
+// so a client whose slave is slow to answer does not hold up the others.
+typedef struct
+{
+    // Set by the caller before SMBAsync_Start
+    HID_SMBUS_DEVICE        device;
+    DWORD                   defaultTimeoutMs;
+
+    // Owned by the queue
+    HANDLE                  thread;
+    HANDLE                  workEvent;          // Set by submit and stop
+    HANDLE                  completionEvent;    // Set when the completion queue gains an entry
+    CRITICAL_SECTION        lock;
+    BOOL                    stopping;
+    SMBUS_ASYNC_READ        *waiting;           // Oldest first
+    SMBUS_ASYNC_READ        *completedHead;
+    SMBUS_ASYNC_READ        *completedTail;
+    DWORD                   nextToken;
+    BYTE                    lastSlave;          // Round-robin position
+    volatile LONG           numCompleted;
+    volatile LONG           numFailed;
+} SMBUS_ASYNC;
+
+// A failed start has released whatever it set up, SMBAsync_Stop is only
+// for a queue that started
+INT SMBAsync_Start(SMBUS_ASYNC *async);
+// Stops the I/O thread after the read on the bus. Reads still waiting fail
+// with -1 and only their callbacks are run, the completion queue is dropped.
+void SMBAsync_Stop(SMBUS_ASYNC *async);
+// Returns the request token, or 0 when the queue is not running
+DWORD SMBAsync_Submit(SMBUS_ASYNC *async, SMBUS_ASYNC_READ *read);
+// Completes a waiting request with -1, FALSE once it has reached the bus
+BOOL SMBAsync_Cancel(SMBUS_ASYNC *async, DWORD token);
+// Next read from the completion queue, NULL after timeoutMs
+SMBUS_ASYNC_READ *SMBAsync_GetCompletion(SMBUS_ASYNC *async, DWORD timeoutMs);
+
+#endif // SMBASYNC_H
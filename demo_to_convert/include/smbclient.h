@@ -0,0 +1,35 @@
+#ifndef SMBCLIENT_H
+#define SMBCLIENT_H
+
+#include <windows.h>
+#include "smbus.h"
+#include "smbipc.h"
+
+// Connection to smbusd. The calls mirror their SMBus_ counterparts and
+// return the same results, the transfers run in the daemon on an adapter
+// it keeps open and configured. One thread per connection.
+typedef struct
+{
+    HANDLE                  pipe;
+    DWORD                   sequence;
+    HID_SMBUS_DEVICE_STR    serial;         // Adapter the daemon picked
+    WORD                    priority;       // SMBIPC_PRIORITY_ of the requests sent, periodic after connecting
+    SMBIPC_REQUEST          request;
+    SMBIPC_RESPONSE         response;
+} SMB_CLIENT;
+
+// An empty or NULL serial takes whatever adapter the daemon has open, or
+// the first one it finds. pipeName NULL is SMBIPC_PIPE_NAME.
+INT SMBClient_Connect(SMB_CLIENT *client, const char *pipeName, const char *serial, DWORD timeoutMs);
+void SMBClient_Close(SMB_CLIENT *client);
+INT SMBClient_Read(SMB_CLIENT *client, BYTE *buffer, BYTE slaveAddress, WORD numBytesToRead, BYTE targetAddressSize, BYTE *targetAddress);
+INT SMBClient_Write(SMB_CLIENT *client, BYTE *buffer, BYTE slaveAddress, BYTE numBytesToWrite);
+// Sent SMBIPC_MAX_OPS descriptors per request, as long as their data fits
+INT SMBClient_ReadBatch(SMB_CLIENT *client, SMBUS_READ_DESC *reads, WORD numReads);
+INT SMBClient_WriteBatch(SMB_CLIENT *client, SMBUS_WRITE_DESC *writes, WORD numWrites);
+// Read from a slave whose target address counts up with every byte, such
+// as an EEPROM. As a bulk request the daemon may split it into several
+// reads so urgent and periodic requests do not wait behind all of it.
+INT SMBClient_ReadSequential(SMB_CLIENT *client, BYTE *buffer, BYTE slaveAddress, WORD numBytesToRead, BYTE targetAddressSize, BYTE *targetAddress);
+
+#endif // SMBCLIENT_H
@@ -0,0 +1,83 @@
+#ifndef SMBIPC_H
+#define SMBIPC_H
+
+#include <stddef.h>
+#include <windows.h>
+#include "smbus.h"
+
+// Wire format between smbusd and SMBClient. One named pipe in message
+// mode, one message per request and per response. A connection starts
+// with an SMBIPC_HELLO that names the adapter, every request after it
+// carries up to SMBIPC_MAX_OPS transfers that run in order.
+#define SMBIPC_PIPE_NAME            "\\\\.\\pipe\\cp2112"
+#define SMBIPC_VERSION              3
+#define SMBIPC_MAX_OPS              16
+#define SMBIPC_MAX_DATA             HID_SMBUS_MAX_READ_REQUEST_SIZE
+
+// Transfer kinds
+#define SMBIPC_OP_READ              1
+#define SMBIPC_OP_WRITE             2
+
+// Op flags
+#define SMBIPC_FLAG_SEQUENTIAL      0x01    // Target address counts up with every byte, as in an EEPROM
+
+// Request classes, served in this order, except that a class left
+// waiting for too many rounds is served once anyway. Urgent and periodic
+// requests run whole, bulk requests one HID report at a time so the others
+// get in between. A sequential bulk read is split into reads of
+// HID_SMBUS_MAX_READ_RESPONSE_SIZE bytes at increasing target addresses.
+#define SMBIPC_PRIORITY_URGENT      0
+#define SMBIPC_PRIORITY_PERIODIC    1
+#define SMBIPC_PRIORITY_BULK        2
+#define SMBIPC_NUM_PRIORITIES       3
+
+typedef struct
+{
+    DWORD                   version;
+    HID_SMBUS_DEVICE_STR    serial;         // Empty for the first adapter found
+} SMBIPC_HELLO;
+
+typedef struct
+{
+    INT                     result;         // 0, or -1 when the adapter could not be opened
+    HID_SMBUS_DEVICE_STR    serial;         // Of the adapter the connection uses
+} SMBIPC_HELLO_REPLY;
+
+// One transfer, like an SMBUS_READ_DESC or SMBUS_WRITE_DESC
+typedef struct
+{
+    BYTE    op;
+    BYTE    flags;
+    BYTE    slaveAddress;
+    BYTE    targetAddressSize;
+    BYTE    targetAddress[HID_SMBUS_MAX_TARGET_ADDRESS_SIZE];
+    WORD    numBytes;                       // To read, or of data to write
+    BYTE    data[HID_SMBUS_MAX_WRITE_REQUEST_SIZE];
+} SMBIPC_OP;
+
+// Only the first numOps ops are sent, at least one
+typedef struct
+{
+    DWORD       sequence;
+    WORD        numOps;
+    WORD        priority;
+    SMBIPC_OP   ops[SMBIPC_MAX_OPS];
+} SMBIPC_REQUEST;
+
+// Results as from SMBus_ReadBatch and SMBus_WriteBatch. Read data follows
+// in op order, every read at its full length whether it succeeded or not,
+// so the reads of one request may ask for SMBIPC_MAX_DATA bytes together.
+typedef struct
+{
+    DWORD       sequence;
+    WORD        numOps;
+    WORD        numData;
+    INT         result;             // -1 when a batch found the adapter closed, as the batch calls return
+    INT         results[SMBIPC_MAX_OPS];
+    BYTE        data[SMBIPC_MAX_DATA];
+} SMBIPC_RESPONSE;
+
+#define SMBIPC_REQUEST_SIZE(n)      (offsetof(SMBIPC_REQUEST, ops) + (n) * sizeof(SMBIPC_OP))
+#define SMBIPC_RESPONSE_SIZE(n)     (offsetof(SMBIPC_RESPONSE, data) + (n))
+
+#endif // SMBIPC_H
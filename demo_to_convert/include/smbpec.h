@@ -0,0 +1,10 @@
+#ifndef SMBPEC_H
+#define SMBPEC_H
+
+#include <windows.h>
+
+// SMBus Packet Error Code: CRC-8, polynomial x^8 + x^2 + x + 1, initial
+// value 0, over every byte of the message including the address bytes
+BYTE SMBPec_Update(BYTE crc, const BYTE *data, DWORD length);
+
+#endif // SMBPEC_H
@@ -0,0 +1,49 @@
+#ifndef SMBPOOL_H
+#define SMBPOOL_H
+
+#include <windows.h>
+#include "smbus.h"
+#include "smbasync.h"
+
+// One borrowed transaction: descriptors for every way of issuing it and a
+// payload big enough for the largest read. Borrowing points the buffers of
+// all three descriptors at data.
+typedef struct SMBUS_TRANSACTION SMBUS_TRANSACTION;
+struct SMBUS_TRANSACTION
+{
+    SMBUS_ASYNC_READ        async;              // First, completions map back with SMBPool_FromAsync
+    SMBUS_READ_DESC         read;
+    SMBUS_WRITE_DESC        write;
+    BYTE                    data[HID_SMBUS_MAX_READ_REQUEST_SIZE];
+    SMBUS_TRANSACTION       *nextFree;
+};
+
+// Fixed set of transactions in caller storage. Borrow and return never
+// allocate, so a polling loop built on the pool does no heap work once it
+// is running. Both may be called from any thread, including SMBAsync
+// callbacks on the I/O thread.
+typedef struct
+{
+    SMBUS_TRANSACTION       *storage;
+    DWORD                   capacity;
+    CRITICAL_SECTION        lock;
+    SMBUS_TRANSACTION       *free;
+    DWORD                   numFree;
+    DWORD                   minFree;            // Low-water mark, sizes the pool
+    volatile LONG           numExhausted;       // Borrows that found the pool empty
+} SMBUS_POOL;
+
+INT SMBPool_Init(SMBUS_POOL *pool, SMBUS_TRANSACTION *storage, DWORD capacity);
+// Every transaction must have been returned
+void SMBPool_Free(SMBUS_POOL *pool);
+// NULL when every transaction is out
+SMBUS_TRANSACTION *SMBPool_Borrow(SMBUS_POOL *pool);
+void SMBPool_Return(SMBUS_POOL *pool, SMBUS_TRANSACTION *transaction);
+
+// Transaction a completed SMBAsync read was borrowed as
+static inline SMBUS_TRANSACTION *SMBPool_FromAsync(SMBUS_ASYNC_READ *read)
+{
+    return (SMBUS_TRANSACTION *)read;
+}
+
+#endif // SMBPOOL_H
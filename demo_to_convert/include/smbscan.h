@@ -0,0 +1,38 @@
+#ifndef SMBSCAN_H
+#define SMBSCAN_H
+
+#include <windows.h>
+#include "smbus.h"
+
+// What a probe found at one address
+#define SMBSCAN_ABSENT              0
+#define SMBSCAN_PRESENT             1
+#define SMBSCAN_ERROR               2   // Bus error or no answer in time
+
+// Bus sweep. Every address in the range is probed with a one byte read,
+// or a one byte write of probeCommand, and classified from the transfer
+// status: the address phase ACK or NACK is enough, so a missing slave
+// costs one address byte on the wire, not a timeout.
+typedef struct
+{
+    // Set by the caller before SMBScan_Run
+    BYTE    firstAddress;           // 8-bit write addresses, 0 = 0x02
+    BYTE    lastAddress;            // 0 = 0xFE
+    BOOL    writeProbe;             // Some slaves only ACK writes, the write goes to the slave
+    BYTE    probeCommand;
+    WORD    busTimeoutMs;           // Read and write timeout while scanning, 0 = 2 ms
+    DWORD   probeTimeoutMs;         // Give up on one address after this, 0 = 10 ms
+
+    // Filled by the scan
+    BYTE    result[128];            // SMBSCAN_* by 7-bit address
+    INT     numPresent;
+    INT     numErrors;
+    DWORD   elapsedMs;
+} SMBUS_SCAN;
+
+// Sweeps the bus with temporarily lowered timeouts and no retries, then
+// puts the adapter configuration back the way it was. Returns the number
+// of slaves found, or -1 when the adapter could not be used.
+INT SMBScan_Run(HID_SMBUS_DEVICE device, SMBUS_SCAN *scan);
+
+#endif // SMBSCAN_H
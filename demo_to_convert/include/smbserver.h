@@ -0,0 +1,95 @@
+#ifndef SMBSERVER_H
+#define SMBSERVER_H
+
+#include <windows.h>
+#include "smbus.h"
+#include "smbipc.h"
+#include "smbtiming.h"
+
+// Pipe connections and adapters one server handles
+#define SMBSERVER_MAX_CLIENTS       16
+#define SMBSERVER_MAX_ADAPTERS      8
+
+// Rounds a class with a request pending may be passed over in a row
+// before it is served anyway
+#define SMBSERVER_AGING_ROUNDS      16
+
+typedef struct SMBSERVER SMBSERVER;
+
+// One pipe connection, served by its own thread. A client has at most one
+// request in flight, the bus thread of its adapter answers it.
+typedef struct
+{
+    SMBSERVER           *server;
+    BOOL                inUse;
+    HANDLE              pipe;
+    HANDLE              thread;
+    HANDLE              doneEvent;      // Response is ready
+    INT                 adapter;        // Index into adapters, -1 before the hello
+    BOOL                pending;        // request waits for the bus thread
+    LONGLONG            arrival;        // QueryPerformanceCounter when request was posted
+    INT                 nextOp;         // Progress of a bulk request
+    WORD                nextOffset;
+    BYTE                *nextData;
+    SMBIPC_REQUEST      request;
+    SMBIPC_RESPONSE     response;
+    DWORD               responseSize;
+    volatile LONG       requests;
+} SMBSERVER_CLIENT;
+
+// An adapter opened for the clients that asked for it, kept open until
+// SMBServer_Stop so later clients skip enumeration and configuration
+typedef struct
+{
+    SMBSERVER           *server;
+    HID_SMBUS_DEVICE_STR serial;
+    HID_SMBUS_DEVICE    device;
+    HANDLE              thread;
+    HANDLE              workEvent;      // A client of this adapter has a request pending
+    INT                 next[SMBIPC_NUM_PRIORITIES];    // Client the next round of each class starts from
+    DWORD               skipped[SMBIPC_NUM_PRIORITIES]; // Rounds in a row run for a higher class while one waited
+    volatile LONG       aged[SMBIPC_NUM_PRIORITIES];    // Rounds given to a class for having waited too long
+    volatile LONG       rounds;
+    volatile LONG       requests;
+    volatile LONG       batches;        // SMBus_ReadBatch and SMBus_WriteBatch calls
+    volatile LONG       pieces;         // Of bulk requests
+    SMBTIMING_HISTOGRAM latency[SMBIPC_NUM_PRIORITIES];  // Request posted to response ready
+} SMBSERVER_ADAPTER;
+
+// Local daemon that owns the adapters and runs transfers for clients of
+// other processes. Each adapter has one bus thread working in rounds: a
+// round takes one pending request from every client of the adapter in the
+// highest class that has one, in turn from where the last round of that
+// class stopped, so no client waits behind more than one request of each
+// other client of its class. The ops of the whole round run in request
+// order, runs of reads and of writes as one batch each, which lets
+// SMBus_ReadBatch merge neighbouring reads of different clients. A bulk
+// round is one HID report of one request, after which the classes are
+// looked at again, see SMBIPC_PRIORITY_BULK. A class passed over for
+// SMBSERVER_AGING_ROUNDS rounds in a row gets the next round regardless,
+// so lower classes keep a minimum share of the bus under load.
+struct SMBSERVER
+{
+    // Set by the caller before SMBServer_Start
+    const char          *pipeName;      // NULL for SMBIPC_PIPE_NAME
+    SMBUS_BUS_CONFIG    config;         // Applied to every adapter opened
+
+    // Owned by the server threads
+    CRITICAL_SECTION    lock;
+    CRITICAL_SECTION    adapterLock;    // Held while a hello finds or opens its adapter, never by bus threads
+    HANDLE              listenThread;
+    HANDLE              stopEvent;
+    HANDLE              pipe;           // Instance the next client connects to
+    SMBSERVER_ADAPTER   adapters[SMBSERVER_MAX_ADAPTERS];
+    INT                 numAdapters;
+    SMBSERVER_CLIENT    clients[SMBSERVER_MAX_CLIENTS];
+    volatile LONG       connections;
+    volatile LONG       refused;        // Connections over SMBSERVER_MAX_CLIENTS or malformed
+};
+
+// Fails when another server holds the pipe name
+INT SMBServer_Start(SMBSERVER *server);
+// Disconnects the clients and closes every adapter
+void SMBServer_Stop(SMBSERVER *server);
+
+#endif // SMBSERVER_H
@@ -0,0 +1,58 @@
+#ifndef SMBTIMING_H
+#define SMBTIMING_H
+
+#include <stdio.h>
+#include <windows.h>
+
+// Distinct slave/register pairs tracked, later ones are not timed
+#define SMBTIMING_MAX_KEYS          64
+// Four buckets per power of two microseconds, up to about 30 s
+#define SMBTIMING_NUM_BUCKETS       96
+
+// Steps of a transaction inside smbus.c
+typedef enum
+{
+    SMBTIMING_READ_REQUEST,         // HidSmbus_AddressReadRequest
+    SMBTIMING_FORCE_RESPONSE,       // HidSmbus_ForceReadResponse
+    SMBTIMING_READ_RESPONSE,        // Each HidSmbus_GetReadResponse chunk
+    SMBTIMING_READ_TOTAL,           // Whole successful read
+    SMBTIMING_WRITE_REQUEST,        // HidSmbus_WriteRequest
+    SMBTIMING_STATUS_POLL,          // Each transfer status request and response
+    SMBTIMING_POLL_SLEEP,           // Backoff between status polls
+    SMBTIMING_WRITE_TOTAL,          // Write request to completed status
+    SMBTIMING_NUM_STAGES
+} SMBTIMING_STAGE;
+
+// Latency histogram in microseconds
+typedef struct
+{
+    volatile LONG       count;
+    volatile LONG       maxUs;
+    volatile LONG64     totalUs;
+    volatile LONG       buckets[SMBTIMING_NUM_BUCKETS];
+} SMBTIMING_HISTOGRAM;
+
+// Histograms of one slave/register pair
+typedef struct
+{
+    volatile LONG       key;            // 0 while the slot is free
+    volatile LONG       errors;         // Failed transactions
+    SMBTIMING_HISTOGRAM stages[SMBTIMING_NUM_STAGES];
+} SMBTIMING_ENTRY;
+
+void SMBTiming_Enable(BOOL enable);
+void SMBTiming_Reset(void);
+void SMBTiming_Dump(FILE *fp, BOOL buckets);
+
+// Used by smbus.c, all of them do nothing for a NULL entry
+SMBTIMING_ENTRY *SMBTiming_Entry(BYTE slaveAddress, BYTE reg);
+LONGLONG SMBTiming_Start(SMBTIMING_ENTRY *entry);
+LONGLONG SMBTiming_Stop(SMBTIMING_ENTRY *entry, SMBTIMING_STAGE stage, LONGLONG start);
+void SMBTiming_Error(SMBTIMING_ENTRY *entry);
+DWORD SMBTiming_Percentile(const SMBTIMING_HISTOGRAM *histogram, DWORD percent);
+
+// Add the time since a QueryPerformanceCounter value to any histogram and
+// return the current counter
+LONGLONG SMBTiming_Record(SMBTIMING_HISTOGRAM *histogram, LONGLONG start);
+
+#endif // SMBTIMING_H
@@ -0,0 +1,29 @@
+#ifndef SMBTUNE_H
+#define SMBTUNE_H
+
+#include <windows.h>
+#include "smbus.h"
+
+// Adapters a settings file holds
+#define SMBTUNE_MAX_ADAPTERS        64
+
+// Bus settings found by SMBus_SetAutoTune, kept per adapter serial in a
+// text file of one line per adapter:
+//   <serial> <bit rate> <write timeout ms> <read timeout ms>
+// Loading only replaces those three fields of config, so the rest of the
+// configuration stays with the caller.
+
+// Values outside the bounds auto-tuning will run with are clamped to them,
+// a file edited by hand or left by other bounds cannot start the bus
+// somewhere tuning would never go. Returns -1 when the file or the serial
+// is not there.
+INT SMBTune_Load(const char *path, const char *serial, const SMBUS_TUNE_CONFIG *bounds, SMBUS_BUS_CONFIG *config);
+// Replace the serial's line, or add it, and rewrite the file
+INT SMBTune_Save(const char *path, const char *serial, const SMBUS_BUS_CONFIG *config);
+
+// Adapter the last run used, for SMBus_OpenCached. A file of one line:
+//   <serial> <device index>
+INT SMBTune_LoadLast(const char *path, HID_SMBUS_DEVICE_STR serial, DWORD *deviceNum);
+INT SMBTune_SaveLast(const char *path, const char *serial, DWORD deviceNum);
+
+#endif // SMBTUNE_H
@@ -1,9 +1,224 @@
+#ifndef SMBUS_H
+#define SMBUS_H
+
 #include "types.h"
 #include "SLABCP2112.h"
+#include "backend.h"
+
+// Number of handles whose open state the SMBus layer tracks itself
+#define SMBUS_MAX_SESSIONS      16
+// Number of enumerated devices the serial lookup cache holds
+#define SMBUS_MAX_DEVICES       32
+
+// Called after each read response report with the bytes received so far
+typedef void (*SMBUS_PROGRESS_CALLBACK)(WORD numBytesRead, WORD numBytesTotal, void *context);
+
+// One register read within an SMBus_ReadBatch call
+typedef struct
+{
+    BYTE    slaveAddress;
+    BYTE    targetAddressSize;
+    BYTE    targetAddress[HID_SMBUS_MAX_TARGET_ADDRESS_SIZE];
+    WORD    numBytesToRead;
+    BYTE    *buffer;
+    INT     result;         // Bytes read, or -1 on failure
+} SMBUS_READ_DESC;
+
+// One write within an SMBus_WriteBatch call
+typedef struct
+{
+    BYTE    slaveAddress;
+    BYTE    numBytesToWrite;
+    BYTE    *buffer;
+    INT     result;         // 0 when complete, or -1 on failure
+} SMBUS_WRITE_DESC;
+
+// Result of a write whose readback differs from the data written
+#define SMBUS_WRITE_MISMATCH        1
+
+// Transfer status polling policy for writes
+typedef struct
+{
+    DWORD   pollIntervalMs;     // Wait after the first busy status
+    DWORD   maxPollIntervalMs;  // Backoff ceiling, the wait doubles up to this
+    DWORD   timeoutMs;          // Give up on a transfer after this long
+} SMBUS_POLL_CONFIG;
+
+// Fault recovery policy
+typedef struct
+{
+    DWORD   resetAfterFaults;   // Faults in a row before a reset and reopen, 0 = only cancel
+    DWORD   minBackoffMs;       // First wait after a failed reopen
+    DWORD   maxBackoffMs;       // Backoff ceiling, the wait doubles up to this
+} SMBUS_RECOVERY_CONFIG;
+
+// What recovery has done to one handle
+typedef struct
+{
+    DWORD   cancels;
+    DWORD   resets;
+    DWORD   reopens;
+    DWORD   failedReopens;
+} SMBUS_RECOVERY_STATS;
 
+// Settings applied by SMBus_Configure, replayed after a reopen
+typedef struct
+{
+    DWORD   bitRate;
+    BYTE    address;
+    BOOL    autoReadRespond;
+    WORD    writeTimeout;
+    WORD    readTimeout;
+    BOOL    sclLowTimeout;
+    WORD    transferRetries;
+    DWORD   responseTimeout;
+} SMBUS_BUS_CONFIG;
+
+// Bus clock and timeout tuning from the errors seen on the wire. Every
+// windowTransfers transfers are judged together: an error rate above
+// maxErrorPermille steps the bit rate down one step of 10, 20, 50, 100,
+// 200 and 400 kHz, and doubles the read and write timeouts when timeouts
+// were among the errors. stepUpWindows windows in a row without errors or
+// retries step the bit rate up again, or halve the timeouts once it is as
+// high as it may go. A rate that failed is not tried again on the handle,
+// and timeouts are not halved below one that timed out. NACKs count
+// against the slave, not the link, and transferRetries is left alone.
+typedef struct
+{
+    DWORD   minBitRate;
+    DWORD   maxBitRate;
+    WORD    minTimeoutMs;       // Bounds of the read and write timeouts
+    WORD    maxTimeoutMs;
+    DWORD   windowTransfers;
+    DWORD   stepUpWindows;
+    DWORD   maxErrorPermille;
+    DWORD   sampleEvery;        // Reads per status query for their retry count, 0 = never
+} SMBUS_TUNE_CONFIG;
+
+// Counts of the windows judged so far
+typedef struct
+{
+    DWORD   transfers;
+    DWORD   errors;             // Bus not free, arbitration lost, incomplete or stuck
+    DWORD   timeouts;           // The errors other than arbitration lost
+    DWORD   retries;            // numRetries of the transfers whose status was seen
+    DWORD   stepsUp;            // Faster bit rate or shorter timeouts
+    DWORD   stepsDown;
+} SMBUS_TUNE_STATS;
+
+// Per-address circuit breaker. A slave that keeps NACKing or timing out is
+// quarantined: its transfers fail without touching the bus, except for one
+// probe per interval, and the first transfer that succeeds lets it back in.
+typedef struct
+{
+    DWORD   quarantineAfter;    // NACKs or timeouts in a row, 0 = never quarantine
+    DWORD   probeIntervalMs;    // Time between probes of a quarantined address
+} SMBUS_BREAKER_CONFIG;
+
+typedef struct
+{
+    DWORD   failures;           // NACKs or timeouts since the last success
+    BOOL    quarantined;
+    DWORD   skipped;            // Transfers refused while quarantined
+    DWORD   quarantines;        // Times the address has been quarantined
+    DWORD   pecErrors;          // Reads whose PEC did not match, retried or not
+} SMBUS_SLAVE_HEALTH;
+
+// What a slave allows SMBus_ReadBatch to do with its reads. With
+// autoIncrement, reads of neighbouring registers in one batch become one
+// block read starting at the lowest register, and the block is split back
+// into the descriptors. Up to maxGap registers nobody asked for may be
+// read in between, only allow that where reading them has no side effect.
+typedef struct
+{
+    BOOL    autoIncrement;      // A read continues into the following registers
+    BYTE    bytesPerRegister;   // Bytes between one register and the next, 0 = 1
+    BYTE    maxGap;
+    BOOL    pec;                // Append a PEC to writes, read and check one after read data
+} SMBUS_SLAVE_CAPS;
+
+// Register cache TTLs. Registers are volatile unless given a TTL; reads
+// of one register with a TTL are answered from the last bus read until it
+// runs out, and any write to the register drops the cached value.
+#define SMBUS_TTL_VOLATILE          0
+#define SMBUS_TTL_CONSTANT          INFINITE
+
+typedef struct
+{
+    DWORD   hits;
+    DWORD   misses;             // Registers with a TTL that had to be read
+} SMBUS_CACHE_STATS;
+
+// Handles from SMBus_Open survive recovery reopening the adapter behind
+// them; SMBus_GetHandle gives the library handle for direct backend calls
 INT SMBus_Open(HID_SMBUS_DEVICE *device);
+INT SMBus_GetSerials(HID_SMBUS_DEVICE_STR *serials, INT maxSerials);
+INT SMBus_OpenBySerial(HID_SMBUS_DEVICE *device, const char *serial);
+// Open by a serial and device index remembered from an earlier run. The
+// index is tried first without enumerating, another adapter there falls
+// back to SMBus_OpenBySerial and deviceNum is updated to where it was found.
+INT SMBus_OpenCached(HID_SMBUS_DEVICE *device, const char *serial, DWORD *deviceNum);
+INT SMBus_RefreshDevices(BOOL force);
+INT SMBus_LookupSerial(const char *serial, DWORD *deviceNum, char *path);
 INT SMBus_Close(HID_SMBUS_DEVICE device);
+BOOL SMBus_IsOpened(HID_SMBUS_DEVICE device);
 INT SMBus_Reset(HID_SMBUS_DEVICE device);
 INT SMBus_Configure(HID_SMBUS_DEVICE device, DWORD bitRate, BYTE address, BOOL autoReadRespond, WORD writeTimeout, WORD readTimeout, BOOL sclLowTimeout, WORD transferRetries, DWORD responseTimeout);
+// Like SMBus_Configure, but reads the settings back first and only writes
+// the ones that differ. The adapter keeps its settings until it is reset
+// or unplugged, so a restart usually writes nothing. Returns the number of
+// settings written, 0 to 2.
+INT SMBus_ConfigureIfChanged(HID_SMBUS_DEVICE device, const SMBUS_BUS_CONFIG *config);
+// GPIO pins, masks as in SLABCP2112.h. The pin setup is reapplied after
+// recovery reopens the adapter. Latch reads and writes are control
+// transfers and do not wait behind a transfer in progress. These four may
+// be called from a thread of their own next to the one doing transfers:
+// they wait while recovery replaces the adapter handle and fail while it
+// has not been reopened, the reopen is left to the transfer path.
+INT SMBus_SetGpioConfig(HID_SMBUS_DEVICE device, BYTE direction, BYTE mode, BYTE function, BYTE clkDiv);
+INT SMBus_GetGpioConfig(HID_SMBUS_DEVICE device, BYTE *direction, BYTE *mode, BYTE *function, BYTE *clkDiv);
+INT SMBus_ReadLatch(HID_SMBUS_DEVICE device, BYTE *latchValue);
+INT SMBus_WriteLatch(HID_SMBUS_DEVICE device, BYTE latchValue, BYTE latchMask);
 INT SMBus_Read(HID_SMBUS_DEVICE device, BYTE *buffer, BYTE slaveAddress, WORD numBytesToRead, BYTE targetAddressSize, BYTE *targetAddress);
-INT SMBus_Write(HID_SMBUS_DEVICE device, BYTE *buffer, BYTE slaveAddress, BYTE numBytesToWrite);
\ No newline at end of file
+INT SMBus_ReadBlock(HID_SMBUS_DEVICE device, BYTE *buffer, BYTE slaveAddress, WORD numBytesToRead, BYTE targetAddressSize, BYTE *targetAddress, SMBUS_PROGRESS_CALLBACK progress, void *context);
+// Polled read that gives up and cancels the transfer after timeoutMs
+INT SMBus_ReadTimeout(HID_SMBUS_DEVICE device, BYTE *buffer, BYTE slaveAddress, WORD numBytesToRead, BYTE targetAddressSize, BYTE *targetAddress, DWORD timeoutMs);
+INT SMBus_ReadBatch(HID_SMBUS_DEVICE device, SMBUS_READ_DESC *reads, WORD numReads);
+INT SMBus_Write(HID_SMBUS_DEVICE device, BYTE *buffer, BYTE slaveAddress, BYTE numBytesToWrite);
+// One write in flight per handle: SMBus_WriteAsync fails while the last
+// one is not collected, SMBus_WaitWrite fails at once when none is pending
+INT SMBus_WriteAsync(HID_SMBUS_DEVICE device, BYTE *buffer, BYTE slaveAddress, BYTE numBytesToWrite);
+INT SMBus_WaitWrite(HID_SMBUS_DEVICE device);
+INT SMBus_WriteBatch(HID_SMBUS_DEVICE device, SMBUS_WRITE_DESC *writes, WORD numWrites);
+// Write, then read back the register named by the first byte and compare
+// it with the rest. Returns 0 when it matches, SMBUS_WRITE_MISMATCH when
+// it does not, or -1 when either transfer failed.
+INT SMBus_WriteVerify(HID_SMBUS_DEVICE device, BYTE *buffer, BYTE slaveAddress, BYTE numBytesToWrite);
+// Writes in a row, then their readbacks as one read batch, per 16
+// descriptors. Each result is set as by SMBus_WriteVerify, returns the
+// number that matched.
+INT SMBus_WriteVerifyBatch(HID_SMBUS_DEVICE device, SMBUS_WRITE_DESC *writes, WORD numWrites);
+void SMBus_SetPollConfig(const SMBUS_POLL_CONFIG *config);
+void SMBus_SetRecoveryConfig(const SMBUS_RECOVERY_CONFIG *config);
+INT SMBus_GetRecoveryStats(HID_SMBUS_DEVICE device, SMBUS_RECOVERY_STATS *stats);
+void SMBus_SetBreakerConfig(const SMBUS_BREAKER_CONFIG *config);
+INT SMBus_GetSlaveHealth(HID_SMBUS_DEVICE device, BYTE slaveAddress, SMBUS_SLAVE_HEALTH *health);
+// Off for every slave until set
+INT SMBus_SetSlaveCaps(HID_SMBUS_DEVICE device, BYTE slaveAddress, const SMBUS_SLAVE_CAPS *caps);
+// Up to 32 registers per handle, returns -1 when the table is full
+INT SMBus_SetRegisterTtl(HID_SMBUS_DEVICE device, BYTE slaveAddress, BYTE reg, DWORD ttlMs);
+// For commands that change more than the register they are sent to
+void SMBus_InvalidateCache(HID_SMBUS_DEVICE device, BYTE slaveAddress);
+INT SMBus_GetCacheStats(HID_SMBUS_DEVICE device, SMBUS_CACHE_STATS *stats);
+// Settings as configured, or as tuned since
+INT SMBus_GetBusConfig(HID_SMBUS_DEVICE device, SMBUS_BUS_CONFIG *config);
+INT SMBus_GetSerial(HID_SMBUS_DEVICE device, HID_SMBUS_DEVICE_STR serial);
+// Off until set, needs SMBus_Configure first. NULL turns it off again.
+// Settings change between transfers, on the thread doing them.
+INT SMBus_SetAutoTune(HID_SMBUS_DEVICE device, const SMBUS_TUNE_CONFIG *config);
+INT SMBus_GetTuneStats(HID_SMBUS_DEVICE device, SMBUS_TUNE_STATS *stats);
+HID_SMBUS_DEVICE SMBus_GetHandle(HID_SMBUS_DEVICE device);
+void SMBus_SetBackend(const SMBUS_BACKEND *backend);
+const SMBUS_BACKEND *SMBus_GetBackend(void);
+
+#endif // SMBUS_H
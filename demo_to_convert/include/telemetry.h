@@ -0,0 +1,86 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <windows.h>
+#include "smbus.h"
+
+// Acquisition limits
+#define TELEMETRY_MAX_WORDS         16
+#define TELEMETRY_MAX_CONSUMERS     4
+
+// One fixed-size sample record
+typedef struct
+{
+    ULONGLONG   timestampUs;                    // Since Telemetry_Start
+    DWORD       sequence;
+    WORD        validMask;                      // Bit n set when raw[n] holds a value read
+    WORD        source;                         // Producer tag, e.g. the adapter index
+    WORD        raw[TELEMETRY_MAX_WORDS];       // Little-endian register words
+    WORD        freshMask;                      // Bit n set when raw[n] was read in this pass
+} TELEMETRY_SAMPLE;
+
+// How often one register is read
+typedef struct
+{
+    DWORD       periodMs;                       // 0 reads the register once
+    DWORD       slackMs;                        // How early a read may join another pass
+} TELEMETRY_RATE;
+
+// Single-consumer ring of samples, lock-free with one producer.
+// A shared ring serializes its producers so several acquisition
+// threads can feed one sink.
+typedef struct
+{
+    TELEMETRY_SAMPLE    *samples;
+    DWORD               capacity;               // Power of two
+    volatile LONG       head;                   // Written by the producer only
+    volatile LONG       tail;                   // Written by the consumer only
+    volatile LONG       dropped;                // Samples lost to a full ring
+    HANDLE              dataEvent;              // Signalled after each push
+    BOOL                shared;                 // Pushes take producerLock
+    CRITICAL_SECTION    producerLock;
+} TELEMETRY_RING;
+
+// Acquisition thread that owns the device while running
+typedef struct
+{
+    // Set by the caller before Telemetry_Start
+    HID_SMBUS_DEVICE    device;
+    BYTE                slaveAddress;
+    const BYTE          *registers;
+    INT                 numRegisters;
+    DWORD               periodMs;
+    const TELEMETRY_RATE *rates;                // Per register, NULL reads all every periodMs
+    TELEMETRY_RING      *rings[TELEMETRY_MAX_CONSUMERS];
+    INT                 numRings;
+    WORD                source;                 // Copied into every sample
+    LONGLONG            epoch;                  // QPC count timestamps count from, 0 for Telemetry_Start
+
+    // Owned by the acquisition thread
+    HANDLE              thread;
+    HANDLE              stopEvent;
+    HANDLE              timer;
+    HANDLE              triggerEvent;           // Set by Telemetry_Trigger
+    volatile LONG       triggered;              // Registers to read out of schedule
+    SMBUS_READ_DESC     reads[TELEMETRY_MAX_WORDS];
+    BYTE                data[TELEMETRY_MAX_WORDS][2];
+    LONGLONG            nextDue[TELEMETRY_MAX_WORDS];   // QPC deadline of each register's next read
+    volatile LONG       passes;                 // Bus passes made
+    volatile LONG       missed;                 // Reads that slipped a whole period
+    volatile LONG       triggers;               // Passes started by Telemetry_Trigger
+} TELEMETRY_ACQUISITION;
+
+INT Telemetry_RingInit(TELEMETRY_RING *ring, TELEMETRY_SAMPLE *storage, DWORD capacity);
+INT Telemetry_RingInitShared(TELEMETRY_RING *ring, TELEMETRY_SAMPLE *storage, DWORD capacity);
+void Telemetry_RingFree(TELEMETRY_RING *ring);
+BOOL Telemetry_RingPush(TELEMETRY_RING *ring, const TELEMETRY_SAMPLE *sample);
+BOOL Telemetry_RingPop(TELEMETRY_RING *ring, TELEMETRY_SAMPLE *sample);
+BOOL Telemetry_RingWait(TELEMETRY_RING *ring, DWORD timeoutMs);
+
+INT Telemetry_Start(TELEMETRY_ACQUISITION *acq);
+void Telemetry_Stop(TELEMETRY_ACQUISITION *acq);
+// Read registers[n] for every bit n in registerMask as soon as the bus is
+// free instead of at their next deadline. Any thread may call it.
+void Telemetry_Trigger(TELEMETRY_ACQUISITION *acq, WORD registerMask);
+
+#endif // TELEMETRY_H
@@ -0,0 +1,29 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <windows.h>
+#include "backend.h"
+
+// Handles a trace can tell apart
+#define TRACE_MAX_DEVICES           16
+
+// Transaction traces, one text line per device call:
+//   <time_us> <device> <call> <status> <arguments and results>
+// device is -1 for calls made without a handle. Data bytes are hex.
+
+// Pass every call on to inner and append it to the trace at path
+INT Trace_Record(const char *path, const SMBUS_BACKEND *inner);
+extern const SMBUS_BACKEND backendTraceRecord;
+
+// Answer calls from a recorded trace. Each device replays its own calls
+// in order, so traces of several adapter threads play back correctly.
+// With realTime the recorded gaps between calls are kept, otherwise the
+// trace runs as fast as it is consumed.
+INT Trace_Replay(const char *path, BOOL realTime);
+extern const SMBUS_BACKEND backendTraceReplay;
+
+// Calls that did not match the trace, or came after its end
+LONG Trace_Mismatches(void);
+void Trace_Close(void);
+
+#endif // TRACE_H
@@ -0,0 +1,109 @@
+#include <stdlib.h>
+#include <string.h>
+#include "backend.h"
+#include "simbus.h"
+#include "smbus.h"
+#include "trace.h"
+
+const SMBUS_BACKEND backendDll =
+{
+    "dll",
+    HidSmbus_GetNumDevices,
+    HidSmbus_GetString,
+    HidSmbus_GetOpenedString,
+    HidSmbus_Open,
+    HidSmbus_Close,
+    HidSmbus_IsOpened,
+    HidSmbus_ReadRequest,
+    HidSmbus_AddressReadRequest,
+    HidSmbus_ForceReadResponse,
+    HidSmbus_GetReadResponse,
+    HidSmbus_WriteRequest,
+    HidSmbus_TransferStatusRequest,
+    HidSmbus_GetTransferStatusResponse,
+    HidSmbus_CancelTransfer,
+    HidSmbus_CancelIo,
+    HidSmbus_SetTimeouts,
+    HidSmbus_GetTimeouts,
+    HidSmbus_SetSmbusConfig,
+    HidSmbus_GetSmbusConfig,
+    HidSmbus_Reset,
+    HidSmbus_SetGpioConfig,
+    HidSmbus_GetGpioConfig,
+    HidSmbus_ReadLatch,
+    HidSmbus_WriteLatch,
+    HidSmbus_GetPartNumber
+};
+
+// Backend options shared by the demo and the tools
+INT Backend_ParseArgs(INT argc, char *argv[])
+{
+    SIM_CONFIG          simConfig = { 1, 0xC8, 0, TRUE, FALSE };
+    const SMBUS_BACKEND *selected = &backendDll;
+    const char          *recordPath = NULL;
+    const char          *replayPath = NULL;
+    BOOL                realTime = FALSE;
+    INT                 numArgs = 1;
+
+    for (INT i = 1; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "-sim") == 0)
+        {
+            simConfig.numDevices = strtoul(argv[++i], NULL, 0);
+            selected = &backendSim;
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "-simslave") == 0)
+        {
+            simConfig.slaveAddress = (BYTE)strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "-simpec") == 0)
+        {
+            simConfig.pec = TRUE;
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "-latency") == 0)
+        {
+            simConfig.latencyUs = strtoul(argv[++i], NULL, 0);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "-record") == 0)
+        {
+            recordPath = argv[++i];
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "-replay") == 0)
+        {
+            replayPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "-realtime") == 0)
+        {
+            realTime = TRUE;
+        }
+        else
+        {
+            argv[numArgs++] = argv[i];
+        }
+    }
+    argv[numArgs] = NULL;
+
+    if (selected == &backendSim)
+    {
+        Sim_Configure(&simConfig);
+    }
+    if (replayPath != NULL)
+    {
+        if (Trace_Replay(replayPath, realTime) != 0)
+        {
+            return -1;
+        }
+        selected = &backendTraceReplay;
+    }
+    else if (recordPath != NULL)
+    {
+        if (Trace_Record(recordPath, selected) != 0)
+        {
+            return -1;
+        }
+        selected = &backendTraceRecord;
+    }
+    SMBus_SetBackend(selected);
+
+    return numArgs;
+}
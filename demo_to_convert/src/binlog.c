@@ -0,0 +1,158 @@
+#include "binlog.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+INT BinLog_ReadHeader(FILE *fp, BINLOG_HEADER *header)
+{
+    if (fseek(fp, 0, SEEK_SET) != 0 || fread(header, sizeof(*header), 1, fp) != 1)
+    {
+        return -1;
+    }
+
+    // Reject foreign files and layouts this build cannot decode
+    if (header->magic != BINLOG_MAGIC || header->version != BINLOG_VERSION ||
+        header->headerSize != BINLOG_HEADER_SIZE ||
+        header->numWords < 1 || header->numWords > TELEMETRY_MAX_WORDS ||
+        header->numChannels > BINLOG_MAX_CHANNELS ||
+        header->recordSize != BINLOG_RECORD_SIZE(header->numWords))
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+void BinLog_DecodeRecord(const BINLOG_HEADER *header, const BYTE *record, TELEMETRY_SAMPLE *sample)
+{
+    memcpy(&sample->timestampUs, &record[0], 8);
+    memcpy(&sample->sequence, &record[8], 4);
+    memcpy(&sample->validMask, &record[12], 2);
+    memcpy(sample->raw, &record[BINLOG_RECORD_FIXED], 2 * header->numWords);
+}
+
+INT BinLog_Open(BIN_LOG *log)
+{
+    BINLOG_HEADER   header;
+    BINLOG_HEADER   existing;
+    long            size;
+    long            torn;
+
+    if (log->numWords < 1 || log->numWords > TELEMETRY_MAX_WORDS || log->numChannels < 1 || log->numChannels > BINLOG_MAX_CHANNELS)
+    {
+        return -1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = BINLOG_MAGIC;
+    header.version = BINLOG_VERSION;
+    header.headerSize = BINLOG_HEADER_SIZE;
+    header.recordSize = BINLOG_RECORD_SIZE(log->numWords);
+    header.numWords = (UINT16)log->numWords;
+    header.numChannels = (UINT16)log->numChannels;
+    header.periodMs = (UINT32)log->periodMs;
+    memcpy(header.channels, log->channels, log->numChannels * sizeof(BINLOG_CHANNEL));
+
+    log->recordSize = header.recordSize;
+    log->used = 0;
+    log->lastFlushTick = GetTickCount();
+
+    // Append only, to a new file or to one with the same layout
+    log->fp = fopen(log->path, "a+b");
+    if (log->fp == NULL)
+    {
+        return -1;
+    }
+    fseek(log->fp, 0, SEEK_END);
+    size = ftell(log->fp);
+    if (size <= 0)
+    {
+        if (fwrite(&header, sizeof(header), 1, log->fp) != 1)
+        {
+            BinLog_Close(log);
+            return -1;
+        }
+    }
+    else
+    {
+        if (BinLog_ReadHeader(log->fp, &existing) != 0 || memcmp(&existing, &header, sizeof(header)) != 0)
+        {
+            BinLog_Close(log);
+            return -1;
+        }
+
+        // A record torn by a crash is completed with zeros so that later
+        // records stay aligned; its zero validMask marks it as empty
+        torn = (size - BINLOG_HEADER_SIZE) % log->recordSize;
+        if (torn != 0)
+        {
+            memset(log->buffer, 0, log->recordSize);
+            fseek(log->fp, 0, SEEK_END);
+            fwrite(log->buffer, 1, log->recordSize - torn, log->fp);
+        }
+    }
+    fflush(log->fp);
+    // Records are batched here already, skip the stdio copy
+    setvbuf(log->fp, NULL, _IONBF, 0);
+
+    return 0;
+}
+
+INT BinLog_Flush(BIN_LOG *log)
+{
+    INT result = 0;
+
+    if (log->fp == NULL)
+    {
+        return -1;
+    }
+
+    if (log->used > 0 && fwrite(log->buffer, 1, log->used, log->fp) != log->used)
+    {
+        result = -1;
+    }
+    log->used = 0;
+    log->lastFlushTick = GetTickCount();
+
+    return result;
+}
+
+INT BinLog_WriteSample(BIN_LOG *log, const TELEMETRY_SAMPLE *sample)
+{
+    BYTE *record;
+
+    if (log->used + log->recordSize > BINLOG_BUFFER_SIZE && BinLog_Flush(log) != 0)
+    {
+        return -1;
+    }
+
+    record = &log->buffer[log->used];
+    memset(record, 0, log->recordSize);
+    memcpy(&record[0], &sample->timestampUs, 8);
+    memcpy(&record[8], &sample->sequence, 4);
+    memcpy(&record[12], &sample->validMask, 2);
+    memcpy(&record[BINLOG_RECORD_FIXED], sample->raw, 2 * log->numWords);
+    log->used += log->recordSize;
+
+    return BinLog_Poll(log);
+}
+
+INT BinLog_Poll(BIN_LOG *log)
+{
+    if (log->used > 0 && log->flushIntervalMs != 0 && GetTickCount() - log->lastFlushTick >= log->flushIntervalMs)
+    {
+        return BinLog_Flush(log);
+    }
+
+    return 0;
+}
+
+void BinLog_Close(BIN_LOG *log)
+{
+    if (log->fp != NULL)
+    {
+        BinLog_Flush(log);
+        fclose(log->fp);
+        log->fp = NULL;
+    }
+}
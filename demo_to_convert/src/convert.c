@@ -0,0 +1,293 @@
+#include "convert.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CONVERT_HAVE_X86
+#include <immintrin.h>
+#endif
+
+static CONVERT_PATH convertPath = CONVERT_SCALAR;
+static BOOL         convertPathSet = FALSE;
+
+// 2^n as a float for the exponent range PMBus can encode
+static inline float Convert_Pow2(INT n)
+{
+    DWORD   bits = (DWORD)(n + 127) << 23;
+    float   value;
+
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+float Convert_Linear11Word(WORD raw)
+{
+    INT mantissa = (INT16)(raw << 5) >> 5;
+    INT exponent = (INT16)raw >> 11;
+
+    return (float)mantissa * Convert_Pow2(exponent);
+}
+
+float Convert_Linear16Word(WORD raw, INT exponent)
+{
+    return (float)raw * Convert_Pow2(exponent);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Scalar path
+/////////////////////////////////////////////////////////////////////////////
+
+static void Convert_LinearFixedScalar(const WORD *raw, float *out, size_t count, float divisor, float offset)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        out[i] = (INT16)raw[i] / divisor + offset;
+    }
+}
+
+static void Convert_Linear11Scalar(const WORD *raw, float *out, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        out[i] = Convert_Linear11Word(raw[i]);
+    }
+}
+
+static void Convert_Linear16Scalar(const WORD *raw, float *out, size_t count, float scale)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        out[i] = (float)raw[i] * scale;
+    }
+}
+
+#ifdef CONVERT_HAVE_X86
+
+/////////////////////////////////////////////////////////////////////////////
+// SSE2 path, 8 words per step
+/////////////////////////////////////////////////////////////////////////////
+
+__attribute__((target("sse2")))
+static void Convert_LinearFixedSse2(const WORD *raw, float *out, size_t count, float divisor, float offset)
+{
+    __m128  vDivisor = _mm_set1_ps(divisor);
+    __m128  vOffset = _mm_set1_ps(offset);
+    size_t  i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i words = _mm_loadu_si128((const __m128i *)&raw[i]);
+        // Sign-extend by placing each word in the top half and shifting back down
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(words, words), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(words, words), 16);
+
+        _mm_storeu_ps(&out[i], _mm_add_ps(_mm_div_ps(_mm_cvtepi32_ps(lo), vDivisor), vOffset));
+        _mm_storeu_ps(&out[i + 4], _mm_add_ps(_mm_div_ps(_mm_cvtepi32_ps(hi), vDivisor), vOffset));
+    }
+    Convert_LinearFixedScalar(&raw[i], &out[i], count - i, divisor, offset);
+}
+
+__attribute__((target("sse2")))
+static inline __m128 Convert_Linear11Sse2Half(__m128i words32)
+{
+    // words32 holds the word in the top 16 bits of each lane
+    __m128i mantissa = _mm_srai_epi32(_mm_slli_epi32(words32, 5), 21);
+    __m128i exponent = _mm_srai_epi32(words32, 27);
+    __m128i pow2 = _mm_slli_epi32(_mm_add_epi32(exponent, _mm_set1_epi32(127)), 23);
+
+    return _mm_mul_ps(_mm_cvtepi32_ps(mantissa), _mm_castsi128_ps(pow2));
+}
+
+__attribute__((target("sse2")))
+static void Convert_Linear11Sse2(const WORD *raw, float *out, size_t count)
+{
+    __m128i zero = _mm_setzero_si128();
+    size_t  i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i words = _mm_loadu_si128((const __m128i *)&raw[i]);
+
+        _mm_storeu_ps(&out[i], Convert_Linear11Sse2Half(_mm_unpacklo_epi16(zero, words)));
+        _mm_storeu_ps(&out[i + 4], Convert_Linear11Sse2Half(_mm_unpackhi_epi16(zero, words)));
+    }
+    Convert_Linear11Scalar(&raw[i], &out[i], count - i);
+}
+
+__attribute__((target("sse2")))
+static void Convert_Linear16Sse2(const WORD *raw, float *out, size_t count, float scale)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128  vScale = _mm_set1_ps(scale);
+    size_t  i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i words = _mm_loadu_si128((const __m128i *)&raw[i]);
+
+        _mm_storeu_ps(&out[i], _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero)), vScale));
+        _mm_storeu_ps(&out[i + 4], _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(words, zero)), vScale));
+    }
+    Convert_Linear16Scalar(&raw[i], &out[i], count - i, scale);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// AVX2 path, 16 words per step
+/////////////////////////////////////////////////////////////////////////////
+
+__attribute__((target("avx2")))
+static void Convert_LinearFixedAvx2(const WORD *raw, float *out, size_t count, float divisor, float offset)
+{
+    __m256  vDivisor = _mm256_set1_ps(divisor);
+    __m256  vOffset = _mm256_set1_ps(offset);
+    size_t  i = 0;
+
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256i lo = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)&raw[i]));
+        __m256i hi = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)&raw[i + 8]));
+
+        _mm256_storeu_ps(&out[i], _mm256_add_ps(_mm256_div_ps(_mm256_cvtepi32_ps(lo), vDivisor), vOffset));
+        _mm256_storeu_ps(&out[i + 8], _mm256_add_ps(_mm256_div_ps(_mm256_cvtepi32_ps(hi), vDivisor), vOffset));
+    }
+    Convert_LinearFixedScalar(&raw[i], &out[i], count - i, divisor, offset);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 Convert_Linear11Avx2Eight(const WORD *raw)
+{
+    __m256i words = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)raw));
+    __m256i mantissa = _mm256_srai_epi32(_mm256_slli_epi32(words, 21), 21);
+    __m256i exponent = _mm256_srai_epi32(words, 11);
+    __m256i pow2 = _mm256_slli_epi32(_mm256_add_epi32(exponent, _mm256_set1_epi32(127)), 23);
+
+    return _mm256_mul_ps(_mm256_cvtepi32_ps(mantissa), _mm256_castsi256_ps(pow2));
+}
+
+__attribute__((target("avx2")))
+static void Convert_Linear11Avx2(const WORD *raw, float *out, size_t count)
+{
+    size_t i = 0;
+
+    for (; i + 16 <= count; i += 16)
+    {
+        _mm256_storeu_ps(&out[i], Convert_Linear11Avx2Eight(&raw[i]));
+        _mm256_storeu_ps(&out[i + 8], Convert_Linear11Avx2Eight(&raw[i + 8]));
+    }
+    Convert_Linear11Scalar(&raw[i], &out[i], count - i);
+}
+
+__attribute__((target("avx2")))
+static void Convert_Linear16Avx2(const WORD *raw, float *out, size_t count, float scale)
+{
+    __m256  vScale = _mm256_set1_ps(scale);
+    size_t  i = 0;
+
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256i lo = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)&raw[i]));
+        __m256i hi = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)&raw[i + 8]));
+
+        _mm256_storeu_ps(&out[i], _mm256_mul_ps(_mm256_cvtepi32_ps(lo), vScale));
+        _mm256_storeu_ps(&out[i + 8], _mm256_mul_ps(_mm256_cvtepi32_ps(hi), vScale));
+    }
+    Convert_Linear16Scalar(&raw[i], &out[i], count - i, scale);
+}
+
+#endif // CONVERT_HAVE_X86
+
+/////////////////////////////////////////////////////////////////////////////
+// Dispatch
+/////////////////////////////////////////////////////////////////////////////
+
+static CONVERT_PATH Convert_BestPath(void)
+{
+#ifdef CONVERT_HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return CONVERT_AVX2;
+    }
+    if (__builtin_cpu_supports("sse2"))
+    {
+        return CONVERT_SSE2;
+    }
+#endif
+    return CONVERT_SCALAR;
+}
+
+CONVERT_PATH Convert_GetPath(void)
+{
+    if (!convertPathSet)
+    {
+        convertPath = Convert_BestPath();
+        convertPathSet = TRUE;
+    }
+
+    return convertPath;
+}
+
+void Convert_SetPath(CONVERT_PATH path)
+{
+    CONVERT_PATH best = Convert_BestPath();
+
+    // AVX2 implies SSE2, anything above the CPU's best falls back to scalar
+    convertPath = (path <= best) ? path : CONVERT_SCALAR;
+    convertPathSet = TRUE;
+}
+
+void Convert_LinearFixed(const WORD *raw, float *out, size_t count, float divisor, float offset)
+{
+    switch (Convert_GetPath())
+    {
+#ifdef CONVERT_HAVE_X86
+    case CONVERT_AVX2:
+        Convert_LinearFixedAvx2(raw, out, count, divisor, offset);
+        break;
+    case CONVERT_SSE2:
+        Convert_LinearFixedSse2(raw, out, count, divisor, offset);
+        break;
+#endif
+    default:
+        Convert_LinearFixedScalar(raw, out, count, divisor, offset);
+        break;
+    }
+}
+
+void Convert_Linear11(const WORD *raw, float *out, size_t count)
+{
+    switch (Convert_GetPath())
+    {
+#ifdef CONVERT_HAVE_X86
+    case CONVERT_AVX2:
+        Convert_Linear11Avx2(raw, out, count);
+        break;
+    case CONVERT_SSE2:
+        Convert_Linear11Sse2(raw, out, count);
+        break;
+#endif
+    default:
+        Convert_Linear11Scalar(raw, out, count);
+        break;
+    }
+}
+
+void Convert_Linear16(const WORD *raw, float *out, size_t count, INT exponent)
+{
+    float scale = Convert_Pow2(exponent);
+
+    switch (Convert_GetPath())
+    {
+#ifdef CONVERT_HAVE_X86
+    case CONVERT_AVX2:
+        Convert_Linear16Avx2(raw, out, count, scale);
+        break;
+    case CONVERT_SSE2:
+        Convert_Linear16Sse2(raw, out, count, scale);
+        break;
+#endif
+    default:
+        Convert_Linear16Scalar(raw, out, count, scale);
+        break;
+    }
+}
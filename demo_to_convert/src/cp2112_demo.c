@@ -3,6 +3,15 @@
 #include <string.h>
 #include <windows.h>
 #include "smbus.h"
+#include "telemetry.h"
+#include "gpio.h"
+#include "csvlog.h"
+#include "binlog.h"
+#include "lvdc4816.h"
+#include "deadband.h"
+#include "smbtiming.h"
+#include "smbtune.h"
+#include "trace.h"
 
 #define BITRATE_HZ                  100000
 #define ACK_ADDRESS                 0x02
@@ -12,6 +21,18 @@
 #define TRANSFER_RETRIES            0
 #define SCL_LOW_TIMEOUT             TRUE
 #define RESPONSE_TIMEOUT_MS         100
+#define SAMPLE_PERIOD_MS            500
+#define CONSOLE_RING_SIZE           256
+#define CSV_FLUSH_BYTES             4096
+#define CSV_FLUSH_INTERVAL_MS       5000
+#define CSV_ROTATE_BYTES            (64ull * 1024 * 1024)
+#define KEYFRAME_MS                 10000
+#define SMBALERT_GPIO               HID_SMBUS_MASK_GPIO_6
+#define POWER_GOOD_GPIO             HID_SMBUS_MASK_GPIO_5
+#define GPIO_POLL_MS                1
+#define GPIO_SOURCE                 0x100
+#define TUNE_PATH                   "cp2112_tune.txt"
+#define LAST_ADAPTER_PATH           "cp2112_last.txt"
 
 #define CHARGER_SLAVE_ADDRESS_W     0x12
 #define BATTERY_SLAVE_ADDRESS_W     0x16
@@ -22,31 +43,121 @@
 INT16 MFRversion_raw;
 INT16 HWOCP_raw;
 float HWOCP_A;
-INT16 temperature1_raw;
-float temperature1_C;
-INT16 temperature2_raw;
-float temperature2_C;
-INT16 HVvoltage_raw;
-float HVvoltage_V;
-INT16 LVvoltage_raw;
-float LVvoltage_V;
-INT16 I2_current_raw;
-float I2_current_A;
-INT16 I1_current_raw;
-float I1_current_A;
-INT16 I1_CNT;
-INT16 DUT_Status;
-int first_timeA = 0;
+float telemetryValues[LVDC4816_NUM_TELEMETRY];
+TELEMETRY_ACQUISITION acquisition;
+GPIO_WATCH gpioWatch;
+TELEMETRY_RING consoleRing;
+TELEMETRY_SAMPLE consoleSamples[CONSOLE_RING_SIZE];
+CSVLOG_COLUMN csvColumns[LVDC4816_NUM_TELEMETRY];
+BINLOG_CHANNEL logChannels[LVDC4816_NUM_TELEMETRY];
+CSV_LOG csvLog;
+BIN_LOG binLog;
+DEADBAND_FILTER changeFilter;
+char csvHeader[CSVLOG_MAX_ROW];
+BOOL binaryLog = FALSE;
+BOOL changesOnly = FALSE;
+BOOL coalesceReads = FALSE;
+BOOL usePec = FALSE;
+BOOL watchPins = FALSE;
+BOOL autoTune = FALSE;
+volatile LONG running = 1;
+// Bounds of -t, also applied to the settings the last run saved
+SMBUS_TUNE_CONFIG tuneConfig = { 10000, 400000, 10, 100, 200, 5, 10, 16 };
+volatile LONG dumpTiming = 0;
 int first_timeB = 0;
 
+// Milliseconds since the process was created, so startup includes loading the DLL
+static double MsSinceStart(void)
+{
+    FILETIME        creation, exited, kernel, user, now;
+    ULARGE_INTEGER  start, current;
+
+    GetProcessTimes(GetCurrentProcess(), &creation, &exited, &kernel, &user);
+    GetSystemTimePreciseAsFileTime(&now);
+    start.LowPart = creation.dwLowDateTime;
+    start.HighPart = creation.dwHighDateTime;
+    current.LowPart = now.dwLowDateTime;
+    current.HighPart = now.dwHighDateTime;
+
+    return (double)(current.QuadPart - start.QuadPart) / 10000.0;
+}
+
+// Ctrl+C ends the sampling loop so buffered rows are flushed on the way out,
+// Ctrl+Break prints the transaction latency histograms
+static BOOL WINAPI ConsoleHandler(DWORD ctrlType)
+{
+    if (ctrlType == CTRL_BREAK_EVENT)
+    {
+        InterlockedExchange(&dumpTiming, 1);
+        return TRUE;
+    }
+    InterlockedExchange(&running, 0);
+    return TRUE;
+}
+
 int main(int argc, char* argv[])
 {
     HID_SMBUS_DEVICE    m_hidSmbus;
     BYTE                buffer[HID_SMBUS_MAX_READ_RESPONSE_SIZE];
     BYTE                targetAddress[16];
     WORD                regLength;
-    // Open device
-    if(SMBus_Open(&m_hidSmbus) != 0)
+    TELEMETRY_SAMPLE    sample;
+    BYTE                configBlock[2][3];
+    SMBUS_WRITE_DESC    configWrites[2];
+    SMBUS_RECOVERY_STATS recovery;
+    SMBUS_CACHE_STATS   cache;
+    SMBUS_SLAVE_HEALTH  health;
+    LARGE_INTEGER       epoch;
+    HID_SMBUS_DEVICE_STR serial = "";
+    SMBUS_BUS_CONFIG    busConfig;
+    SMBUS_TUNE_STATS    tuning;
+    DWORD               deviceNum = 0;
+    DWORD               lastDeviceNum = 0;
+    BOOL                haveLast;
+    BOOL                firstSample = TRUE;
+    INT                 numWritten;
+    double              openedMs, configuredMs;
+    SMBTiming_Enable(TRUE);
+
+    // "-sim", "-record" and "-replay" pick the device backend
+    argc = Backend_ParseArgs(argc, argv);
+    if (argc < 0)
+    {
+        fprintf(stderr,"\r\nERROR: Could not open trace.\r\n");
+        return -1;
+    }
+
+    // "-b" logs raw words to outputA.bin instead, decode with binlog2csv.
+    // "-d" only logs words that moved past their deadband, plus keyframes.
+    // "-c" reads neighbouring telemetry registers in one block read.
+    // "-p" adds a PEC to every transfer with the LVDC4816.
+    // "-g" watches SMBALERT# and power-good, an alert reads DUT status at once.
+    // "-t" tunes bit rate and timeouts to the error rate, kept in cp2112_tune.txt.
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-b") == 0)
+            binaryLog = TRUE;
+        else if (strcmp(argv[i], "-d") == 0)
+            changesOnly = TRUE;
+        else if (strcmp(argv[i], "-c") == 0)
+            coalesceReads = TRUE;
+        else if (strcmp(argv[i], "-p") == 0)
+            usePec = TRUE;
+        else if (strcmp(argv[i], "-g") == 0)
+            watchPins = TRUE;
+        else if (strcmp(argv[i], "-t") == 0)
+            autoTune = TRUE;
+    }
+
+    // Open device, the adapter of the last run without enumerating.
+    // If it has been swapped for another since, any adapter will do.
+    haveLast = (SMBTune_LoadLast(LAST_ADAPTER_PATH, serial, &lastDeviceNum) == 0);
+    deviceNum = lastDeviceNum;
+    if (haveLast && SMBus_OpenCached(&m_hidSmbus, serial, &deviceNum) != 0)
+    {
+        haveLast = FALSE;
+    }
+    if(!haveLast && SMBus_Open(&m_hidSmbus) != 0)
     {
         fprintf(stderr,"\r\nERROR: Could not open device.\r\n");
         SMBus_Close(m_hidSmbus);
@@ -54,10 +165,36 @@ int main(int argc, char* argv[])
         getchar();
         return -1;
     }
+    openedMs = MsSinceStart();
     fprintf(stderr,"\r\nDevice successfully opened.\r\n");
 
-    // Configure device
-    if(SMBus_Configure(m_hidSmbus, BITRATE_HZ, ACK_ADDRESS, AUTO_RESPOND, WRITE_TIMEOUT_MS, READ_TIMEOUT_MS, SCL_LOW_TIMEOUT, TRANSFER_RETRIES, RESPONSE_TIMEOUT_MS) != 0)
+    // Remember where it was for the next run. Without its serial the tuned
+    // settings of some other adapter must not be picked up either.
+    if (SMBus_GetSerial(m_hidSmbus, serial) != 0)
+    {
+        serial[0] = '\0';
+    }
+    else if ((haveLast || SMBus_LookupSerial(serial, &deviceNum, NULL) == 0) && (!haveLast || deviceNum != lastDeviceNum))
+    {
+        SMBTune_SaveLast(LAST_ADAPTER_PATH, serial, deviceNum);
+    }
+
+    // Configure device, starting from what the last run tuned this adapter to.
+    // Settings the adapter still has from the last run are not written again.
+    busConfig.bitRate = BITRATE_HZ;
+    busConfig.address = ACK_ADDRESS;
+    busConfig.autoReadRespond = AUTO_RESPOND;
+    busConfig.writeTimeout = WRITE_TIMEOUT_MS;
+    busConfig.readTimeout = READ_TIMEOUT_MS;
+    busConfig.sclLowTimeout = SCL_LOW_TIMEOUT;
+    busConfig.transferRetries = TRANSFER_RETRIES;
+    busConfig.responseTimeout = RESPONSE_TIMEOUT_MS;
+    if (autoTune && SMBTune_Load(TUNE_PATH, serial, &tuneConfig, &busConfig) == 0)
+    {
+        fprintf(stderr,"Tuned settings: %lu Hz, %u ms timeouts.\r\n", busConfig.bitRate, busConfig.readTimeout);
+    }
+    numWritten = SMBus_ConfigureIfChanged(m_hidSmbus, &busConfig);
+    if(numWritten < 0)
     {
         fprintf(stderr,"ERROR: Could not configure device.\r\n");
         SMBus_Close(m_hidSmbus);
@@ -65,199 +202,280 @@ int main(int argc, char* argv[])
         getchar();
         return -1;
     }
-    fprintf(stderr,"Device successfully configured.\r\n");
+    configuredMs = MsSinceStart();
+    fprintf(stderr,"Device successfully configured, %d of 2 settings written.\r\n", numWritten);
+
+    if (autoTune && SMBus_SetAutoTune(m_hidSmbus, &tuneConfig) != 0)
+    {
+        fprintf(stderr,"ERROR: Could not enable auto-tuning.\r\n");
+        autoTune = FALSE;
+    }
+
+    // Transfer options for the LVDC4816 from the command line
+    if (coalesceReads || usePec)
+    {
+        SMBUS_SLAVE_CAPS caps = { coalesceReads, LVDC4816_BYTES_PER_REGISTER, 2, usePec };
+
+        SMBus_SetSlaveCaps(m_hidSmbus, LVDC4816_SLAVE_ADDRESS0x60_W, &caps);
+    }
+
+    // Constant and slow registers are served from the read cache
+    for (int i = 0; i < LVDC4816_NUM_REGISTERS; i++)
+    {
+        SMBus_SetRegisterTtl(m_hidSmbus, LVDC4816_SLAVE_ADDRESS0x60_W, lvdc4816Registers[i].address, lvdc4816Registers[i].ttlMs);
+    }
 
     // MFRversion [0x9B]
-    targetAddress[0] = 0x9B;
+    targetAddress[0] = LVDC4816_REG_MFR_VERSION;
     regLength = 2;
     if (SMBus_Read(m_hidSmbus, buffer, LVDC4816_SLAVE_ADDRESS0x60_W, regLength, 1, targetAddress) != regLength)
     {
         fprintf(stderr,"ERROR: Could not perform SMBus read 'MFRversion' Reg  %02X\r\n", targetAddress[0]);
-        // SMBus_Close(m_hidSmbus);
-        // return -1;
     }
-    MFRversion_raw = (buffer[1] << 8) | buffer[0];
-    MFRversion_raw = MFRversion_raw & 0xFFFF; // 16-bit 2's complement
-    fprintf(stderr, "MFRversion=0x%x\r\n", MFRversion_raw);
+    else
+    {
+        MFRversion_raw = LVDC4816_Raw_MFR_VERSION(buffer);
+        fprintf(stderr, "MFRversion=0x%x\r\n", MFRversion_raw);
+    }
 
     // HW OCP [0xEA]
-    targetAddress[0] = 0xEA;
+    targetAddress[0] = LVDC4816_REG_HW_OCP;
     regLength = 2;
     if (SMBus_Read(m_hidSmbus, buffer, LVDC4816_SLAVE_ADDRESS0x60_W, regLength, 1, targetAddress) != regLength)
     {
         fprintf(stderr,"ERROR: Could not perform SMBus read 'HW_OCP' Reg %02X\r\n", targetAddress[0]);
-        // SMBus_Close(m_hidSmbus);
-        // return -1;
     }
-    HWOCP_raw = (buffer[1] << 8) | buffer[0];
-    HWOCP_raw = HWOCP_raw & 0xFFFF; // 16-bit 2's complement
-    HWOCP_A = HWOCP_raw / 32.0f;
-    fprintf(stderr, "HWOCP=%2.2f\r\n", HWOCP_A);
-
-    // Write protect [0x10]
-    targetAddress[0] = 0x10;
-    buffer[0] = 0x10;
-    buffer[1] = 0;
-    regLength = 2;
-    if (SMBus_Write(m_hidSmbus, buffer, LVDC4816_SLAVE_ADDRESS0x60_W, regLength))
+    else
     {
-        fprintf(stderr,"ERROR: Could not perform SMBus write 'Write protect' Reg = %02X\r\n", targetAddress[0]);
-        // SMBus_Close(m_hidSmbus);
-        // return -1;
+        HWOCP_raw = LVDC4816_Raw_HW_OCP(buffer);
+        HWOCP_A = LVDC4816_Decode_HW_OCP(HWOCP_raw);
+        fprintf(stderr, "HWOCP=%2.2f\r\n", HWOCP_A);
     }
 
+    // Write protect [0x10]
+    configWrites[0].slaveAddress = LVDC4816_SLAVE_ADDRESS0x60_W;
+    configWrites[0].numBytesToWrite = LVDC4816_Pack_WRITE_PROTECT(0, configBlock[0]);
+    configWrites[0].buffer = configBlock[0];
+
     // HW OCP [0xEA]
-    targetAddress[0] = 0xEA;
     HWOCP_A = 600;
-    buffer[0] = 0xEA;
-    buffer[1] = ((UINT8)(HWOCP_A*32)&0xff);
-    buffer[2] = (UINT8)(((UINT16)(HWOCP_A*32)>>8)&0xff); // Set HW OCP to 600A
-    fprintf(stderr, "Setting HWOCP to %d \r\n", buffer[1]);
-    fprintf(stderr, "Setting HWOCP to %d \r\n", buffer[2]);
-        
-    regLength = 3;
-    if (SMBus_Write(m_hidSmbus, buffer, LVDC4816_SLAVE_ADDRESS0x60_W, regLength))
+    configWrites[1].slaveAddress = LVDC4816_SLAVE_ADDRESS0x60_W;
+    configWrites[1].numBytesToWrite = LVDC4816_Pack_HW_OCP(HWOCP_A, configBlock[1]); // Set HW OCP to 600A
+    configWrites[1].buffer = configBlock[1];
+    fprintf(stderr, "Setting HWOCP to %d \r\n", configBlock[1][1]);
+    fprintf(stderr, "Setting HWOCP to %d \r\n", configBlock[1][2]);
+
+    // Issue both writes, then read both back in one batch
+    if (SMBus_WriteVerifyBatch(m_hidSmbus, configWrites, 2) != 2)
     {
-        fprintf(stderr,"ERROR: Could not perform SMBus write. Reg = %02X\r\n", targetAddress[0]);
-        // SMBus_Close(m_hidSmbus);
-        // return -1;
+        for (int i = 0; i < 2; i++)
+        {
+            if (configWrites[i].result == SMBUS_WRITE_MISMATCH)
+            {
+                fprintf(stderr,"ERROR: SMBus write did not stick. Reg = %02X\r\n", configBlock[i][0]);
+            }
+            else if (configWrites[i].result != 0)
+            {
+                fprintf(stderr,"ERROR: Could not perform SMBus write. Reg = %02X\r\n", configBlock[i][0]);
+            }
+        }
     }
 
-    // HW OCP [0xEA]
-    targetAddress[0] = 0xEA;
-    regLength = 2;
-    if (SMBus_Read(m_hidSmbus, buffer, LVDC4816_SLAVE_ADDRESS0x60_W, regLength, 1, targetAddress) != regLength)
+    // HW OCP [0xEA], as read back
+    if (configWrites[1].result == 0)
     {
-        fprintf(stderr,"ERROR: Could not perform SMBus read. Reg = %02X\r\n", targetAddress[0]);
-        // SMBus_Close(m_hidSmbus);
-        // return -1;
+        HWOCP_raw = LVDC4816_Raw_HW_OCP(&configBlock[1][1]);
+        HWOCP_A = LVDC4816_Decode_HW_OCP(HWOCP_raw);
+        fprintf(stderr, "HWOCP=%2.2f\r\n", HWOCP_A);
     }
-    HWOCP_raw = (buffer[1] << 8) | buffer[0];
-    HWOCP_raw = HWOCP_raw & 0xFFFF; // 16-bit 2's complement
-    HWOCP_A = HWOCP_raw / 32.0f;
-    fprintf(stderr, "HWOCP=%2.2f\r\n", HWOCP_A);
 
-    while(1)
+    if (changesOnly)
     {
-        buffer[0] = 0;
-        buffer[1] = 0;
-        // Temperature1 [0x8D]
-        targetAddress[0] = 0x8D;
-        regLength = 2;
-        if (SMBus_Read(m_hidSmbus, buffer, LVDC4816_SLAVE_ADDRESS0x60_W, regLength, 1, targetAddress) != regLength)
+        changeFilter.deadbands = lvdc4816TelemetryDeadbands;
+        changeFilter.numWords = LVDC4816_NUM_TELEMETRY;
+        changeFilter.keyframeMs = KEYFRAME_MS;
+        Deadband_Init(&changeFilter);
+    }
+    if (binaryLog)
+    {
+        LVDC4816_TelemetryChannels(logChannels, LVDC4816_SLAVE_ADDRESS0x60_W);
+        binLog.path = "outputA.bin";
+        binLog.channels = logChannels;
+        binLog.numChannels = LVDC4816_NUM_TELEMETRY;
+        binLog.numWords = LVDC4816_NUM_TELEMETRY;
+        binLog.periodMs = SAMPLE_PERIOD_MS;
+        binLog.flushIntervalMs = CSV_FLUSH_INTERVAL_MS;
+        if (BinLog_Open(&binLog) != 0)
         {
-            fprintf(stderr,"ERROR: Could not perform SMBus read. Reg = %02X\r\n", targetAddress[0]);
-            // SMBus_Close(m_hidSmbus);
-            // return -1;
+            fprintf(stderr,"ERROR: Could not open %s.\r\n", binLog.path);
+            SMBus_Close(m_hidSmbus);
+            return -1;
         }
-        temperature1_raw = (buffer[1] << 8) | buffer[0];
-        temperature1_raw = temperature1_raw & 0xFFFF; // 16-bit 2's complement
-        temperature1_C = temperature1_raw / 32.0f - 40.0f;
-
-        // Temperature2 [0x8E]
-        targetAddress[0] = 0x8E;
-        regLength = 2;
-        if (SMBus_Read(m_hidSmbus, buffer, LVDC4816_SLAVE_ADDRESS0x60_W, regLength, 1, targetAddress) != regLength)
+    }
+    else
+    {
+        // Keep the CSV open for the whole run
+        LVDC4816_TelemetryColumns(csvColumns);
+        csvLog.path = "outputA.csv";
+        csvLog.header = &lvdc4816TelemetryHeader[1];
+        if (changesOnly)
         {
-            fprintf(stderr,"ERROR: Could not perform SMBus read. Reg = %02X\r\n", targetAddress[0]);
-            // SMBus_Close(m_hidSmbus);
-            // return -1;
+            // Sparse rows need their time, empty fields did not change.
+            // A file of their own keeps them out of existing full-row logs.
+            csvLog.path = "outputA_changes.csv";
+            snprintf(csvHeader, sizeof(csvHeader), "time_us%s", lvdc4816TelemetryHeader);
+            csvLog.header = csvHeader;
+            csvLog.sparse = TRUE;
         }
-        temperature2_raw = (buffer[1] << 8) | buffer[0];
-        temperature2_raw = temperature2_raw & 0xFFFF; // 16-bit 2's complement
-        temperature2_C = temperature2_raw / 32.0f - 40.0f;
-
-        // HV [0x88]
-        targetAddress[0] = 0x88;
-        regLength = 2;
-        if (SMBus_Read(m_hidSmbus, buffer, LVDC4816_SLAVE_ADDRESS0x60_W, regLength, 1, targetAddress) != regLength)
+        csvLog.columns = csvColumns;
+        csvLog.numColumns = LVDC4816_NUM_TELEMETRY;
+        csvLog.flushBytes = CSV_FLUSH_BYTES;
+        csvLog.flushIntervalMs = CSV_FLUSH_INTERVAL_MS;
+        csvLog.rotateBytes = CSV_ROTATE_BYTES;
+        if (CsvLog_Open(&csvLog) != 0)
         {
-            fprintf(stderr,"ERROR: Could not perform SMBus read. Reg = %02X\r\n", targetAddress[0]);
-            // SMBus_Close(m_hidSmbus);
-            // return -1;
+            fprintf(stderr,"ERROR: Could not open %s.\r\n", csvLog.path);
+            SMBus_Close(m_hidSmbus);
+            return -1;
         }
-        HVvoltage_raw = (buffer[1] << 8) | buffer[0];
-        HVvoltage_raw = HVvoltage_raw & 0xFFFF; // 16-bit 2's complement
-        HVvoltage_V = HVvoltage_raw / 32.0f;
-
-        // LV [0x8B]
-        targetAddress[0] = 0x8B;
-        regLength = 2;
-        if (SMBus_Read(m_hidSmbus, buffer, LVDC4816_SLAVE_ADDRESS0x60_W, regLength, 1, targetAddress) != regLength)
+    }
+
+    // Hand the device to the acquisition thread, this thread only consumes samples.
+    // Pin edges share the ring and the time axis with the register samples.
+    if (watchPins)
+        Telemetry_RingInitShared(&consoleRing, consoleSamples, CONSOLE_RING_SIZE);
+    else
+        Telemetry_RingInit(&consoleRing, consoleSamples, CONSOLE_RING_SIZE);
+    QueryPerformanceCounter(&epoch);
+    acquisition.device = m_hidSmbus;
+    acquisition.slaveAddress = LVDC4816_SLAVE_ADDRESS0x60_W;
+    acquisition.registers = lvdc4816TelemetryRegs;
+    acquisition.numRegisters = LVDC4816_NUM_TELEMETRY;
+    acquisition.periodMs = SAMPLE_PERIOD_MS;
+    acquisition.rates = lvdc4816TelemetryRates;
+    acquisition.rings[0] = &consoleRing;
+    acquisition.numRings = 1;
+    acquisition.epoch = epoch.QuadPart;
+    // Pins are set up before the acquisition thread owns the bus. An alert
+    // before its first pass is not lost, that pass reads every register.
+    if (watchPins)
+    {
+        // All pins are inputs, only the two lines are logged
+        gpioWatch.device = m_hidSmbus;
+        gpioWatch.direction = 0x00;
+        gpioWatch.mode = 0x00;
+        gpioWatch.watchMask = SMBALERT_GPIO | POWER_GOOD_GPIO;
+        gpioWatch.alertMask = SMBALERT_GPIO;
+        gpioWatch.triggerMask = 1 << LVDC4816_TLM_DUT_STATUS;
+        gpioWatch.acq = &acquisition;
+        gpioWatch.pollIntervalMs = GPIO_POLL_MS;
+        gpioWatch.rings[0] = &consoleRing;
+        gpioWatch.numRings = 1;
+        gpioWatch.source = GPIO_SOURCE;
+        gpioWatch.epoch = epoch.QuadPart;
+        if (Gpio_Start(&gpioWatch) != 0)
         {
-            fprintf(stderr,"ERROR: Could not perform SMBus read. Reg = %02X\r\n", targetAddress[0]);
-            // SMBus_Close(m_hidSmbus);
-            // return -1;
+            fprintf(stderr,"ERROR: Could not start GPIO watch.\r\n");
+            watchPins = FALSE;
         }
-        LVvoltage_raw = (buffer[1] << 8) | buffer[0];
-        LVvoltage_raw = LVvoltage_raw & 0xFFFF; // 16-bit 2's complement
-        LVvoltage_V = LVvoltage_raw / 32.0f;
-
-        // I2 Current [0x8C]
-        targetAddress[0] = 0x8C;
-        regLength = 2;
-        if (SMBus_Read(m_hidSmbus, buffer, LVDC4816_SLAVE_ADDRESS0x60_W, regLength, 1, targetAddress) != regLength)
+    }
+
+    if (Telemetry_Start(&acquisition) != 0)
+    {
+        fprintf(stderr,"ERROR: Could not start acquisition.\r\n");
+        if (watchPins)
+            Gpio_Stop(&gpioWatch);
+        SMBus_Close(m_hidSmbus);
+        return -1;
+    }
+
+    SetConsoleCtrlHandler(ConsoleHandler, TRUE);
+    while(running)
+    {
+        if (InterlockedExchange(&dumpTiming, 0))
+        {
+            SMBTiming_Dump(stderr, FALSE);
+        }
+
+        // Wake up at least once per flush interval so rows never sit in the buffer
+        if (!Telemetry_RingWait(&consoleRing, CSV_FLUSH_INTERVAL_MS) || !Telemetry_RingPop(&consoleRing, &sample))
         {
-            fprintf(stderr,"ERROR: Could not perform SMBus read. Reg = %02X\r\n", targetAddress[0]);
-            // SMBus_Close(m_hidSmbus);
-            // return -1;
+            if (binaryLog)
+                BinLog_Poll(&binLog);
+            else
+                CsvLog_Poll(&csvLog);
+            continue;
         }
-        I2_current_raw = (buffer[1] << 8) | buffer[0];
-        I2_current_raw = I2_current_raw & 0xFFFF; // 16-bit 2's complement
-        I2_current_A = I2_current_raw / 32.0f;
-
-        // I1 Current [0x90]
-        targetAddress[0] = 0x90;
-        regLength = 2;
-        if (SMBus_Read(m_hidSmbus, buffer, LVDC4816_SLAVE_ADDRESS0x60_W, regLength, 1, targetAddress) != regLength)
+        if (sample.source == GPIO_SOURCE)
         {
-            fprintf(stderr,"ERROR: Could not perform SMBus read. Reg = %02X\r\n", targetAddress[0]);
-            // SMBus_Close(m_hidSmbus);
-            // return -1;
+            fprintf(stderr, "%llu us: SMBALERT#=%d, PG=%d\r\n", sample.timestampUs,
+                (sample.raw[GPIO_WORD_LATCH] & SMBALERT_GPIO) != 0, (sample.raw[GPIO_WORD_LATCH] & POWER_GOOD_GPIO) != 0);
+            continue;
         }
-        I1_current_raw = (buffer[1] << 8) | buffer[0];
-        I1_current_raw = I1_current_raw & 0xFFFF; // 16-bit 2's complement
-        I1_current_A = I1_current_raw / 32.0f;
-
-        // I1 CNT [0xCD]
-        targetAddress[0] = 0xCD;
-        regLength = 2;
-        if (SMBus_Read(m_hidSmbus, buffer, LVDC4816_SLAVE_ADDRESS0x60_W, regLength, 1, targetAddress) != regLength)
+
+        // Startup cost as the tooling that respawns us sees it
+        if (firstSample && sample.validMask == (1u << LVDC4816_NUM_TELEMETRY) - 1)
         {
-            fprintf(stderr,"ERROR: Could not perform SMBus read. Reg = %02X\r\n", targetAddress[0]);
-            // SMBus_Close(m_hidSmbus);
-            // return -1;
+            firstSample = FALSE;
+            fprintf(stderr, "First valid sample %.1f ms after process start (opened at %.1f ms, configured at %.1f ms)\r\n",
+                MsSinceStart(), openedMs, configuredMs);
         }
-        I1_CNT = (buffer[1] << 8) | buffer[0];
-        I1_CNT = I1_CNT & 0xFFFF; // 16-bit 2's complement
-        
-        // Status [0x79]
-        targetAddress[0] = 0x79;
-        regLength = 2;
-        if (SMBus_Read(m_hidSmbus, buffer, LVDC4816_SLAVE_ADDRESS0x60_W, regLength, 1, targetAddress) != regLength)
+
+        if (changesOnly && !Deadband_Filter(&changeFilter, &sample))
         {
-            fprintf(stderr,"ERROR: Could not perform SMBus read. Reg = %02X\r\n", targetAddress[0]);
-            // SMBus_Close(m_hidSmbus);
-            // return -1;
+            continue;
         }
-        DUT_Status = (buffer[1] << 8) | buffer[0];
-        DUT_Status = DUT_Status & 0xFFFF; // 16-bit 2's complement
-        
-        fprintf(stderr, "HV_V=%2.2f, LV_V=%2.2f, I1_A=%2.2f, I2_A=%2.2f, Temp1_C=%2.2f, Temp2_C=%2.2f, I1_CNT=%d, DUT_Status=0x%x\r\n", HVvoltage_V, LVvoltage_V, I1_current_A, I2_current_A, temperature1_C, temperature2_C, I1_CNT, DUT_Status);
-        //openfile("output.csv","a") and then write data
-        first_timeA ++;
-        FILE *fp;
-        fp = fopen("outputA.csv", "a");
-        if(first_timeA == 1)
-            fprintf(fp, "HV_V,LV_V,I1_A,I2_A,Temp1_C,Temp2_C,I1_CNT,DUT_Status\n");
-        fprintf(fp, "%2.2f,%2.2f,%2.2f,%2.2f,%2.2f,%2.2f,%d,0x%x\n", HVvoltage_V, LVvoltage_V, I1_current_A, I2_current_A, temperature1_C, temperature2_C, I1_CNT, DUT_Status);
-        fclose(fp);
-        // Sleep for 0.5 second
-        Sleep(500);
+        for (int i = 0; i < LVDC4816_NUM_TELEMETRY; i++)
+        {
+            if (!(sample.validMask & (1 << i)))
+            {
+                fprintf(stderr,"ERROR: Could not perform SMBus read. Reg = %02X\r\n", lvdc4816TelemetryRegs[i]);
+            }
+        }
+
+        LVDC4816_DecodeTelemetry(sample.raw, telemetryValues);
+        fprintf(stderr, "HV_V=%2.2f, LV_V=%2.2f, I1_A=%2.2f, I2_A=%2.2f, Temp1_C=%2.2f, Temp2_C=%2.2f, I1_CNT=%d, DUT_Status=0x%x\r\n",
+            telemetryValues[LVDC4816_TLM_HV_VOLTAGE], telemetryValues[LVDC4816_TLM_LV_VOLTAGE],
+            telemetryValues[LVDC4816_TLM_I1_CURRENT], telemetryValues[LVDC4816_TLM_I2_CURRENT],
+            telemetryValues[LVDC4816_TLM_TEMPERATURE1], telemetryValues[LVDC4816_TLM_TEMPERATURE2],
+            (INT16)sample.raw[LVDC4816_TLM_I1_CNT], sample.raw[LVDC4816_TLM_DUT_STATUS]);
+        if (binaryLog)
+            BinLog_WriteSample(&binLog, &sample);
+        else
+            CsvLog_WriteSample(&csvLog, &sample);
     }
 
     // Success
     fprintf(stderr, "Done! Exiting...\r\n");
+    if (watchPins)
+        Gpio_Stop(&gpioWatch);
+    Telemetry_Stop(&acquisition);
+    fprintf(stderr, "%ld bus passes, %ld missed deadlines\r\n", acquisition.passes, acquisition.missed);
+    if (watchPins)
+        fprintf(stderr, "%ld latch reads, %ld edges, %ld alerts, %ld errors\r\n", gpioWatch.polls, gpioWatch.edges, gpioWatch.alerts, gpioWatch.errors);
+    if (changesOnly)
+        fprintf(stderr, "%llu of %llu samples logged, %llu words\r\n", changeFilter.samplesOut, changeFilter.samplesIn, changeFilter.wordsOut);
+    Telemetry_RingFree(&consoleRing);
+    if (binaryLog)
+        BinLog_Close(&binLog);
+    else
+        CsvLog_Close(&csvLog);
+    if (SMBus_GetRecoveryStats(m_hidSmbus, &recovery) == 0)
+        fprintf(stderr, "%lu cancels, %lu resets, %lu reopens, %lu failed reopens\r\n", recovery.cancels, recovery.resets, recovery.reopens, recovery.failedReopens);
+    if (SMBus_GetCacheStats(m_hidSmbus, &cache) == 0)
+        fprintf(stderr, "%lu cache hits, %lu misses\r\n", cache.hits, cache.misses);
+    if (autoTune && SMBus_GetTuneStats(m_hidSmbus, &tuning) == 0 && SMBus_GetBusConfig(m_hidSmbus, &busConfig) == 0)
+    {
+        fprintf(stderr, "%lu transfers, %lu errors, %lu retries, tuned to %lu Hz, %u ms timeouts\r\n",
+            tuning.transfers, tuning.errors, tuning.retries, busConfig.bitRate, busConfig.readTimeout);
+        if (SMBus_GetSerial(m_hidSmbus, serial) != 0 || SMBTune_Save(TUNE_PATH, serial, &busConfig) != 0)
+            fprintf(stderr,"ERROR: Could not save %s.\r\n", TUNE_PATH);
+    }
+    if (usePec && SMBus_GetSlaveHealth(m_hidSmbus, LVDC4816_SLAVE_ADDRESS0x60_W, &health) == 0)
+        fprintf(stderr, "%lu PEC errors\r\n", health.pecErrors);
     SMBus_Close(m_hidSmbus);
+    if (SMBus_GetBackend() == &backendTraceReplay)
+        fprintf(stderr, "Replay mismatches: %ld\r\n", Trace_Mismatches());
+    Trace_Close();
     return 0;
 }
@@ -0,0 +1,247 @@
+#include "csvlog.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Write an unsigned decimal, returns the new end of the text
+static char *CsvLog_PutUInt(char *p, ULONGLONG value)
+{
+    char    digits[20];
+    INT     n = 0;
+
+    do
+    {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    while (n > 0)
+    {
+        *p++ = digits[--n];
+    }
+
+    return p;
+}
+
+// Same text as "%2.2f" for the magnitudes a register word can scale to.
+// A float times 100 is exact in a double, so only a value exactly halfway
+// between two hundredths needs a rule: away from zero, as msvcrt.dll does.
+// Negative values that round to zero keep their sign, "-0.00".
+static char *CsvLog_PutFixed2(char *p, float value)
+{
+    ULONGLONG hundredths = (ULONGLONG)floor(fabs((double)value) * 100.0 + 0.5);
+
+    if (value < 0)
+    {
+        *p++ = '-';
+    }
+    p = CsvLog_PutUInt(p, hundredths / 100);
+    *p++ = '.';
+    *p++ = (char)('0' + (hundredths / 10) % 10);
+    *p++ = (char)('0' + hundredths % 10);
+
+    return p;
+}
+
+// "0x%x" of the word as an INT16, so a negative one shows all 32 bits
+static char *CsvLog_PutHex(char *p, INT16 word)
+{
+    static const char   hex[] = "0123456789abcdef";
+    DWORD               value = (DWORD)(INT)word;
+    INT                 shift = 28;
+
+    *p++ = '0';
+    *p++ = 'x';
+    // No leading zeros, matching "0x%x"
+    while (shift > 0 && ((value >> shift) & 0xF) == 0)
+    {
+        shift -= 4;
+    }
+    for (; shift >= 0; shift -= 4)
+    {
+        *p++ = hex[(value >> shift) & 0xF];
+    }
+
+    return p;
+}
+
+// Open the current file of the rotation and write its header if it is new
+static INT CsvLog_OpenFile(CSV_LOG *log)
+{
+    char        path[MAX_PATH];
+    const char  *ext;
+    long        size;
+
+    if (log->rotation == 0)
+    {
+        snprintf(path, sizeof(path), "%s", log->path);
+    }
+    else
+    {
+        // outputA.csv -> outputA_001.csv
+        ext = strrchr(log->path, '.');
+        if (ext == NULL)
+        {
+            ext = log->path + strlen(log->path);
+        }
+        snprintf(path, sizeof(path), "%.*s_%03lu%s", (int)(ext - log->path), log->path, log->rotation, ext);
+    }
+
+    // Binary with CRLF rows, the same bytes text mode wrote before
+    log->fp = fopen(path, "ab");
+    if (log->fp == NULL)
+    {
+        return -1;
+    }
+    // Rows are batched here already, skip the stdio copy
+    setvbuf(log->fp, NULL, _IONBF, 0);
+
+    fseek(log->fp, 0, SEEK_END);
+    size = ftell(log->fp);
+    log->fileBytes = (size > 0) ? (ULONGLONG)size : 0;
+    if (log->fileBytes == 0 && log->header != NULL)
+    {
+        log->fileBytes = fwrite(log->header, 1, strlen(log->header), log->fp);
+        log->fileBytes += fwrite("\r\n", 1, 2, log->fp);
+    }
+
+    return 0;
+}
+
+INT CsvLog_Open(CSV_LOG *log)
+{
+    if (log->numColumns < 1 || log->numColumns > CSVLOG_MAX_COLUMNS)
+    {
+        return -1;
+    }
+    if (log->flushBytes == 0 || log->flushBytes > CSVLOG_BUFFER_SIZE - CSVLOG_MAX_ROW)
+    {
+        log->flushBytes = CSVLOG_BUFFER_SIZE - CSVLOG_MAX_ROW;
+    }
+
+    log->used = 0;
+    log->rotation = 0;
+    log->lastFlushTick = GetTickCount();
+
+    return CsvLog_OpenFile(log);
+}
+
+// Hand the buffered rows to the file in one write
+static INT CsvLog_WriteBuffer(CSV_LOG *log)
+{
+    INT result = 0;
+
+    if (log->used > 0)
+    {
+        if (fwrite(log->buffer, 1, log->used, log->fp) != log->used)
+        {
+            result = -1;
+        }
+        log->fileBytes += log->used;
+        log->used = 0;
+    }
+    log->lastFlushTick = GetTickCount();
+
+    return result;
+}
+
+INT CsvLog_Flush(CSV_LOG *log)
+{
+    INT result;
+
+    if (log->fp == NULL)
+    {
+        return -1;
+    }
+
+    result = CsvLog_WriteBuffer(log);
+
+    // Rotate on a row boundary once the file is full
+    if (log->rotateBytes != 0 && log->fileBytes >= log->rotateBytes)
+    {
+        fclose(log->fp);
+        log->fp = NULL;
+        log->rotation++;
+        if (CsvLog_OpenFile(log) != 0)
+        {
+            result = -1;
+        }
+    }
+
+    return result;
+}
+
+INT CsvLog_WriteSample(CSV_LOG *log, const TELEMETRY_SAMPLE *sample)
+{
+    char    *p = &log->buffer[log->used];
+    WORD    raw;
+
+    // Sparse rows are only meaningful with their time
+    if (log->sparse)
+    {
+        p = CsvLog_PutUInt(p, sample->timestampUs);
+    }
+
+    // Format the whole row straight into the buffer
+    for (INT i = 0; i < log->numColumns; i++)
+    {
+        raw = sample->raw[log->columns[i].word];
+        if (i > 0 || log->sparse)
+        {
+            *p++ = ',';
+        }
+        if (log->sparse && !(sample->freshMask & (1 << log->columns[i].word)))
+        {
+            continue;
+        }
+        switch (log->columns[i].format)
+        {
+        case CSVLOG_FIXED2:
+            p = CsvLog_PutFixed2(p, (INT16)raw / log->columns[i].divisor + log->columns[i].offset);
+            break;
+        case CSVLOG_INT:
+            if ((INT16)raw < 0)
+            {
+                *p++ = '-';
+            }
+            p = CsvLog_PutUInt(p, (ULONGLONG)abs((INT16)raw));
+            break;
+        case CSVLOG_HEX:
+            p = CsvLog_PutHex(p, (INT16)raw);
+            break;
+        }
+    }
+    *p++ = '\r';
+    *p++ = '\n';
+    log->used = (DWORD)(p - log->buffer);
+
+    // Size threshold always leaves room for one more row
+    if (log->used >= log->flushBytes)
+    {
+        return CsvLog_Flush(log);
+    }
+
+    return CsvLog_Poll(log);
+}
+
+INT CsvLog_Poll(CSV_LOG *log)
+{
+    // Time threshold, also called by the consumer while it is idle
+    if (log->used > 0 && log->flushIntervalMs != 0 && GetTickCount() - log->lastFlushTick >= log->flushIntervalMs)
+    {
+        return CsvLog_Flush(log);
+    }
+
+    return 0;
+}
+
+void CsvLog_Close(CSV_LOG *log)
+{
+    if (log->fp != NULL)
+    {
+        CsvLog_WriteBuffer(log);
+        fclose(log->fp);
+        log->fp = NULL;
+    }
+}
@@ -0,0 +1,72 @@
+#include "deadband.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+INT Deadband_Init(DEADBAND_FILTER *filter)
+{
+    if (filter->numWords < 1 || filter->numWords > TELEMETRY_MAX_WORDS)
+    {
+        return -1;
+    }
+
+    memset(filter->last, 0, sizeof(filter->last));
+    filter->lastValid = 0;
+    filter->lastKeyframeUs = 0;
+    filter->started = FALSE;
+    filter->samplesIn = 0;
+    filter->samplesOut = 0;
+    filter->wordsOut = 0;
+
+    return 0;
+}
+
+BOOL Deadband_Filter(DEADBAND_FILTER *filter, TELEMETRY_SAMPLE *sample)
+{
+    WORD    changed = 0;
+    WORD    allWords = (WORD)((1u << filter->numWords) - 1);
+
+    filter->samplesIn++;
+
+    // Keyframes carry every word so a reader can start anywhere
+    if (!filter->started || (filter->keyframeMs != 0 && sample->timestampUs - filter->lastKeyframeUs >= (ULONGLONG)filter->keyframeMs * 1000))
+    {
+        filter->started = TRUE;
+        filter->lastKeyframeUs = sample->timestampUs;
+        changed = allWords;
+    }
+    else
+    {
+        // Validity changes always count, values only past their deadband.
+        // Words are compared signed, as the register map decodes them.
+        changed = (WORD)((sample->validMask ^ filter->lastValid) & allWords);
+        for (INT i = 0; i < filter->numWords; i++)
+        {
+            INT deadband = (filter->deadbands != NULL) ? filter->deadbands[i] : 0;
+
+            if ((sample->freshMask & (1 << i)) && abs((INT16)sample->raw[i] - (INT16)filter->last[i]) > deadband)
+            {
+                changed |= (WORD)(1 << i);
+            }
+        }
+        if (changed == 0)
+        {
+            return FALSE;
+        }
+    }
+
+    // Remember what the loggers saw, unsent words keep drifting against it
+    for (INT i = 0; i < filter->numWords; i++)
+    {
+        if (changed & (1 << i))
+        {
+            filter->last[i] = sample->raw[i];
+            filter->wordsOut++;
+        }
+    }
+    filter->lastValid = (WORD)((filter->lastValid & ~changed) | (sample->validMask & changed));
+    sample->freshMask = changed;
+    filter->samplesOut++;
+
+    return TRUE;
+}
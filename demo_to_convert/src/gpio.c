@@ -0,0 +1,141 @@
+#include "gpio.h"
+
+#include <string.h>
+
+// Wait after a failed latch read before the next one
+#define GPIO_ERROR_BACKOFF_MS       10
+
+static void Gpio_Push(GPIO_WATCH *watch, TELEMETRY_SAMPLE *sample, LONGLONG start, LONGLONG frequency, BYTE changed, WORD missed)
+{
+    LARGE_INTEGER now;
+
+    QueryPerformanceCounter(&now);
+    sample->timestampUs = (ULONGLONG)(now.QuadPart - start) * 1000000 / (ULONGLONG)frequency;
+    sample->raw[GPIO_WORD_LATCH] = watch->latch;
+    sample->raw[GPIO_WORD_CHANGED] = changed;
+    sample->raw[GPIO_WORD_MISSED] = missed;
+    for (INT i = 0; i < watch->numRings; i++)
+    {
+        Telemetry_RingPush(watch->rings[i], sample);
+    }
+    sample->sequence++;
+    InterlockedIncrement(&watch->edges);
+}
+
+static DWORD WINAPI Gpio_Thread(LPVOID param)
+{
+    GPIO_WATCH          *watch = (GPIO_WATCH *)param;
+    TELEMETRY_SAMPLE    sample;
+    LARGE_INTEGER       freq, start;
+    DWORD               waitMs = watch->pollIntervalMs;
+    WORD                missed = 0;
+
+    memset(&sample, 0, sizeof(sample));
+    sample.source = watch->source;
+    sample.validMask = (1 << GPIO_WORD_LATCH) | (1 << GPIO_WORD_CHANGED) | (1 << GPIO_WORD_MISSED);
+    sample.freshMask = sample.validMask;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&start);
+    // A common epoch puts edges on the acquisition's time axis
+    if (watch->epoch != 0)
+    {
+        start.QuadPart = watch->epoch;
+    }
+
+    // The levels the watch starts from, nothing changed yet
+    Gpio_Push(watch, &sample, start.QuadPart, freq.QuadPart, 0, 0);
+
+    while (WaitForSingleObject(watch->stopEvent, waitMs) == WAIT_TIMEOUT)
+    {
+        BYTE latch, changed;
+
+        waitMs = watch->pollIntervalMs;
+        InterlockedIncrement(&watch->polls);
+        if (SMBus_ReadLatch(watch->device, &latch) != 0)
+        {
+            InterlockedIncrement(&watch->errors);
+            if (missed < 0xFFFF)
+            {
+                missed++;
+            }
+            waitMs = GPIO_ERROR_BACKOFF_MS;
+            continue;
+        }
+
+        changed = (BYTE)((latch ^ watch->latch) & watch->watchMask);
+        if (changed == 0)
+        {
+            missed = 0;
+            continue;
+        }
+        watch->latch = latch;
+
+        // Status first, the sample can wait for the acquisition thread to wake
+        if (watch->acq != NULL && (changed & watch->alertMask & ~latch) != 0)
+        {
+            Telemetry_Trigger(watch->acq, watch->triggerMask);
+            InterlockedIncrement(&watch->alerts);
+        }
+        Gpio_Push(watch, &sample, start.QuadPart, freq.QuadPart, changed, missed);
+        missed = 0;
+    }
+
+    return 0;
+}
+
+INT Gpio_Start(GPIO_WATCH *watch)
+{
+    watch->thread = NULL;
+    watch->stopEvent = NULL;
+    watch->polls = 0;
+    watch->edges = 0;
+    watch->alerts = 0;
+    watch->errors = 0;
+    if (watch->numRings > TELEMETRY_MAX_CONSUMERS)
+    {
+        return -1;
+    }
+
+    // Configure pins
+    if (SMBus_SetGpioConfig(watch->device, watch->direction, watch->mode, watch->function, watch->clkDiv) != 0)
+    {
+        return -1;
+    }
+
+    // Levels to find the first edge against
+    if (SMBus_ReadLatch(watch->device, &watch->latch) != 0)
+    {
+        return -1;
+    }
+
+    watch->stopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (watch->stopEvent == NULL)
+    {
+        return -1;
+    }
+
+    watch->thread = CreateThread(NULL, 0, Gpio_Thread, watch, 0, NULL);
+    if (watch->thread == NULL)
+    {
+        Gpio_Stop(watch);
+        return -1;
+    }
+
+    return 0;
+}
+
+void Gpio_Stop(GPIO_WATCH *watch)
+{
+    if (watch->thread != NULL)
+    {
+        SetEvent(watch->stopEvent);
+        WaitForSingleObject(watch->thread, INFINITE);
+        CloseHandle(watch->thread);
+        watch->thread = NULL;
+    }
+    if (watch->stopEvent != NULL)
+    {
+        CloseHandle(watch->stopEvent);
+        watch->stopEvent = NULL;
+    }
+}
@@ -0,0 +1,74 @@
+#include "lvdc4816.h"
+
+#include <string.h>
+
+#define LVDC4816_X_INFO(name, address, width, endian, divisor, offset, format, cache) \
+    { #name, address, width, LVDC4816_##endian, CSVLOG_##format, divisor, offset, LVDC4816_TTL_##cache },
+const LVDC4816_REG_INFO lvdc4816Registers[LVDC4816_NUM_REGISTERS] =
+{
+    LVDC4816_REGISTERS(LVDC4816_X_INFO)
+};
+
+#define LVDC4816_X_TLM_REG(reg, column, periodMs, slackMs, deadband) LVDC4816_REG_##reg,
+const BYTE lvdc4816TelemetryRegs[LVDC4816_NUM_TELEMETRY] =
+{
+    LVDC4816_TELEMETRY(LVDC4816_X_TLM_REG)
+};
+
+#define LVDC4816_X_TLM_RATE(reg, column, periodMs, slackMs, deadband) { periodMs, slackMs },
+const TELEMETRY_RATE lvdc4816TelemetryRates[LVDC4816_NUM_TELEMETRY] =
+{
+    LVDC4816_TELEMETRY(LVDC4816_X_TLM_RATE)
+};
+
+#define LVDC4816_X_TLM_DEADBAND(reg, column, periodMs, slackMs, deadband) deadband,
+const WORD lvdc4816TelemetryDeadbands[LVDC4816_NUM_TELEMETRY] =
+{
+    LVDC4816_TELEMETRY(LVDC4816_X_TLM_DEADBAND)
+};
+
+#define LVDC4816_X_TLM_NAME(reg, column, periodMs, slackMs, deadband) column,
+const char *const lvdc4816TelemetryNames[LVDC4816_NUM_TELEMETRY] =
+{
+    LVDC4816_TELEMETRY(LVDC4816_X_TLM_NAME)
+};
+
+// Comma-separated column names; skip the leading comma
+#define LVDC4816_X_TLM_HEADER(reg, column, periodMs, slackMs, deadband) "," column
+const char lvdc4816TelemetryHeader[] = LVDC4816_TELEMETRY(LVDC4816_X_TLM_HEADER);
+
+#define LVDC4816_X_TLM_ID(reg, column, periodMs, slackMs, deadband) LVDC4816_ID_##reg,
+static const BYTE telemetryIds[LVDC4816_NUM_TELEMETRY] =
+{
+    LVDC4816_TELEMETRY(LVDC4816_X_TLM_ID)
+};
+
+void LVDC4816_TelemetryColumns(CSVLOG_COLUMN *columns)
+{
+    for (INT i = 0; i < LVDC4816_NUM_TELEMETRY; i++)
+    {
+        const LVDC4816_REG_INFO *info = &lvdc4816Registers[telemetryIds[i]];
+
+        columns[i].word = (BYTE)i;
+        columns[i].format = info->format;
+        columns[i].divisor = info->divisor;
+        columns[i].offset = info->offset;
+    }
+}
+
+void LVDC4816_TelemetryChannels(BINLOG_CHANNEL *channels, BYTE slaveAddress)
+{
+    for (INT i = 0; i < LVDC4816_NUM_TELEMETRY; i++)
+    {
+        const LVDC4816_REG_INFO *info = &lvdc4816Registers[telemetryIds[i]];
+
+        memset(&channels[i], 0, sizeof(channels[i]));
+        channels[i].word = (BYTE)i;
+        channels[i].format = (BYTE)info->format;
+        channels[i].slaveAddress = slaveAddress;
+        channels[i].reg = info->address;
+        channels[i].divisor = info->divisor;
+        channels[i].offset = info->offset;
+        strncpy(channels[i].name, lvdc4816TelemetryNames[i], BINLOG_NAME_LEN - 1);
+    }
+}
@@ -0,0 +1,113 @@
+#include "rack.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Open every enumerated adapter by serial, returns the number opened
+INT Rack_Open(RACK *rack)
+{
+    HID_SMBUS_DEVICE_STR    serials[RACK_MAX_ADAPTERS];
+    INT                     numSerials;
+    INT                     numOpened = 0;
+
+    memset(rack->adapters, 0, sizeof(rack->adapters));
+    rack->numAdapters = 0;
+
+    // Enumerate devices
+    numSerials = SMBus_GetSerials(serials, RACK_MAX_ADAPTERS);
+    // Check status
+    if (numSerials < 0)
+    {
+        return -1;
+    }
+
+    // Keep an entry for every adapter found so indices stay stable
+    // even when one of them fails to open
+    for (INT i = 0; i < numSerials; i++)
+    {
+        RACK_ADAPTER *adapter = &rack->adapters[i];
+
+        strcpy(adapter->serial, serials[i]);
+        if (SMBus_OpenBySerial(&adapter->device, adapter->serial) == 0)
+        {
+            adapter->opened = TRUE;
+            numOpened++;
+        }
+    }
+    rack->numAdapters = numSerials;
+
+    return numOpened;
+}
+
+INT Rack_Start(RACK *rack)
+{
+    LARGE_INTEGER   epoch;
+    INT             numStarted = 0;
+
+    if (rack->sink == NULL || !rack->sink->shared)
+    {
+        return -1;
+    }
+
+    // One time base for the whole rack
+    QueryPerformanceCounter(&epoch);
+    for (INT i = 0; i < rack->numAdapters; i++)
+    {
+        RACK_ADAPTER            *adapter = &rack->adapters[i];
+        TELEMETRY_ACQUISITION   *acq = &adapter->acquisition;
+
+        if (!adapter->opened)
+        {
+            continue;
+        }
+
+        acq->device = adapter->device;
+        acq->slaveAddress = rack->slaveAddress;
+        acq->registers = rack->registers;
+        acq->numRegisters = rack->numRegisters;
+        acq->periodMs = rack->periodMs;
+        acq->rates = rack->rates;
+        acq->rings[0] = rack->sink;
+        acq->numRings = 1;
+        acq->source = (WORD)i;
+        acq->epoch = epoch.QuadPart;
+        if (Telemetry_Start(acq) != 0)
+        {
+            Rack_Stop(rack);
+            return -1;
+        }
+        numStarted++;
+    }
+
+    return numStarted;
+}
+
+void Rack_Stop(RACK *rack)
+{
+    // Signal every thread first so they wind down in parallel
+    for (INT i = 0; i < rack->numAdapters; i++)
+    {
+        if (rack->adapters[i].acquisition.thread != NULL)
+        {
+            SetEvent(rack->adapters[i].acquisition.stopEvent);
+        }
+    }
+    for (INT i = 0; i < rack->numAdapters; i++)
+    {
+        Telemetry_Stop(&rack->adapters[i].acquisition);
+    }
+}
+
+void Rack_Close(RACK *rack)
+{
+    Rack_Stop(rack);
+    for (INT i = 0; i < rack->numAdapters; i++)
+    {
+        if (rack->adapters[i].opened)
+        {
+            SMBus_Close(rack->adapters[i].device);
+            rack->adapters[i].opened = FALSE;
+        }
+    }
+    rack->numAdapters = 0;
+}
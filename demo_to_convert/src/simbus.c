@@ -0,0 +1,729 @@
+#include "simbus.h"
+#include "lvdc4816.h"
+#include "smbpec.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define SIM_REPORT_SIZE             HID_SMBUS_MAX_READ_RESPONSE_SIZE
+
+// Transfer in flight on one adapter
+typedef enum
+{
+    SIM_IDLE,
+    SIM_READ,
+    SIM_WRITE
+} SIM_TRANSFER;
+
+typedef struct
+{
+    BYTE    address;
+    WORD    regs[256];
+} SIM_SLAVE;
+
+typedef struct
+{
+    BOOL            opened;
+    SIM_SLAVE       slaves[SIM_MAX_SLAVES];
+    INT             numSlaves;
+
+    // Device configuration
+    DWORD           bitRate;
+    BYTE            ackAddress;
+    BOOL            autoReadRespond;
+    WORD            writeTimeout;
+    WORD            readTimeout;
+    BOOL            sclLowTimeout;
+    WORD            transferRetries;
+    DWORD           responseTimeout;
+    BYTE            gpioDirection, gpioMode, gpioFunction, gpioClkDiv;
+    BYTE            latch;
+
+    // Transfer state
+    SIM_TRANSFER    transfer;
+    SIM_SLAVE       *slave;             // NULL when the address is not acknowledged
+    BYTE            reg;
+    WORD            numBytes;
+    WORD            numDone;
+    BYTE            pec;                // Of the read so far, with SIM_CONFIG pec
+    LONGLONG        completeAt;         // QPC count the transfer finishes at
+} SIM_DEVICE;
+
+static SIM_CONFIG   simConfig = { 1, 0xC8, 0, TRUE, FALSE };
+static SIM_DEVICE   simDevices[SIM_MAX_DEVICES];
+static BOOL         simConfigured;
+static LONGLONG     simFrequency;
+
+static LONGLONG Sim_Now(void)
+{
+    LARGE_INTEGER now;
+
+    QueryPerformanceCounter(&now);
+    return now.QuadPart;
+}
+
+// Power-on LVDC4816 contents
+static void Sim_InitSlave(SIM_SLAVE *slave, BYTE address)
+{
+    memset(slave, 0, sizeof(*slave));
+    slave->address = address;
+    slave->regs[LVDC4816_REG_HV_VOLTAGE] = LVDC4816_Encode_HV_VOLTAGE(48.0f);
+    slave->regs[LVDC4816_REG_LV_VOLTAGE] = LVDC4816_Encode_LV_VOLTAGE(12.0f);
+    slave->regs[LVDC4816_REG_I1_CURRENT] = LVDC4816_Encode_I1_CURRENT(20.0f);
+    slave->regs[LVDC4816_REG_I2_CURRENT] = LVDC4816_Encode_I2_CURRENT(80.0f);
+    slave->regs[LVDC4816_REG_TEMPERATURE1] = LVDC4816_Encode_TEMPERATURE1(35.0f);
+    slave->regs[LVDC4816_REG_TEMPERATURE2] = LVDC4816_Encode_TEMPERATURE2(33.0f);
+    slave->regs[LVDC4816_REG_MFR_VERSION] = 0x0102;
+    slave->regs[LVDC4816_REG_HW_OCP] = LVDC4816_Encode_HW_OCP(700.0f);
+}
+
+void Sim_Configure(const SIM_CONFIG *config)
+{
+    LARGE_INTEGER freq;
+
+    QueryPerformanceFrequency(&freq);
+    simFrequency = freq.QuadPart;
+    simConfig = *config;
+    if (simConfig.numDevices > SIM_MAX_DEVICES)
+    {
+        simConfig.numDevices = SIM_MAX_DEVICES;
+    }
+
+    memset(simDevices, 0, sizeof(simDevices));
+    for (DWORD i = 0; i < SIM_MAX_DEVICES; i++)
+    {
+        SIM_DEVICE *dev = &simDevices[i];
+
+        dev->bitRate = 100000;
+        dev->ackAddress = 0x02;
+        dev->responseTimeout = 1000;
+        dev->latch = 0xFF;
+        Sim_InitSlave(&dev->slaves[0], simConfig.slaveAddress);
+        dev->numSlaves = 1;
+    }
+    simConfigured = TRUE;
+}
+
+static void Sim_Init(void)
+{
+    if (!simConfigured)
+    {
+        Sim_Configure(&simConfig);
+    }
+}
+
+INT Sim_AddSlave(DWORD deviceNum, BYTE slaveAddress)
+{
+    SIM_DEVICE *dev;
+
+    Sim_Init();
+    if (deviceNum >= SIM_MAX_DEVICES || simDevices[deviceNum].numSlaves >= SIM_MAX_SLAVES)
+    {
+        return -1;
+    }
+
+    dev = &simDevices[deviceNum];
+    Sim_InitSlave(&dev->slaves[dev->numSlaves++], slaveAddress);
+    return 0;
+}
+
+static SIM_SLAVE *Sim_FindSlave(SIM_DEVICE *dev, BYTE slaveAddress)
+{
+    for (INT i = 0; i < dev->numSlaves; i++)
+    {
+        if (dev->slaves[i].address == slaveAddress)
+        {
+            return &dev->slaves[i];
+        }
+    }
+
+    return NULL;
+}
+
+void Sim_SetRegister(DWORD deviceNum, BYTE slaveAddress, BYTE reg, WORD value)
+{
+    SIM_SLAVE *slave;
+
+    Sim_Init();
+    if (deviceNum < SIM_MAX_DEVICES && (slave = Sim_FindSlave(&simDevices[deviceNum], slaveAddress)) != NULL)
+    {
+        slave->regs[reg] = value;
+    }
+}
+
+WORD Sim_GetRegister(DWORD deviceNum, BYTE slaveAddress, BYTE reg)
+{
+    SIM_SLAVE *slave;
+
+    Sim_Init();
+    if (deviceNum < SIM_MAX_DEVICES && (slave = Sim_FindSlave(&simDevices[deviceNum], slaveAddress)) != NULL)
+    {
+        return slave->regs[reg];
+    }
+
+    return 0xFFFF;
+}
+
+void Sim_SetInputs(DWORD deviceNum, BYTE value, BYTE mask)
+{
+    SIM_DEVICE *dev;
+
+    Sim_Init();
+    if (deviceNum < SIM_MAX_DEVICES)
+    {
+        dev = &simDevices[deviceNum];
+        mask &= (BYTE)~dev->gpioDirection;
+        dev->latch = (BYTE)((dev->latch & ~mask) | (value & mask));
+    }
+}
+
+static SIM_DEVICE *Sim_Device(HID_SMBUS_DEVICE device)
+{
+    SIM_DEVICE *dev = (SIM_DEVICE *)device;
+
+    if (dev < simDevices || dev >= simDevices + simConfig.numDevices || !dev->opened)
+    {
+        return NULL;
+    }
+
+    return dev;
+}
+
+// Start a transfer of numBytes payload bytes plus the address and command bytes
+static void Sim_StartTransfer(SIM_DEVICE *dev, SIM_TRANSFER transfer, BYTE slaveAddress, BYTE reg, WORD numBytes, WORD overheadBytes)
+{
+    LONGLONG us = simConfig.latencyUs;
+
+    // Nine clocks per byte including the acknowledge bit
+    if (simConfig.busTiming && dev->bitRate > 0)
+    {
+        us += (LONGLONG)(numBytes + overheadBytes) * 9 * 1000000 / dev->bitRate;
+    }
+
+    dev->transfer = transfer;
+    dev->slave = Sim_FindSlave(dev, slaveAddress);
+    dev->reg = reg;
+    dev->numBytes = numBytes;
+    dev->numDone = 0;
+    dev->completeAt = Sim_Now() + us * simFrequency / 1000000;
+}
+
+// Block like the HID read does, sleeping for the coarse part of the wait.
+// A zero timeout waits for as long as it takes, as on the device.
+static BOOL Sim_WaitUntil(LONGLONG deadline, DWORD timeoutMs)
+{
+    LONGLONG limit = Sim_Now() + (LONGLONG)timeoutMs * simFrequency / 1000;
+    LONGLONG now;
+
+    while ((now = Sim_Now()) < deadline)
+    {
+        LONGLONG remainingMs = (deadline - now) * 1000 / simFrequency;
+
+        if (timeoutMs != 0 && now >= limit)
+        {
+            return FALSE;
+        }
+        if (remainingMs > 1)
+        {
+            Sleep((DWORD)(remainingMs - 1));
+        }
+    }
+
+    return TRUE;
+}
+
+// Register files are word wide and reads run on through the following
+// registers, byte k of a read comes from reg + k / 2
+static BYTE Sim_ReadByte(SIM_DEVICE *dev, WORD offset)
+{
+    SIM_SLAVE   *slave = dev->slave;
+    BYTE        reg = (BYTE)(dev->reg + offset / 2);
+    WORD        value = slave->regs[reg];
+
+    // Counts every time its low byte is fetched
+    if (reg == LVDC4816_REG_I1_CNT && (offset & 1) == 0)
+    {
+        slave->regs[reg]++;
+    }
+
+    return (offset & 1) ? (BYTE)(value >> 8) : (BYTE)value;
+}
+
+static HID_SMBUS_STATUS WINAPI Sim_GetNumDevices(DWORD *numDevices, WORD vid, WORD pid)
+{
+    Sim_Init();
+    *numDevices = simConfig.numDevices;
+    return HID_SMBUS_SUCCESS;
+}
+
+static HID_SMBUS_STATUS Sim_String(DWORD deviceNum, char *deviceString, DWORD options)
+{
+    switch (options)
+    {
+    case HID_SMBUS_GET_SERIAL_STR:
+        sprintf(deviceString, "SIM%04lu", (unsigned long)deviceNum);
+        return HID_SMBUS_SUCCESS;
+    case HID_SMBUS_GET_PATH_STR:
+        sprintf(deviceString, "sim#%lu", (unsigned long)deviceNum);
+        return HID_SMBUS_SUCCESS;
+    case HID_SMBUS_GET_PRODUCT_STR:
+        strcpy(deviceString, "Simulated CP2112");
+        return HID_SMBUS_SUCCESS;
+    default:
+        return HID_SMBUS_INVALID_PARAMETER;
+    }
+}
+
+static HID_SMBUS_STATUS WINAPI Sim_GetString(DWORD deviceNum, WORD vid, WORD pid, char *deviceString, DWORD options)
+{
+    Sim_Init();
+    if (deviceNum >= simConfig.numDevices)
+    {
+        return HID_SMBUS_DEVICE_NOT_FOUND;
+    }
+
+    return Sim_String(deviceNum, deviceString, options);
+}
+
+static HID_SMBUS_STATUS WINAPI Sim_GetOpenedString(HID_SMBUS_DEVICE device, char *deviceString, DWORD options)
+{
+    SIM_DEVICE *dev = Sim_Device(device);
+
+    if (dev == NULL)
+    {
+        return HID_SMBUS_INVALID_DEVICE_OBJECT;
+    }
+
+    return Sim_String((DWORD)(dev - simDevices), deviceString, options);
+}
+
+static HID_SMBUS_STATUS WINAPI Sim_Open(HID_SMBUS_DEVICE *device, DWORD deviceNum, WORD vid, WORD pid)
+{
+    Sim_Init();
+    if (deviceNum >= simConfig.numDevices)
+    {
+        return HID_SMBUS_DEVICE_NOT_FOUND;
+    }
+    if (simDevices[deviceNum].opened)
+    {
+        return HID_SMBUS_DEVICE_ACCESS_ERROR;
+    }
+
+    simDevices[deviceNum].opened = TRUE;
+    simDevices[deviceNum].transfer = SIM_IDLE;
+    *device = &simDevices[deviceNum];
+    return HID_SMBUS_SUCCESS;
+}
+
+static HID_SMBUS_STATUS WINAPI Sim_Close(HID_SMBUS_DEVICE device)
+{
+    SIM_DEVICE *dev = Sim_Device(device);
+
+    if (dev == NULL)
+    {
+        return HID_SMBUS_INVALID_DEVICE_OBJECT;
+    }
+
+    dev->opened = FALSE;
+    return HID_SMBUS_SUCCESS;
+}
+
+static HID_SMBUS_STATUS WINAPI Sim_IsOpened(HID_SMBUS_DEVICE device, BOOL *opened)
+{
+    *opened = (Sim_Device(device) != NULL);
+    return HID_SMBUS_SUCCESS;
+}
+
+static HID_SMBUS_STATUS WINAPI Sim_AddressReadRequest(HID_SMBUS_DEVICE device, BYTE slaveAddress, WORD numBytesToRead, BYTE targetAddressSize, BYTE targetAddress[16])
+{
+    SIM_DEVICE *dev = Sim_Device(device);
+
+    if (dev == NULL)
+    {
+        return HID_SMBUS_INVALID_DEVICE_OBJECT;
+    }
+    if (numBytesToRead < HID_SMBUS_MIN_READ_REQUEST_SIZE || numBytesToRead > HID_SMBUS_MAX_READ_REQUEST_SIZE ||
+        targetAddressSize < 1 || targetAddressSize > HID_SMBUS_MAX_TARGET_ADDRESS_SIZE)
+    {
+        return HID_SMBUS_INVALID_REQUEST_LENGTH;
+    }
+
+    // Write address, target address, repeated start, read address
+    Sim_StartTransfer(dev, SIM_READ, slaveAddress, targetAddress[0], numBytesToRead, 2 + targetAddressSize);
+    dev->pec = SMBPec_Update(0, &slaveAddress, 1);
+    dev->pec = SMBPec_Update(dev->pec, targetAddress, targetAddressSize);
+    slaveAddress |= 0x01;
+    dev->pec = SMBPec_Update(dev->pec, &slaveAddress, 1);
+    return HID_SMBUS_SUCCESS;
+}
+
+static HID_SMBUS_STATUS WINAPI Sim_ReadRequest(HID_SMBUS_DEVICE device, BYTE slaveAddress, WORD numBytesToRead)
+{
+    SIM_DEVICE  *dev = Sim_Device(device);
+    BYTE        targetAddress[HID_SMBUS_MAX_TARGET_ADDRESS_SIZE];
+
+    if (dev == NULL)
+    {
+        return HID_SMBUS_INVALID_DEVICE_OBJECT;
+    }
+
+    // Without a target address the read continues where the last one stopped
+    targetAddress[0] = (BYTE)(dev->reg + (dev->numDone + 1) / 2);
+    return Sim_AddressReadRequest(device, slaveAddress, numBytesToRead, 1, targetAddress);
+}
+
+static HID_SMBUS_STATUS WINAPI Sim_ForceReadResponse(HID_SMBUS_DEVICE device, WORD numBytesToRead)
+{
+    return (Sim_Device(device) != NULL) ? HID_SMBUS_SUCCESS : HID_SMBUS_INVALID_DEVICE_OBJECT;
+}
+
+static HID_SMBUS_STATUS WINAPI Sim_GetReadResponse(HID_SMBUS_DEVICE device, HID_SMBUS_S0 *status, BYTE *buffer, BYTE bufferSize, BYTE *numBytesRead)
+{
+    SIM_DEVICE  *dev = Sim_Device(device);
+    WORD        count;
+
+    *numBytesRead = 0;
+    if (dev == NULL)
+    {
+        return HID_SMBUS_INVALID_DEVICE_OBJECT;
+    }
+    if (dev->transfer != SIM_READ || !Sim_WaitUntil(dev->completeAt, dev->responseTimeout))
+    {
+        *status = (dev->transfer == SIM_READ) ? HID_SMBUS_S0_BUSY : HID_SMBUS_S0_IDLE;
+        return HID_SMBUS_READ_TIMED_OUT;
+    }
+
+    // Address not acknowledged
+    if (dev->slave == NULL)
+    {
+        dev->transfer = SIM_IDLE;
+        *status = HID_SMBUS_S0_ERROR;
+        return HID_SMBUS_SUCCESS;
+    }
+
+    // One interrupt report worth of data
+    count = dev->numBytes - dev->numDone;
+    if (count > bufferSize)
+    {
+        count = bufferSize;
+    }
+    if (count > SIM_REPORT_SIZE)
+    {
+        count = SIM_REPORT_SIZE;
+    }
+    for (WORD i = 0; i < count; i++)
+    {
+        // The byte after the data is the PEC when the slave sends one
+        if (simConfig.pec && dev->numDone + i == dev->numBytes - 1)
+        {
+            buffer[i] = dev->pec;
+            continue;
+        }
+        buffer[i] = Sim_ReadByte(dev, dev->numDone + i);
+        dev->pec = SMBPec_Update(dev->pec, &buffer[i], 1);
+    }
+    dev->numDone += count;
+    *numBytesRead = (BYTE)count;
+    *status = (dev->numDone >= dev->numBytes) ? HID_SMBUS_S0_COMPLETE : HID_SMBUS_S0_BUSY;
+    if (dev->numDone >= dev->numBytes)
+    {
+        dev->transfer = SIM_IDLE;
+    }
+
+    return HID_SMBUS_SUCCESS;
+}
+
+static HID_SMBUS_STATUS WINAPI Sim_WriteRequest(HID_SMBUS_DEVICE device, BYTE slaveAddress, BYTE *buffer, BYTE numBytesToWrite)
+{
+    SIM_DEVICE *dev = Sim_Device(device);
+
+    if (dev == NULL)
+    {
+        return HID_SMBUS_INVALID_DEVICE_OBJECT;
+    }
+    if (numBytesToWrite < HID_SMBUS_MIN_WRITE_REQUEST_SIZE || numBytesToWrite > HID_SMBUS_MAX_WRITE_REQUEST_SIZE)
+    {
+        return HID_SMBUS_INVALID_REQUEST_LENGTH;
+    }
+
+    Sim_StartTransfer(dev, SIM_WRITE, slaveAddress, buffer[0], numBytesToWrite, 1);
+
+    // A slave that checks PEC NACKs a bad one and drops the data
+    if (simConfig.pec && dev->slave != NULL)
+    {
+        BYTE pec = SMBPec_Update(SMBPec_Update(0, &slaveAddress, 1), buffer, numBytesToWrite - 1);
+
+        if (numBytesToWrite < 2 || buffer[numBytesToWrite - 1] != pec)
+        {
+            dev->slave = NULL;
+        }
+        numBytesToWrite--;
+    }
+
+    // Data bytes after the command go low byte first into consecutive registers
+    if (dev->slave != NULL)
+    {
+        for (BYTE i = 1; i < numBytesToWrite; i++)
+        {
+            WORD *reg = &dev->slave->regs[(BYTE)(buffer[0] + (i - 1) / 2)];
+
+            *reg = (i & 1) ? (WORD)((*reg & 0xFF00) | buffer[i]) : (WORD)((*reg & 0x00FF) | (buffer[i] << 8));
+        }
+    }
+
+    return HID_SMBUS_SUCCESS;
+}
+
+static HID_SMBUS_STATUS WINAPI Sim_TransferStatusRequest(HID_SMBUS_DEVICE device)
+{
+    return (Sim_Device(device) != NULL) ? HID_SMBUS_SUCCESS : HID_SMBUS_INVALID_DEVICE_OBJECT;
+}
+
+static HID_SMBUS_STATUS WINAPI Sim_GetTransferStatusResponse(HID_SMBUS_DEVICE device, HID_SMBUS_S0 *status, HID_SMBUS_S1 *detailedStatus, WORD *numRetries, WORD *bytesRead)
+{
+    SIM_DEVICE *dev = Sim_Device(device);
+
+    if (dev == NULL)
+    {
+        return HID_SMBUS_INVALID_DEVICE_OBJECT;
+    }
+
+    *numRetries = 0;
+    *bytesRead = 0;
+    *detailedStatus = 0;
+    if (dev->transfer == SIM_IDLE)
+    {
+        *status = HID_SMBUS_S0_IDLE;
+    }
+    else if (Sim_Now() < dev->completeAt)
+    {
+        *status = HID_SMBUS_S0_BUSY;
+        if (dev->slave == NULL)
+        {
+            *detailedStatus = HID_SMBUS_S1_BUSY_ADDRESS_NACKED;
+        }
+        else
+        {
+            *detailedStatus = (dev->transfer == SIM_WRITE) ? HID_SMBUS_S1_BUSY_WRITING : HID_SMBUS_S1_BUSY_READING;
+        }
+    }
+    else if (dev->slave == NULL)
+    {
+        *status = HID_SMBUS_S0_ERROR;
+        *detailedStatus = HID_SMBUS_S1_ERROR_TIMEOUT_NACK;
+        dev->transfer = SIM_IDLE;
+    }
+    else
+    {
+        *status = HID_SMBUS_S0_COMPLETE;
+        *bytesRead = (dev->transfer == SIM_READ) ? dev->numBytes : 0;
+        // Read data stays available for GetReadResponse
+        if (dev->transfer == SIM_WRITE)
+        {
+            dev->transfer = SIM_IDLE;
+        }
+    }
+
+    return HID_SMBUS_SUCCESS;
+}
+
+static HID_SMBUS_STATUS WINAPI Sim_CancelTransfer(HID_SMBUS_DEVICE device)
+{
+    SIM_DEVICE *dev = Sim_Device(device);
+
+    if (dev == NULL)
+    {
+        return HID_SMBUS_INVALID_DEVICE_OBJECT;
+    }
+
+    dev->transfer = SIM_IDLE;
+    return HID_SMBUS_SUCCESS;
+}
+
+static HID_SMBUS_STATUS WINAPI Sim_CancelIo(HID_SMBUS_DEVICE device)
+{
+    return (Sim_Device(device) != NULL) ? HID_SMBUS_SUCCESS : HID_SMBUS_INVALID_DEVICE_OBJECT;
+}
+
+static HID_SMBUS_STATUS WINAPI Sim_SetTimeouts(HID_SMBUS_DEVICE device, DWORD responseTimeout)
+{
+    SIM_DEVICE *dev = Sim_Device(device);
+
+    if (dev == NULL)
+    {
+        return HID_SMBUS_INVALID_DEVICE_OBJECT;
+    }
+
+    dev->responseTimeout = responseTimeout;
+    return HID_SMBUS_SUCCESS;
+}
+
+static HID_SMBUS_STATUS WINAPI Sim_GetTimeouts(HID_SMBUS_DEVICE device, DWORD *responseTimeout)
+{
+    SIM_DEVICE *dev = Sim_Device(device);
+
+    if (dev == NULL)
+    {
+        return HID_SMBUS_INVALID_DEVICE_OBJECT;
+    }
+
+    *responseTimeout = dev->responseTimeout;
+    return HID_SMBUS_SUCCESS;
+}
+
+static HID_SMBUS_STATUS WINAPI Sim_SetSmbusConfig(HID_SMBUS_DEVICE device, DWORD bitRate, BYTE address, BOOL autoReadRespond, WORD writeTimeout, WORD readTimeout, BOOL sclLowTimeout, WORD transferRetries)
+{
+    SIM_DEVICE *dev = Sim_Device(device);
+
+    if (dev == NULL)
+    {
+        return HID_SMBUS_INVALID_DEVICE_OBJECT;
+    }
+    if (bitRate == 0 || address < HID_SMBUS_MIN_ADDRESS || address > HID_SMBUS_MAX_ADDRESS || (address & 1))
+    {
+        return HID_SMBUS_INVALID_PARAMETER;
+    }
+
+    dev->bitRate = bitRate;
+    dev->ackAddress = address;
+    dev->autoReadRespond = autoReadRespond;
+    dev->writeTimeout = writeTimeout;
+    dev->readTimeout = readTimeout;
+    dev->sclLowTimeout = sclLowTimeout;
+    dev->transferRetries = transferRetries;
+    return HID_SMBUS_SUCCESS;
+}
+
+static HID_SMBUS_STATUS WINAPI Sim_GetSmbusConfig(HID_SMBUS_DEVICE device, DWORD *bitRate, BYTE *address, BOOL *autoReadRespond, WORD *writeTimeout, WORD *readTimeout, BOOL *sclLowTimeout, WORD *transferRetries)
+{
+    SIM_DEVICE *dev = Sim_Device(device);
+
+    if (dev == NULL)
+    {
+        return HID_SMBUS_INVALID_DEVICE_OBJECT;
+    }
+
+    *bitRate = dev->bitRate;
+    *address = dev->ackAddress;
+    *autoReadRespond = dev->autoReadRespond;
+    *writeTimeout = dev->writeTimeout;
+    *readTimeout = dev->readTimeout;
+    *sclLowTimeout = dev->sclLowTimeout;
+    *transferRetries = dev->transferRetries;
+    return HID_SMBUS_SUCCESS;
+}
+
+static HID_SMBUS_STATUS WINAPI Sim_Reset(HID_SMBUS_DEVICE device)
+{
+    SIM_DEVICE *dev = Sim_Device(device);
+
+    if (dev == NULL)
+    {
+        return HID_SMBUS_INVALID_DEVICE_OBJECT;
+    }
+
+    dev->transfer = SIM_IDLE;
+    return HID_SMBUS_SUCCESS;
+}
+
+static HID_SMBUS_STATUS WINAPI Sim_SetGpioConfig(HID_SMBUS_DEVICE device, BYTE direction, BYTE mode, BYTE function, BYTE clkDiv)
+{
+    SIM_DEVICE *dev = Sim_Device(device);
+
+    if (dev == NULL)
+    {
+        return HID_SMBUS_INVALID_DEVICE_OBJECT;
+    }
+
+    dev->gpioDirection = direction;
+    dev->gpioMode = mode;
+    dev->gpioFunction = function;
+    dev->gpioClkDiv = clkDiv;
+    return HID_SMBUS_SUCCESS;
+}
+
+static HID_SMBUS_STATUS WINAPI Sim_GetGpioConfig(HID_SMBUS_DEVICE device, BYTE *direction, BYTE *mode, BYTE *function, BYTE *clkDiv)
+{
+    SIM_DEVICE *dev = Sim_Device(device);
+
+    if (dev == NULL)
+    {
+        return HID_SMBUS_INVALID_DEVICE_OBJECT;
+    }
+
+    *direction = dev->gpioDirection;
+    *mode = dev->gpioMode;
+    *function = dev->gpioFunction;
+    *clkDiv = dev->gpioClkDiv;
+    return HID_SMBUS_SUCCESS;
+}
+
+static HID_SMBUS_STATUS WINAPI Sim_ReadLatch(HID_SMBUS_DEVICE device, BYTE *latchValue)
+{
+    SIM_DEVICE *dev = Sim_Device(device);
+
+    if (dev == NULL)
+    {
+        return HID_SMBUS_INVALID_DEVICE_OBJECT;
+    }
+
+    *latchValue = dev->latch;
+    return HID_SMBUS_SUCCESS;
+}
+
+static HID_SMBUS_STATUS WINAPI Sim_WriteLatch(HID_SMBUS_DEVICE device, BYTE latchValue, BYTE latchMask)
+{
+    SIM_DEVICE *dev = Sim_Device(device);
+
+    if (dev == NULL)
+    {
+        return HID_SMBUS_INVALID_DEVICE_OBJECT;
+    }
+
+    // Only outputs can be driven
+    latchMask &= dev->gpioDirection;
+    dev->latch = (BYTE)((dev->latch & ~latchMask) | (latchValue & latchMask));
+    return HID_SMBUS_SUCCESS;
+}
+
+static HID_SMBUS_STATUS WINAPI Sim_GetPartNumber(HID_SMBUS_DEVICE device, BYTE *partNumber, BYTE *version)
+{
+    if (Sim_Device(device) == NULL)
+    {
+        return HID_SMBUS_INVALID_DEVICE_OBJECT;
+    }
+
+    *partNumber = HID_SMBUS_PART_CP2112;
+    *version = 0;
+    return HID_SMBUS_SUCCESS;
+}
+
+const SMBUS_BACKEND backendSim =
+{
+    "sim",
+    Sim_GetNumDevices,
+    Sim_GetString,
+    Sim_GetOpenedString,
+    Sim_Open,
+    Sim_Close,
+    Sim_IsOpened,
+    Sim_ReadRequest,
+    Sim_AddressReadRequest,
+    Sim_ForceReadResponse,
+    Sim_GetReadResponse,
+    Sim_WriteRequest,
+    Sim_TransferStatusRequest,
+    Sim_GetTransferStatusResponse,
+    Sim_CancelTransfer,
+    Sim_CancelIo,
+    Sim_SetTimeouts,
+    Sim_GetTimeouts,
+    Sim_SetSmbusConfig,
+    Sim_GetSmbusConfig,
+    Sim_Reset,
+    Sim_SetGpioConfig,
+    Sim_GetGpioConfig,
+    Sim_ReadLatch,
+    Sim_WriteLatch,
+    Sim_GetPartNumber
+};
@@ -0,0 +1,274 @@
+#include "smbasync.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Hand a finished read to its callback or the completion queue
+static void SMBAsync_Complete(SMBUS_ASYNC *async, SMBUS_ASYNC_READ *read)
+{
+    InterlockedIncrement(&async->numCompleted);
+    if (read->result < 0)
+    {
+        InterlockedIncrement(&async->numFailed);
+    }
+
+    if (read->callback != NULL)
+    {
+        read->callback(read);
+        return;
+    }
+
+    read->next = NULL;
+    EnterCriticalSection(&async->lock);
+    if (async->completedTail != NULL)
+    {
+        async->completedTail->next = read;
+    }
+    else
+    {
+        async->completedHead = read;
+    }
+    async->completedTail = read;
+    LeaveCriticalSection(&async->lock);
+    SetEvent(async->completionEvent);
+}
+
+// Oldest request of the next slave address after the last one served.
+// Called with the lock held.
+static SMBUS_ASYNC_READ *SMBAsync_Take(SMBUS_ASYNC *async)
+{
+    SMBUS_ASYNC_READ    **link;
+    SMBUS_ASYNC_READ    **best = NULL;
+    INT                 bestDistance = 256;
+    SMBUS_ASYNC_READ    *read;
+
+    for (link = &async->waiting; *link != NULL; link = &(*link)->next)
+    {
+        INT distance = (BYTE)((*link)->slaveAddress - async->lastSlave - 1);
+
+        if (distance < bestDistance)
+        {
+            bestDistance = distance;
+            best = link;
+        }
+    }
+    if (best == NULL)
+    {
+        return NULL;
+    }
+
+    read = *best;
+    *best = read->next;
+    async->lastSlave = read->slaveAddress;
+
+    return read;
+}
+
+static DWORD WINAPI SMBAsync_Thread(LPVOID param)
+{
+    SMBUS_ASYNC         *async = (SMBUS_ASYNC *)param;
+    SMBUS_ASYNC_READ    *read;
+
+    for (;;)
+    {
+        EnterCriticalSection(&async->lock);
+        read = async->stopping ? NULL : SMBAsync_Take(async);
+        if (read == NULL && async->stopping)
+        {
+            LeaveCriticalSection(&async->lock);
+            break;
+        }
+        LeaveCriticalSection(&async->lock);
+
+        if (read == NULL)
+        {
+            WaitForSingleObject(async->workEvent, INFINITE);
+            continue;
+        }
+
+        // Every read is bounded, a stuck slave is cancelled on time
+        read->result = SMBus_ReadTimeout(async->device, read->buffer, read->slaveAddress, read->numBytesToRead,
+            read->targetAddressSize, read->targetAddress, (read->timeoutMs != 0) ? read->timeoutMs : async->defaultTimeoutMs);
+        SMBAsync_Complete(async, read);
+    }
+
+    return 0;
+}
+
+INT SMBAsync_Start(SMBUS_ASYNC *async)
+{
+    // Checked before anything is touched, a failed start owns nothing
+    if (async->defaultTimeoutMs == 0)
+    {
+        return -1;
+    }
+
+    async->thread = NULL;
+    async->workEvent = NULL;
+    async->completionEvent = NULL;
+    async->stopping = FALSE;
+    async->waiting = NULL;
+    async->completedHead = NULL;
+    async->completedTail = NULL;
+    async->nextToken = 0;
+    async->lastSlave = 0xFF;
+    async->numCompleted = 0;
+    async->numFailed = 0;
+    InitializeCriticalSection(&async->lock);
+    async->workEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    async->completionEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (async->workEvent == NULL || async->completionEvent == NULL)
+    {
+        SMBAsync_Stop(async);
+        return -1;
+    }
+
+    async->thread = CreateThread(NULL, 0, SMBAsync_Thread, async, 0, NULL);
+    if (async->thread == NULL)
+    {
+        SMBAsync_Stop(async);
+        return -1;
+    }
+
+    return 0;
+}
+
+void SMBAsync_Stop(SMBUS_ASYNC *async)
+{
+    SMBUS_ASYNC_READ *read;
+
+    // The thread finishes the read on the bus and then exits
+    EnterCriticalSection(&async->lock);
+    async->stopping = TRUE;
+    LeaveCriticalSection(&async->lock);
+    if (async->thread != NULL)
+    {
+        SetEvent(async->workEvent);
+        WaitForSingleObject(async->thread, INFINITE);
+        CloseHandle(async->thread);
+        async->thread = NULL;
+    }
+
+    // Nothing left can reach the bus, callbacks still hear about it
+    while ((read = async->waiting) != NULL)
+    {
+        async->waiting = read->next;
+        read->result = -1;
+        InterlockedIncrement(&async->numCompleted);
+        InterlockedIncrement(&async->numFailed);
+        if (read->callback != NULL)
+        {
+            read->callback(read);
+        }
+    }
+    async->completedHead = NULL;
+    async->completedTail = NULL;
+
+    if (async->workEvent != NULL)
+    {
+        CloseHandle(async->workEvent);
+        async->workEvent = NULL;
+    }
+    if (async->completionEvent != NULL)
+    {
+        CloseHandle(async->completionEvent);
+        async->completionEvent = NULL;
+    }
+    DeleteCriticalSection(&async->lock);
+}
+
+DWORD SMBAsync_Submit(SMBUS_ASYNC *async, SMBUS_ASYNC_READ *read)
+{
+    SMBUS_ASYNC_READ **link;
+
+    if (read->numBytesToRead < HID_SMBUS_MIN_READ_REQUEST_SIZE || read->numBytesToRead > HID_SMBUS_MAX_READ_REQUEST_SIZE)
+    {
+        return 0;
+    }
+
+    EnterCriticalSection(&async->lock);
+    if (async->stopping || async->thread == NULL)
+    {
+        LeaveCriticalSection(&async->lock);
+        return 0;
+    }
+
+    // Tokens skip 0, it means failure
+    if (++async->nextToken == 0)
+    {
+        async->nextToken = 1;
+    }
+    read->token = async->nextToken;
+    read->result = -1;
+    read->next = NULL;
+    for (link = &async->waiting; *link != NULL; link = &(*link)->next)
+    {
+    }
+    *link = read;
+    LeaveCriticalSection(&async->lock);
+
+    SetEvent(async->workEvent);
+    return read->token;
+}
+
+BOOL SMBAsync_Cancel(SMBUS_ASYNC *async, DWORD token)
+{
+    SMBUS_ASYNC_READ **link;
+    SMBUS_ASYNC_READ *read = NULL;
+
+    EnterCriticalSection(&async->lock);
+    for (link = &async->waiting; *link != NULL; link = &(*link)->next)
+    {
+        if ((*link)->token == token)
+        {
+            read = *link;
+            *link = read->next;
+            break;
+        }
+    }
+    LeaveCriticalSection(&async->lock);
+
+    if (read == NULL)
+    {
+        return FALSE;
+    }
+
+    read->result = -1;
+    SMBAsync_Complete(async, read);
+    return TRUE;
+}
+
+SMBUS_ASYNC_READ *SMBAsync_GetCompletion(SMBUS_ASYNC *async, DWORD timeoutMs)
+{
+    SMBUS_ASYNC_READ    *read;
+    DWORD               start = GetTickCount();
+    DWORD               elapsed;
+
+    for (;;)
+    {
+        EnterCriticalSection(&async->lock);
+        read = async->completedHead;
+        if (read != NULL)
+        {
+            async->completedHead = read->next;
+            if (async->completedHead == NULL)
+            {
+                async->completedTail = NULL;
+            }
+        }
+        LeaveCriticalSection(&async->lock);
+
+        if (read != NULL)
+        {
+            return read;
+        }
+
+        // The event is auto-reset, so check the queue again after each wake
+        elapsed = GetTickCount() - start;
+        if (timeoutMs != INFINITE && elapsed >= timeoutMs)
+        {
+            return NULL;
+        }
+        WaitForSingleObject(async->completionEvent, (timeoutMs == INFINITE) ? INFINITE : timeoutMs - elapsed);
+    }
+}
@@ -0,0 +1,268 @@
+#include "smbclient.h"
+
+#include <string.h>
+
+INT SMBClient_Connect(SMB_CLIENT *client, const char *pipeName, const char *serial, DWORD timeoutMs)
+{
+    const char          *name = (pipeName != NULL) ? pipeName : SMBIPC_PIPE_NAME;
+    DWORD               mode = PIPE_READMODE_MESSAGE;
+    DWORD               start = GetTickCount();
+    SMBIPC_HELLO        hello;
+    SMBIPC_HELLO_REPLY  reply;
+    DWORD               size;
+
+    memset(client, 0, sizeof(*client));
+    client->pipe = INVALID_HANDLE_VALUE;
+    client->priority = SMBIPC_PRIORITY_PERIODIC;
+    if (serial != NULL && strlen(serial) >= sizeof(hello.serial))
+    {
+        return -1;
+    }
+
+    // Every instance busy means the daemon is between two connects
+    for (;;)
+    {
+        client->pipe = CreateFileA(name, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+        if (client->pipe != INVALID_HANDLE_VALUE)
+        {
+            break;
+        }
+        if (GetLastError() != ERROR_PIPE_BUSY || GetTickCount() - start >= timeoutMs ||
+            !WaitNamedPipeA(name, timeoutMs - (GetTickCount() - start)))
+        {
+            return -1;
+        }
+    }
+    SetNamedPipeHandleState(client->pipe, &mode, NULL, NULL);
+
+    // Name the adapter, the daemon opens it if nobody has yet
+    memset(&hello, 0, sizeof(hello));
+    hello.version = SMBIPC_VERSION;
+    if (serial != NULL)
+    {
+        strcpy(hello.serial, serial);
+    }
+    if (!WriteFile(client->pipe, &hello, sizeof(hello), &size, NULL) ||
+        !ReadFile(client->pipe, &reply, sizeof(reply), &size, NULL) || size != sizeof(reply) || reply.result != 0)
+    {
+        SMBClient_Close(client);
+        return -1;
+    }
+    reply.serial[sizeof(reply.serial) - 1] = '\0';
+    strcpy(client->serial, reply.serial);
+
+    return 0;
+}
+
+void SMBClient_Close(SMB_CLIENT *client)
+{
+    if (client->pipe != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(client->pipe);
+        client->pipe = INVALID_HANDLE_VALUE;
+    }
+}
+
+// Send the request built in client->request and wait for its response
+static INT SMBClient_Transact(SMB_CLIENT *client)
+{
+    DWORD size;
+
+    client->request.sequence = ++client->sequence;
+    client->request.priority = client->priority;
+    if (!WriteFile(client->pipe, &client->request, (DWORD)SMBIPC_REQUEST_SIZE(client->request.numOps), &size, NULL) ||
+        !ReadFile(client->pipe, &client->response, sizeof(client->response), &size, NULL))
+    {
+        return -1;
+    }
+    if (size < SMBIPC_RESPONSE_SIZE(0) || size != SMBIPC_RESPONSE_SIZE(client->response.numData) ||
+        client->response.sequence != client->request.sequence || client->response.numOps != client->request.numOps)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+// Counted and failed as SMBus_ReadBatch does: descriptors that got every
+// byte, or -1 once the adapter or the daemon could not run the batch
+static INT SMBClient_Reads(SMB_CLIENT *client, SMBUS_READ_DESC *reads, WORD numReads, BYTE flags)
+{
+    INT numOk = 0;
+
+    for (WORD i = 0; i < numReads; )
+    {
+        const BYTE  *data = client->response.data;
+        WORD        numData = 0;
+        WORD        count = 0;
+
+        // As many descriptors as fit in one request
+        while (i + count < numReads && count < SMBIPC_MAX_OPS && numData + reads[i + count].numBytesToRead <= SMBIPC_MAX_DATA)
+        {
+            SMBUS_READ_DESC *read = &reads[i + count];
+            SMBIPC_OP       *op = &client->request.ops[count];
+
+            if (read->numBytesToRead == 0 || read->targetAddressSize > HID_SMBUS_MAX_TARGET_ADDRESS_SIZE)
+            {
+                break;
+            }
+            op->op = SMBIPC_OP_READ;
+            op->flags = flags;
+            op->slaveAddress = read->slaveAddress;
+            op->targetAddressSize = read->targetAddressSize;
+            memcpy(op->targetAddress, read->targetAddress, read->targetAddressSize);
+            op->numBytes = read->numBytesToRead;
+            numData += read->numBytesToRead;
+            count++;
+        }
+
+        // One the daemon would refuse fails on its own
+        if (count == 0)
+        {
+            reads[i++].result = -1;
+            continue;
+        }
+
+        client->request.numOps = count;
+        if (SMBClient_Transact(client) != 0)
+        {
+            for (; i < numReads; i++)
+            {
+                reads[i].result = -1;
+            }
+            return -1;
+        }
+        for (WORD k = 0; k < count; k++, i++)
+        {
+            // Never more than the descriptor has room for, whatever came back
+            reads[i].result = client->response.results[k];
+            if (reads[i].result > reads[i].numBytesToRead)
+            {
+                reads[i].result = reads[i].numBytesToRead;
+            }
+            if (reads[i].result > 0)
+            {
+                memcpy(reads[i].buffer, data, reads[i].result);
+            }
+            numOk += (reads[i].result == reads[i].numBytesToRead);
+            data += reads[i].numBytesToRead;
+        }
+        if (client->response.result < 0)
+        {
+            for (; i < numReads; i++)
+            {
+                reads[i].result = -1;
+            }
+            return -1;
+        }
+    }
+
+    return numOk;
+}
+
+INT SMBClient_ReadBatch(SMB_CLIENT *client, SMBUS_READ_DESC *reads, WORD numReads)
+{
+    return SMBClient_Reads(client, reads, numReads, 0);
+}
+
+INT SMBClient_WriteBatch(SMB_CLIENT *client, SMBUS_WRITE_DESC *writes, WORD numWrites)
+{
+    INT numOk = 0;
+
+    for (WORD i = 0; i < numWrites; )
+    {
+        WORD count = 0;
+
+        while (i + count < numWrites && count < SMBIPC_MAX_OPS)
+        {
+            SMBUS_WRITE_DESC    *write = &writes[i + count];
+            SMBIPC_OP           *op = &client->request.ops[count];
+
+            if (write->numBytesToWrite == 0 || write->numBytesToWrite > HID_SMBUS_MAX_WRITE_REQUEST_SIZE)
+            {
+                break;
+            }
+            op->op = SMBIPC_OP_WRITE;
+            op->flags = 0;
+            op->slaveAddress = write->slaveAddress;
+            op->targetAddressSize = 0;
+            op->numBytes = write->numBytesToWrite;
+            memcpy(op->data, write->buffer, write->numBytesToWrite);
+            count++;
+        }
+
+        if (count == 0)
+        {
+            writes[i++].result = -1;
+            continue;
+        }
+
+        client->request.numOps = count;
+        if (SMBClient_Transact(client) != 0)
+        {
+            for (; i < numWrites; i++)
+            {
+                writes[i].result = -1;
+            }
+            return -1;
+        }
+        for (WORD k = 0; k < count; k++, i++)
+        {
+            writes[i].result = client->response.results[k];
+            if (writes[i].result == 0)
+            {
+                numOk++;
+            }
+        }
+        if (client->response.result < 0)
+        {
+            for (; i < numWrites; i++)
+            {
+                writes[i].result = -1;
+            }
+            return -1;
+        }
+    }
+
+    return numOk;
+}
+
+static INT SMBClient_ReadOne(SMB_CLIENT *client, BYTE flags, BYTE *buffer, BYTE slaveAddress, WORD numBytesToRead, BYTE targetAddressSize, BYTE *targetAddress)
+{
+    SMBUS_READ_DESC read;
+
+    if (targetAddressSize > HID_SMBUS_MAX_TARGET_ADDRESS_SIZE)
+    {
+        return -1;
+    }
+    read.slaveAddress = slaveAddress;
+    read.targetAddressSize = targetAddressSize;
+    memcpy(read.targetAddress, targetAddress, targetAddressSize);
+    read.numBytesToRead = numBytesToRead;
+    read.buffer = buffer;
+    SMBClient_Reads(client, &read, 1, flags);
+
+    return read.result;
+}
+
+INT SMBClient_Read(SMB_CLIENT *client, BYTE *buffer, BYTE slaveAddress, WORD numBytesToRead, BYTE targetAddressSize, BYTE *targetAddress)
+{
+    return SMBClient_ReadOne(client, 0, buffer, slaveAddress, numBytesToRead, targetAddressSize, targetAddress);
+}
+
+INT SMBClient_ReadSequential(SMB_CLIENT *client, BYTE *buffer, BYTE slaveAddress, WORD numBytesToRead, BYTE targetAddressSize, BYTE *targetAddress)
+{
+    return SMBClient_ReadOne(client, SMBIPC_FLAG_SEQUENTIAL, buffer, slaveAddress, numBytesToRead, targetAddressSize, targetAddress);
+}
+
+INT SMBClient_Write(SMB_CLIENT *client, BYTE *buffer, BYTE slaveAddress, BYTE numBytesToWrite)
+{
+    SMBUS_WRITE_DESC write;
+
+    write.slaveAddress = slaveAddress;
+    write.numBytesToWrite = numBytesToWrite;
+    write.buffer = buffer;
+    SMBClient_WriteBatch(client, &write, 1);
+
+    return write.result;
+}
@@ -0,0 +1,79 @@
+#include "smbpool.h"
+
+#include <string.h>
+
+INT SMBPool_Init(SMBUS_POOL *pool, SMBUS_TRANSACTION *storage, DWORD capacity)
+{
+    if (storage == NULL || capacity == 0)
+    {
+        return -1;
+    }
+
+    pool->storage = storage;
+    pool->capacity = capacity;
+    pool->free = NULL;
+    for (DWORD i = capacity; i > 0; i--)
+    {
+        storage[i - 1].nextFree = pool->free;
+        pool->free = &storage[i - 1];
+    }
+    pool->numFree = capacity;
+    pool->minFree = capacity;
+    pool->numExhausted = 0;
+    InitializeCriticalSection(&pool->lock);
+
+    return 0;
+}
+
+void SMBPool_Free(SMBUS_POOL *pool)
+{
+    DeleteCriticalSection(&pool->lock);
+    pool->free = NULL;
+    pool->numFree = 0;
+}
+
+SMBUS_TRANSACTION *SMBPool_Borrow(SMBUS_POOL *pool)
+{
+    SMBUS_TRANSACTION *transaction;
+
+    EnterCriticalSection(&pool->lock);
+    transaction = pool->free;
+    if (transaction != NULL)
+    {
+        pool->free = transaction->nextFree;
+        if (--pool->numFree < pool->minFree)
+        {
+            pool->minFree = pool->numFree;
+        }
+    }
+    LeaveCriticalSection(&pool->lock);
+
+    if (transaction == NULL)
+    {
+        InterlockedIncrement(&pool->numExhausted);
+        return NULL;
+    }
+
+    // Fresh descriptors, the payload is left as it was
+    memset(&transaction->async, 0, sizeof(transaction->async));
+    memset(&transaction->read, 0, sizeof(transaction->read));
+    memset(&transaction->write, 0, sizeof(transaction->write));
+    transaction->async.buffer = transaction->data;
+    transaction->async.result = -1;
+    transaction->read.buffer = transaction->data;
+    transaction->read.result = -1;
+    transaction->write.buffer = transaction->data;
+    transaction->write.result = -1;
+    transaction->nextFree = NULL;
+
+    return transaction;
+}
+
+void SMBPool_Return(SMBUS_POOL *pool, SMBUS_TRANSACTION *transaction)
+{
+    EnterCriticalSection(&pool->lock);
+    transaction->nextFree = pool->free;
+    pool->free = transaction;
+    pool->numFree++;
+    LeaveCriticalSection(&pool->lock);
+}
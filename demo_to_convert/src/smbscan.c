@@ -0,0 +1,174 @@
+#include "smbscan.h"
+
+#include <string.h>
+
+#define SMBSCAN_BUS_TIMEOUT_MS      2
+#define SMBSCAN_PROBE_TIMEOUT_MS    10
+
+// Saved adapter configuration, put back after the sweep
+typedef struct
+{
+    DWORD   bitRate;
+    BYTE    address;
+    BOOL    autoReadRespond;
+    WORD    writeTimeout;
+    WORD    readTimeout;
+    BOOL    sclLowTimeout;
+    WORD    transferRetries;
+    DWORD   responseTimeout;
+} SMBSCAN_CONFIG;
+
+static INT SMBScan_GetConfig(const SMBUS_BACKEND *backend, HID_SMBUS_DEVICE device, SMBSCAN_CONFIG *config)
+{
+    if (backend->GetSmbusConfig(device, &config->bitRate, &config->address, &config->autoReadRespond, &config->writeTimeout,
+            &config->readTimeout, &config->sclLowTimeout, &config->transferRetries) != HID_SMBUS_SUCCESS ||
+        backend->GetTimeouts(device, &config->responseTimeout) != HID_SMBUS_SUCCESS)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+static INT SMBScan_SetConfig(const SMBUS_BACKEND *backend, HID_SMBUS_DEVICE device, const SMBSCAN_CONFIG *config)
+{
+    if (backend->SetSmbusConfig(device, config->bitRate, config->address, config->autoReadRespond, config->writeTimeout,
+            config->readTimeout, config->sclLowTimeout, config->transferRetries) != HID_SMBUS_SUCCESS ||
+        backend->SetTimeouts(device, config->responseTimeout) != HID_SMBUS_SUCCESS)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+// Probe one address. Status is polled without sleeping, a NACK shows up
+// as soon as the address byte is on the wire and the transfer is cancelled
+// there instead of being left to time out.
+static BYTE SMBScan_Probe(const SMBUS_BACKEND *backend, HID_SMBUS_DEVICE device, const SMBUS_SCAN *scan, BYTE slaveAddress, DWORD probeTimeoutMs)
+{
+    HID_SMBUS_STATUS    status;
+    HID_SMBUS_S0        status0;
+    HID_SMBUS_S1        status1;
+    WORD                numRetries;
+    WORD                bytesRead;
+    BYTE                command = scan->probeCommand;
+    BYTE                buffer[HID_SMBUS_MAX_READ_RESPONSE_SIZE];
+    BYTE                numBytesRead;
+    DWORD               start = GetTickCount();
+
+    // Issue the probe
+    if (scan->writeProbe)
+    {
+        status = backend->WriteRequest(device, slaveAddress, &command, 1);
+    }
+    else
+    {
+        status = backend->ReadRequest(device, slaveAddress, 1);
+    }
+    // Check status
+    if (status != HID_SMBUS_SUCCESS)
+    {
+        return SMBSCAN_ERROR;
+    }
+
+    for (;;)
+    {
+        if (backend->TransferStatusRequest(device) != HID_SMBUS_SUCCESS ||
+            backend->GetTransferStatusResponse(device, &status0, &status1, &numRetries, &bytesRead) != HID_SMBUS_SUCCESS)
+        {
+            backend->CancelTransfer(device);
+            return SMBSCAN_ERROR;
+        }
+
+        if (status0 == HID_SMBUS_S0_COMPLETE)
+        {
+            break;
+        }
+        if (status0 == HID_SMBUS_S0_ERROR)
+        {
+            return (status1 == HID_SMBUS_S1_ERROR_TIMEOUT_NACK) ? SMBSCAN_ABSENT : SMBSCAN_ERROR;
+        }
+        if (status0 == HID_SMBUS_S0_BUSY && status1 == HID_SMBUS_S1_BUSY_ADDRESS_NACKED)
+        {
+            backend->CancelTransfer(device);
+            return SMBSCAN_ABSENT;
+        }
+        if (GetTickCount() - start >= probeTimeoutMs)
+        {
+            backend->CancelTransfer(device);
+            return SMBSCAN_ERROR;
+        }
+    }
+
+    // Drain the byte that was read so the next request starts clean
+    if (!scan->writeProbe)
+    {
+        if (backend->ForceReadResponse(device, 1) != HID_SMBUS_SUCCESS ||
+            backend->GetReadResponse(device, &status0, buffer, sizeof(buffer), &numBytesRead) != HID_SMBUS_SUCCESS)
+        {
+            backend->CancelTransfer(device);
+        }
+    }
+
+    return SMBSCAN_PRESENT;
+}
+
+INT SMBScan_Run(HID_SMBUS_DEVICE device, SMBUS_SCAN *scan)
+{
+    const SMBUS_BACKEND *backend = SMBus_GetBackend();
+    SMBSCAN_CONFIG      saved;
+    SMBSCAN_CONFIG      fast;
+    DWORD               probeTimeoutMs = (scan->probeTimeoutMs != 0) ? scan->probeTimeoutMs : SMBSCAN_PROBE_TIMEOUT_MS;
+    BYTE                firstAddress = (scan->firstAddress != 0) ? (BYTE)(scan->firstAddress & 0xFE) : 0x02;
+    BYTE                lastAddress = (scan->lastAddress != 0) ? scan->lastAddress : 0xFE;
+    DWORD               start = GetTickCount();
+
+    memset(scan->result, SMBSCAN_ABSENT, sizeof(scan->result));
+    scan->numPresent = 0;
+    scan->numErrors = 0;
+    scan->elapsedMs = 0;
+
+    // Make sure that the device is opened
+    if (!SMBus_IsOpened(device))
+    {
+        return -1;
+    }
+    device = SMBus_GetHandle(device);
+
+    // Same bit rate, short timeouts, no retries
+    if (SMBScan_GetConfig(backend, device, &saved) != 0)
+    {
+        return -1;
+    }
+    fast = saved;
+    fast.autoReadRespond = FALSE;
+    fast.writeTimeout = (scan->busTimeoutMs != 0) ? scan->busTimeoutMs : SMBSCAN_BUS_TIMEOUT_MS;
+    fast.readTimeout = fast.writeTimeout;
+    fast.transferRetries = 0;
+    fast.responseTimeout = probeTimeoutMs;
+    if (SMBScan_SetConfig(backend, device, &fast) != 0)
+    {
+        SMBScan_SetConfig(backend, device, &saved);
+        return -1;
+    }
+
+    // Each probe goes out as soon as the previous one is classified
+    for (INT address = firstAddress; address <= lastAddress; address += 2)
+    {
+        BYTE result = SMBScan_Probe(backend, device, scan, (BYTE)address, probeTimeoutMs);
+
+        scan->result[address >> 1] = result;
+        scan->numPresent += (result == SMBSCAN_PRESENT);
+        scan->numErrors += (result == SMBSCAN_ERROR);
+    }
+
+    // Put the caller's configuration back
+    scan->elapsedMs = GetTickCount() - start;
+    if (SMBScan_SetConfig(backend, device, &saved) != 0)
+    {
+        return -1;
+    }
+
+    return scan->numPresent;
+}
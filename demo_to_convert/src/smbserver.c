@@ -0,0 +1,659 @@
+#include "smbserver.h"
+
+#include <string.h>
+
+// Ops one round can hold, one request of every client
+#define SMBSERVER_MAX_ROUND_OPS     (SMBSERVER_MAX_CLIENTS * SMBIPC_MAX_OPS)
+
+// Wait between attempts when a new pipe instance cannot be created
+#define SMBSERVER_RETRY_MS          100
+
+// One op of a round and the client it came from
+typedef struct
+{
+    SMBSERVER_CLIENT    *client;
+    INT                 index;
+    BYTE                *data;          // Where read data goes in the response
+} SMBSERVER_ROUND_OP;
+
+static HANDLE SMBServer_CreatePipe(const SMBSERVER *server, BOOL first)
+{
+    const char *name = (server->pipeName != NULL) ? server->pipeName : SMBIPC_PIPE_NAME;
+
+    // Only the first instance may create the name, a second server fails here
+    return CreateNamedPipeA(name, PIPE_ACCESS_DUPLEX | (first ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0),
+        PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+        PIPE_UNLIMITED_INSTANCES, sizeof(SMBIPC_RESPONSE), sizeof(SMBIPC_REQUEST), 0, NULL);
+}
+
+// Synchronous pipe calls only return early when cancelled, so keep
+// cancelling until the thread has seen the stop event
+static void SMBServer_Join(HANDLE thread)
+{
+    while (WaitForSingleObject(thread, 10) == WAIT_TIMEOUT)
+    {
+        CancelSynchronousIo(thread);
+    }
+    CloseHandle(thread);
+}
+
+// Bytes of read data the request asks for, or -1 when it is malformed.
+// An empty request is malformed too, a bulk round always runs an op.
+static INT SMBServer_CheckRequest(const SMBIPC_REQUEST *request, DWORD size)
+{
+    INT numData = 0;
+
+    if (size < SMBIPC_REQUEST_SIZE(0) || request->numOps == 0 || request->numOps > SMBIPC_MAX_OPS || size != SMBIPC_REQUEST_SIZE(request->numOps) ||
+        request->priority >= SMBIPC_NUM_PRIORITIES)
+    {
+        return -1;
+    }
+
+    for (INT i = 0; i < request->numOps; i++)
+    {
+        const SMBIPC_OP *op = &request->ops[i];
+
+        if ((op->flags & ~SMBIPC_FLAG_SEQUENTIAL) != 0)
+        {
+            return -1;
+        }
+        if (op->op == SMBIPC_OP_READ)
+        {
+            if (op->numBytes == 0 || op->targetAddressSize > HID_SMBUS_MAX_TARGET_ADDRESS_SIZE)
+            {
+                return -1;
+            }
+            numData += op->numBytes;
+            if (numData > SMBIPC_MAX_DATA)
+            {
+                return -1;
+            }
+        }
+        else if (op->op != SMBIPC_OP_WRITE || op->numBytes == 0 || op->numBytes > HID_SMBUS_MAX_WRITE_REQUEST_SIZE)
+        {
+            return -1;
+        }
+    }
+
+    return numData;
+}
+
+// Response header once every op has its result
+static void SMBServer_Finish(SMBSERVER_CLIENT *client)
+{
+    client->response.sequence = client->request.sequence;
+    client->response.numOps = client->request.numOps;
+    client->responseSize = (DWORD)SMBIPC_RESPONSE_SIZE(client->response.numData);
+}
+
+// Run the ops of a round in order, every run of reads or of writes as one batch
+static void SMBServer_RunRound(SMBSERVER_ADAPTER *adapter, SMBSERVER_CLIENT **round, INT numRound)
+{
+    SMBSERVER_ROUND_OP  ops[SMBSERVER_MAX_ROUND_OPS];
+    SMBUS_READ_DESC     reads[SMBSERVER_MAX_ROUND_OPS];
+    SMBUS_WRITE_DESC    writes[SMBSERVER_MAX_ROUND_OPS];
+    INT                 numOps = 0;
+
+    // Lay the read data out in each response as it goes
+    for (INT c = 0; c < numRound; c++)
+    {
+        SMBSERVER_CLIENT    *client = round[c];
+        BYTE                *data = client->response.data;
+
+        for (INT i = 0; i < client->request.numOps; i++)
+        {
+            ops[numOps].client = client;
+            ops[numOps].index = i;
+            ops[numOps].data = data;
+            if (client->request.ops[i].op == SMBIPC_OP_READ)
+            {
+                data += client->request.ops[i].numBytes;
+            }
+            numOps++;
+        }
+    }
+
+    for (INT i = 0; i < numOps; )
+    {
+        BYTE    kind = ops[i].client->request.ops[ops[i].index].op;
+        INT     count = 0;
+        BOOL    batchOk;
+
+        while (i + count < numOps && ops[i + count].client->request.ops[ops[i + count].index].op == kind)
+        {
+            const SMBIPC_OP *op = &ops[i + count].client->request.ops[ops[i + count].index];
+
+            if (kind == SMBIPC_OP_READ)
+            {
+                reads[count].slaveAddress = op->slaveAddress;
+                reads[count].targetAddressSize = op->targetAddressSize;
+                memcpy(reads[count].targetAddress, op->targetAddress, op->targetAddressSize);
+                reads[count].numBytesToRead = op->numBytes;
+                reads[count].buffer = ops[i + count].data;
+                reads[count].result = -1;
+            }
+            else
+            {
+                writes[count].slaveAddress = op->slaveAddress;
+                writes[count].numBytesToWrite = (BYTE)op->numBytes;
+                writes[count].buffer = (BYTE *)op->data;
+                writes[count].result = -1;
+            }
+            count++;
+        }
+
+        // A batch that failed as a whole fails every op in it
+        if (kind == SMBIPC_OP_READ)
+        {
+            batchOk = (SMBus_ReadBatch(adapter->device, reads, (WORD)count) >= 0);
+        }
+        else
+        {
+            batchOk = (SMBus_WriteBatch(adapter->device, writes, (WORD)count) >= 0);
+        }
+        InterlockedIncrement(&adapter->batches);
+
+        for (INT k = 0; k < count; k++, i++)
+        {
+            ops[i].client->response.results[ops[i].index] = !batchOk ? -1 : (kind == SMBIPC_OP_READ) ? reads[k].result : writes[k].result;
+            if (!batchOk)
+            {
+                ops[i].client->response.result = -1;
+            }
+        }
+    }
+
+    for (INT c = 0; c < numRound; c++)
+    {
+        SMBServer_Finish(round[c]);
+    }
+}
+
+// Target address of a sequential read moved on by offset bytes, most
+// significant byte first
+static void SMBServer_OffsetAddress(BYTE *address, const BYTE *base, BYTE size, WORD offset)
+{
+    DWORD carry = offset;
+
+    for (INT i = size - 1; i >= 0; i--)
+    {
+        carry += base[i];
+        address[i] = (BYTE)carry;
+        carry >>= 8;
+    }
+}
+
+// Run one HID report of a bulk request, TRUE once the request is done.
+// Writes fit one report each, reads only split when they are sequential.
+static BOOL SMBServer_RunPiece(SMBSERVER_ADAPTER *adapter, SMBSERVER_CLIENT *client)
+{
+    const SMBIPC_OP *op = &client->request.ops[client->nextOp];
+    INT             *result = &client->response.results[client->nextOp];
+    BOOL            opDone = TRUE;
+
+    if (op->op == SMBIPC_OP_READ)
+    {
+        SMBUS_READ_DESC read;
+        WORD            chunk = op->numBytes - client->nextOffset;
+
+        if ((op->flags & SMBIPC_FLAG_SEQUENTIAL) && chunk > HID_SMBUS_MAX_READ_RESPONSE_SIZE)
+        {
+            chunk = HID_SMBUS_MAX_READ_RESPONSE_SIZE;
+        }
+        read.slaveAddress = op->slaveAddress;
+        read.targetAddressSize = op->targetAddressSize;
+        SMBServer_OffsetAddress(read.targetAddress, op->targetAddress, op->targetAddressSize, client->nextOffset);
+        read.numBytesToRead = chunk;
+        read.buffer = client->nextData + client->nextOffset;
+        read.result = -1;
+
+        // A short piece ends the read with what came so far
+        if (SMBus_ReadBatch(adapter->device, &read, 1) < 0)
+        {
+            client->response.result = -1;
+            *result = -1;
+        }
+        else if (read.result < 0 || read.result > chunk)
+        {
+            *result = -1;
+        }
+        else
+        {
+            client->nextOffset += (WORD)read.result;
+            *result = client->nextOffset;
+            opDone = (read.result < chunk || client->nextOffset == op->numBytes);
+        }
+    }
+    else
+    {
+        SMBUS_WRITE_DESC write;
+
+        write.slaveAddress = op->slaveAddress;
+        write.numBytesToWrite = (BYTE)op->numBytes;
+        write.buffer = (BYTE *)op->data;
+        write.result = -1;
+        if (SMBus_WriteBatch(adapter->device, &write, 1) < 0)
+        {
+            client->response.result = -1;
+            write.result = -1;
+        }
+        *result = write.result;
+    }
+    InterlockedIncrement(&adapter->batches);
+    InterlockedIncrement(&adapter->pieces);
+
+    if (opDone)
+    {
+        if (op->op == SMBIPC_OP_READ)
+        {
+            client->nextData += op->numBytes;
+        }
+        client->nextOp++;
+        client->nextOffset = 0;
+    }
+    if (client->nextOp < client->request.numOps)
+    {
+        return FALSE;
+    }
+
+    SMBServer_Finish(client);
+    return TRUE;
+}
+
+static DWORD WINAPI SMBServer_BusThread(LPVOID param)
+{
+    SMBSERVER_ADAPTER   *adapter = (SMBSERVER_ADAPTER *)param;
+    SMBSERVER           *server = adapter->server;
+    INT                 index = (INT)(adapter - server->adapters);
+    HANDLE              waitHandles[2] = { server->stopEvent, adapter->workEvent };
+    SMBSERVER_CLIENT    *round[SMBSERVER_MAX_CLIENTS];
+    BOOL                more = FALSE;
+
+    // Look again without waiting after every round, requests of lower
+    // classes and the rest of a bulk request do not signal workEvent again
+    while (WaitForMultipleObjects(2, waitHandles, FALSE, more ? 0 : INFINITE) != WAIT_OBJECT_0)
+    {
+        WORD    priority = SMBIPC_NUM_PRIORITIES;
+        BOOL    waiting[SMBIPC_NUM_PRIORITIES] = { FALSE };
+        INT     numRound = 0;
+
+        // Highest class with a request pending
+        EnterCriticalSection(&server->lock);
+        for (INT i = 0; i < SMBSERVER_MAX_CLIENTS; i++)
+        {
+            SMBSERVER_CLIENT *client = &server->clients[i];
+
+            if (client->inUse && client->pending && client->adapter == index)
+            {
+                waiting[client->request.priority] = TRUE;
+                if (client->request.priority < priority)
+                {
+                    priority = client->request.priority;
+                }
+            }
+        }
+
+        // Unless a lower class has been passed over for too long, so a
+        // steady stream of higher requests cannot starve it
+        for (WORD p = priority + 1; p < SMBIPC_NUM_PRIORITIES; p++)
+        {
+            if (waiting[p] && adapter->skipped[p] >= SMBSERVER_AGING_ROUNDS)
+            {
+                priority = p;
+                adapter->aged[p]++;
+                break;
+            }
+        }
+        for (WORD p = 0; p < SMBIPC_NUM_PRIORITIES; p++)
+        {
+            adapter->skipped[p] = (waiting[p] && p != priority) ? adapter->skipped[p] + 1 : 0;
+        }
+
+        // One request of every client in it, from where its last round stopped.
+        // Bulk requests stay pending until their last piece has run.
+        for (INT k = 0; priority < SMBIPC_NUM_PRIORITIES && k < SMBSERVER_MAX_CLIENTS; k++)
+        {
+            INT                 i = (adapter->next[priority] + k) % SMBSERVER_MAX_CLIENTS;
+            SMBSERVER_CLIENT    *client = &server->clients[i];
+
+            if (client->inUse && client->pending && client->adapter == index && client->request.priority == priority)
+            {
+                round[numRound++] = client;
+                if (priority == SMBIPC_PRIORITY_BULK)
+                {
+                    break;
+                }
+                client->pending = FALSE;
+            }
+        }
+        if (numRound > 0)
+        {
+            adapter->next[priority] = (INT)(round[0] - server->clients + 1) % SMBSERVER_MAX_CLIENTS;
+        }
+        LeaveCriticalSection(&server->lock);
+
+        more = (numRound > 0);
+        if (numRound == 0)
+        {
+            continue;
+        }
+        if (priority == SMBIPC_PRIORITY_BULK)
+        {
+            if (!SMBServer_RunPiece(adapter, round[0]))
+            {
+                continue;
+            }
+            EnterCriticalSection(&server->lock);
+            round[0]->pending = FALSE;
+            LeaveCriticalSection(&server->lock);
+        }
+        else
+        {
+            SMBServer_RunRound(adapter, round, numRound);
+        }
+
+        InterlockedIncrement(&adapter->rounds);
+        InterlockedExchangeAdd(&adapter->requests, numRound);
+        for (INT c = 0; c < numRound; c++)
+        {
+            SMBTiming_Record(&adapter->latency[priority], round[c]->arrival);
+            SetEvent(round[c]->doneEvent);
+        }
+    }
+
+    return 0;
+}
+
+// Adapter for a hello, opened and configured the first time it is asked
+// for. An empty serial takes any adapter already open, or the first one.
+// The bus threads of the adapters already open go on meanwhile, only
+// other hellos wait. Enumeration is serialised with recovery in smbus.c.
+static INT SMBServer_Adapter(SMBSERVER *server, const char *serial)
+{
+    SMBSERVER_ADAPTER   *adapter;
+    INT                 index = -1;
+
+    EnterCriticalSection(&server->adapterLock);
+    for (INT i = 0; i < server->numAdapters; i++)
+    {
+        if (serial[0] == '\0' || strcmp(server->adapters[i].serial, serial) == 0)
+        {
+            index = i;
+            break;
+        }
+    }
+    if (index < 0 && server->numAdapters < SMBSERVER_MAX_ADAPTERS)
+    {
+        adapter = &server->adapters[server->numAdapters];
+        memset(adapter, 0, sizeof(*adapter));
+        adapter->server = server;
+        if ((serial[0] != '\0' ? SMBus_OpenBySerial(&adapter->device, serial) : SMBus_Open(&adapter->device)) == 0)
+        {
+            if (SMBus_Configure(adapter->device, server->config.bitRate, server->config.address, server->config.autoReadRespond,
+                    server->config.writeTimeout, server->config.readTimeout, server->config.sclLowTimeout,
+                    server->config.transferRetries, server->config.responseTimeout) != 0 ||
+                SMBus_GetSerial(adapter->device, adapter->serial) != 0 ||
+                (adapter->workEvent = CreateEvent(NULL, FALSE, FALSE, NULL)) == NULL ||
+                (adapter->thread = CreateThread(NULL, 0, SMBServer_BusThread, adapter, 0, NULL)) == NULL)
+            {
+                if (adapter->workEvent != NULL)
+                {
+                    CloseHandle(adapter->workEvent);
+                }
+                SMBus_Close(adapter->device);
+            }
+            else
+            {
+                index = server->numAdapters++;
+            }
+        }
+    }
+    LeaveCriticalSection(&server->adapterLock);
+
+    return index;
+}
+
+static DWORD WINAPI SMBServer_ClientThread(LPVOID param)
+{
+    SMBSERVER_CLIENT    *client = (SMBSERVER_CLIENT *)param;
+    SMBSERVER           *server = client->server;
+    HANDLE              waitHandles[2] = { server->stopEvent, client->doneEvent };
+    SMBIPC_HELLO        hello;
+    SMBIPC_HELLO_REPLY  reply;
+    LARGE_INTEGER       now;
+    DWORD               size;
+
+    // The hello picks the adapter
+    memset(&reply, 0, sizeof(reply));
+    reply.result = -1;
+    if (ReadFile(client->pipe, &hello, sizeof(hello), &size, NULL) && size == sizeof(hello) && hello.version == SMBIPC_VERSION)
+    {
+        hello.serial[sizeof(hello.serial) - 1] = '\0';
+        client->adapter = SMBServer_Adapter(server, hello.serial);
+        if (client->adapter >= 0)
+        {
+            reply.result = 0;
+            strcpy(reply.serial, server->adapters[client->adapter].serial);
+        }
+    }
+    else
+    {
+        InterlockedIncrement(&server->refused);
+    }
+
+    if (WriteFile(client->pipe, &reply, sizeof(reply), &size, NULL) && reply.result == 0)
+    {
+        // One request at a time, the bus thread fills in the response
+        while (ReadFile(client->pipe, &client->request, sizeof(client->request), &size, NULL))
+        {
+            INT numData = SMBServer_CheckRequest(&client->request, size);
+
+            if (numData < 0)
+            {
+                InterlockedIncrement(&server->refused);
+                break;
+            }
+            client->response.numData = (WORD)numData;
+            client->response.result = 0;
+            client->nextOp = 0;
+            client->nextOffset = 0;
+            client->nextData = client->response.data;
+            QueryPerformanceCounter(&now);
+            client->arrival = now.QuadPart;
+
+            EnterCriticalSection(&server->lock);
+            client->pending = TRUE;
+            LeaveCriticalSection(&server->lock);
+            SetEvent(server->adapters[client->adapter].workEvent);
+            if (WaitForMultipleObjects(2, waitHandles, FALSE, INFINITE) != WAIT_OBJECT_0 + 1)
+            {
+                break;
+            }
+
+            InterlockedIncrement(&client->requests);
+            if (!WriteFile(client->pipe, &client->response, client->responseSize, &size, NULL))
+            {
+                break;
+            }
+        }
+    }
+
+    DisconnectNamedPipe(client->pipe);
+    CloseHandle(client->pipe);
+    EnterCriticalSection(&server->lock);
+    client->pending = FALSE;
+    client->inUse = FALSE;
+    LeaveCriticalSection(&server->lock);
+
+    return 0;
+}
+
+static DWORD WINAPI SMBServer_ListenThread(LPVOID param)
+{
+    SMBSERVER *server = (SMBSERVER *)param;
+
+    while (WaitForSingleObject(server->stopEvent, 0) == WAIT_TIMEOUT)
+    {
+        SMBSERVER_CLIENT    *client = NULL;
+        HANDLE              pipe;
+
+        if (server->pipe == INVALID_HANDLE_VALUE)
+        {
+            server->pipe = SMBServer_CreatePipe(server, FALSE);
+            if (server->pipe == INVALID_HANDLE_VALUE)
+            {
+                WaitForSingleObject(server->stopEvent, SMBSERVER_RETRY_MS);
+                continue;
+            }
+        }
+
+        // Blocks until a client connects or SMBServer_Stop cancels it
+        if (!ConnectNamedPipe(server->pipe, NULL) && GetLastError() != ERROR_PIPE_CONNECTED)
+        {
+            CloseHandle(server->pipe);
+            server->pipe = INVALID_HANDLE_VALUE;
+            continue;
+        }
+        pipe = server->pipe;
+        server->pipe = INVALID_HANDLE_VALUE;
+        InterlockedIncrement(&server->connections);
+
+        // A slot whose thread is done, the thread handle is closed on reuse
+        EnterCriticalSection(&server->lock);
+        for (INT i = 0; client == NULL && i < SMBSERVER_MAX_CLIENTS; i++)
+        {
+            if (!server->clients[i].inUse)
+            {
+                client = &server->clients[i];
+                client->inUse = TRUE;
+            }
+        }
+        LeaveCriticalSection(&server->lock);
+        if (client == NULL)
+        {
+            InterlockedIncrement(&server->refused);
+            DisconnectNamedPipe(pipe);
+            CloseHandle(pipe);
+            continue;
+        }
+        if (client->thread != NULL)
+        {
+            WaitForSingleObject(client->thread, INFINITE);
+            CloseHandle(client->thread);
+        }
+
+        client->pipe = pipe;
+        client->adapter = -1;
+        client->pending = FALSE;
+        client->requests = 0;
+        client->thread = CreateThread(NULL, 0, SMBServer_ClientThread, client, 0, NULL);
+        if (client->thread == NULL)
+        {
+            DisconnectNamedPipe(pipe);
+            CloseHandle(pipe);
+            client->inUse = FALSE;
+        }
+    }
+
+    return 0;
+}
+
+INT SMBServer_Start(SMBSERVER *server)
+{
+    memset(server->adapters, 0, sizeof(server->adapters));
+    memset(server->clients, 0, sizeof(server->clients));
+    server->numAdapters = 0;
+    server->connections = 0;
+    server->refused = 0;
+    server->listenThread = NULL;
+    server->pipe = INVALID_HANDLE_VALUE;
+    InitializeCriticalSection(&server->lock);
+    InitializeCriticalSection(&server->adapterLock);
+
+    server->stopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (server->stopEvent == NULL)
+    {
+        DeleteCriticalSection(&server->adapterLock);
+        DeleteCriticalSection(&server->lock);
+        return -1;
+    }
+    for (INT i = 0; i < SMBSERVER_MAX_CLIENTS; i++)
+    {
+        server->clients[i].server = server;
+        server->clients[i].doneEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+        if (server->clients[i].doneEvent == NULL)
+        {
+            SMBServer_Stop(server);
+            return -1;
+        }
+    }
+
+    server->pipe = SMBServer_CreatePipe(server, TRUE);
+    if (server->pipe == INVALID_HANDLE_VALUE)
+    {
+        SMBServer_Stop(server);
+        return -1;
+    }
+
+    server->listenThread = CreateThread(NULL, 0, SMBServer_ListenThread, server, 0, NULL);
+    if (server->listenThread == NULL)
+    {
+        SMBServer_Stop(server);
+        return -1;
+    }
+
+    return 0;
+}
+
+void SMBServer_Stop(SMBSERVER *server)
+{
+    SetEvent(server->stopEvent);
+    if (server->listenThread != NULL)
+    {
+        SMBServer_Join(server->listenThread);
+        server->listenThread = NULL;
+    }
+    if (server->pipe != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(server->pipe);
+        server->pipe = INVALID_HANDLE_VALUE;
+    }
+
+    // Client threads, then bus threads. A bus thread may still be finishing
+    // a round for a client that has gone and sets its doneEvent at the end,
+    // so the events are only closed once every bus thread has exited.
+    for (INT i = 0; i < SMBSERVER_MAX_CLIENTS; i++)
+    {
+        SMBSERVER_CLIENT *client = &server->clients[i];
+
+        if (client->thread != NULL)
+        {
+            SMBServer_Join(client->thread);
+            client->thread = NULL;
+        }
+    }
+    for (INT i = 0; i < server->numAdapters; i++)
+    {
+        SMBSERVER_ADAPTER *adapter = &server->adapters[i];
+
+        WaitForSingleObject(adapter->thread, INFINITE);
+        CloseHandle(adapter->thread);
+        CloseHandle(adapter->workEvent);
+        SMBus_Close(adapter->device);
+    }
+    server->numAdapters = 0;
+    for (INT i = 0; i < SMBSERVER_MAX_CLIENTS; i++)
+    {
+        SMBSERVER_CLIENT *client = &server->clients[i];
+
+        if (client->doneEvent != NULL)
+        {
+            CloseHandle(client->doneEvent);
+            client->doneEvent = NULL;
+        }
+    }
+
+    CloseHandle(server->stopEvent);
+    DeleteCriticalSection(&server->adapterLock);
+    DeleteCriticalSection(&server->lock);
+}
@@ -0,0 +1,229 @@
+#include "smbtiming.h"
+
+#include <string.h>
+
+static const char *stageNames[SMBTIMING_NUM_STAGES] =
+{
+    "read_request", "force_response", "read_response", "read_total",
+    "write_request", "status_poll", "poll_sleep", "write_total"
+};
+
+static SMBTIMING_ENTRY  entries[SMBTIMING_MAX_KEYS];
+static volatile LONG    enabled;
+static LONGLONG         frequency;
+
+void SMBTiming_Enable(BOOL enable)
+{
+    LARGE_INTEGER freq;
+
+    QueryPerformanceFrequency(&freq);
+    frequency = freq.QuadPart;
+    InterlockedExchange(&enabled, enable ? 1 : 0);
+}
+
+// Clear the histograms, keys stay so concurrent lookups remain valid
+void SMBTiming_Reset(void)
+{
+    for (INT i = 0; i < SMBTIMING_MAX_KEYS; i++)
+    {
+        entries[i].errors = 0;
+        memset((void *)entries[i].stages, 0, sizeof(entries[i].stages));
+    }
+}
+
+SMBTIMING_ENTRY *SMBTiming_Entry(BYTE slaveAddress, BYTE reg)
+{
+    LONG    key = 0x10000 | (slaveAddress << 8) | reg;
+    INT     slot = (slaveAddress * 31 + reg) & (SMBTIMING_MAX_KEYS - 1);
+
+    if (!enabled)
+    {
+        return NULL;
+    }
+
+    // Open addressing, a free slot is claimed with a compare-exchange so
+    // several acquisition threads can insert keys concurrently
+    for (INT i = 0; i < SMBTIMING_MAX_KEYS; i++)
+    {
+        SMBTIMING_ENTRY *entry = &entries[(slot + i) & (SMBTIMING_MAX_KEYS - 1)];
+        LONG            current = entry->key;
+
+        if (current == 0)
+        {
+            current = InterlockedCompareExchange(&entry->key, key, 0);
+            if (current == 0)
+            {
+                return entry;
+            }
+        }
+        if (current == key)
+        {
+            return entry;
+        }
+    }
+
+    // Table full
+    return NULL;
+}
+
+LONGLONG SMBTiming_Start(SMBTIMING_ENTRY *entry)
+{
+    LARGE_INTEGER now;
+
+    if (entry == NULL)
+    {
+        return 0;
+    }
+
+    QueryPerformanceCounter(&now);
+    return now.QuadPart;
+}
+
+static INT SMBTiming_Bucket(DWORD us)
+{
+    INT octave = 0;
+
+    // Values below four get a bucket each
+    if (us < 4)
+    {
+        return (INT)us;
+    }
+    while ((us >> octave) > 1)
+    {
+        octave++;
+    }
+    // Two bits below the leading one select the quarter octave
+    octave = 4 * (octave - 1) + (INT)((us >> (octave - 2)) & 3);
+
+    return (octave < SMBTIMING_NUM_BUCKETS) ? octave : SMBTIMING_NUM_BUCKETS - 1;
+}
+
+// Largest value that falls in a bucket
+static DWORD SMBTiming_BucketLimit(INT bucket)
+{
+    INT shift;
+
+    if (bucket < 4)
+    {
+        return (DWORD)bucket;
+    }
+    shift = bucket / 4 - 1;
+
+    return (((DWORD)(4 + bucket % 4) << shift) + ((DWORD)1 << shift)) - 1;
+}
+
+LONGLONG SMBTiming_Record(SMBTIMING_HISTOGRAM *histogram, LONGLONG start)
+{
+    LARGE_INTEGER   now;
+    LONGLONG        elapsed;
+    LONG            us;
+    LONG            max;
+
+    // Histograms outside the table are usable without SMBTiming_Enable
+    if (frequency == 0)
+    {
+        LARGE_INTEGER freq;
+
+        QueryPerformanceFrequency(&freq);
+        frequency = freq.QuadPart;
+    }
+
+    QueryPerformanceCounter(&now);
+    elapsed = (now.QuadPart - start) * 1000000 / frequency;
+    us = (elapsed > 0x7FFFFFFF) ? 0x7FFFFFFF : (LONG)elapsed;
+
+    InterlockedIncrement(&histogram->count);
+    InterlockedExchangeAdd64(&histogram->totalUs, us);
+    InterlockedIncrement(&histogram->buckets[SMBTiming_Bucket((DWORD)us)]);
+    max = histogram->maxUs;
+    while (us > max)
+    {
+        LONG previous = InterlockedCompareExchange(&histogram->maxUs, us, max);
+        if (previous == max)
+        {
+            break;
+        }
+        max = previous;
+    }
+
+    return now.QuadPart;
+}
+
+LONGLONG SMBTiming_Stop(SMBTIMING_ENTRY *entry, SMBTIMING_STAGE stage, LONGLONG start)
+{
+    if (entry == NULL)
+    {
+        return 0;
+    }
+
+    // The end of this stage starts the next one
+    return SMBTiming_Record(&entry->stages[stage], start);
+}
+
+void SMBTiming_Error(SMBTIMING_ENTRY *entry)
+{
+    if (entry != NULL)
+    {
+        InterlockedIncrement(&entry->errors);
+    }
+}
+
+// Upper bound of the bucket holding the given percentile
+DWORD SMBTiming_Percentile(const SMBTIMING_HISTOGRAM *histogram, DWORD percent)
+{
+    LONGLONG    target = ((LONGLONG)histogram->count * percent + 99) / 100;
+    LONGLONG    seen = 0;
+
+    for (INT i = 0; i < SMBTIMING_NUM_BUCKETS; i++)
+    {
+        seen += histogram->buckets[i];
+        if (seen >= target && seen > 0)
+        {
+            return SMBTiming_BucketLimit(i);
+        }
+    }
+
+    return 0;
+}
+
+// One line per slave/register/stage, optionally followed by the
+// non-empty buckets as upper_us:count pairs
+void SMBTiming_Dump(FILE *fp, BOOL buckets)
+{
+    fprintf(fp, "slave,reg,stage,count,errors,mean_us,p50_us,p99_us,max_us\n");
+    for (INT i = 0; i < SMBTIMING_MAX_KEYS; i++)
+    {
+        const SMBTIMING_ENTRY *entry = &entries[i];
+
+        if (entry->key == 0)
+        {
+            continue;
+        }
+        for (INT stage = 0; stage < SMBTIMING_NUM_STAGES; stage++)
+        {
+            const SMBTIMING_HISTOGRAM *histogram = &entry->stages[stage];
+
+            if (histogram->count == 0)
+            {
+                continue;
+            }
+            fprintf(fp, "0x%02X,0x%02X,%s,%ld,%ld,%.1f,%lu,%lu,%ld\n",
+                (BYTE)(entry->key >> 8), (BYTE)entry->key, stageNames[stage],
+                (long)histogram->count, (long)entry->errors,
+                (double)histogram->totalUs / histogram->count,
+                (unsigned long)SMBTiming_Percentile(histogram, 50), (unsigned long)SMBTiming_Percentile(histogram, 99),
+                (long)histogram->maxUs);
+            if (buckets)
+            {
+                for (INT b = 0; b < SMBTIMING_NUM_BUCKETS; b++)
+                {
+                    if (histogram->buckets[b] != 0)
+                    {
+                        fprintf(fp, " %lu:%ld", (unsigned long)SMBTiming_BucketLimit(b), (long)histogram->buckets[b]);
+                    }
+                }
+                fprintf(fp, "\n");
+            }
+        }
+    }
+}
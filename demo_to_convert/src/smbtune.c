@@ -0,0 +1,141 @@
+#include "smbtune.h"
+
+#include <stdio.h>
+#include <string.h>
+
+typedef struct
+{
+    HID_SMBUS_DEVICE_STR    serial;
+    DWORD                   bitRate;
+    WORD                    writeTimeout;
+    WORD                    readTimeout;
+} SMBTUNE_ENTRY;
+
+// Read every well-formed line, returns the number of entries
+static INT SMBTune_ReadFile(const char *path, SMBTUNE_ENTRY *entries)
+{
+    FILE            *fp = fopen(path, "r");
+    char            line[128];
+    INT             count = 0;
+    unsigned long   bitRate;
+    unsigned int    writeTimeout, readTimeout;
+
+    if (fp == NULL)
+    {
+        return 0;
+    }
+
+    while (count < SMBTUNE_MAX_ADAPTERS && fgets(line, sizeof(line), fp) != NULL)
+    {
+        SMBTUNE_ENTRY *entry = &entries[count];
+
+        if (sscanf(line, "%259s %lu %u %u", entry->serial, &bitRate, &writeTimeout, &readTimeout) == 4)
+        {
+            entry->bitRate = (DWORD)bitRate;
+            entry->writeTimeout = (WORD)writeTimeout;
+            entry->readTimeout = (WORD)readTimeout;
+            count++;
+        }
+    }
+    fclose(fp);
+
+    return count;
+}
+
+static DWORD SMBTune_Clamp(DWORD value, DWORD lo, DWORD hi)
+{
+    return (value < lo) ? lo : (value > hi) ? hi : value;
+}
+
+INT SMBTune_Load(const char *path, const char *serial, const SMBUS_TUNE_CONFIG *bounds, SMBUS_BUS_CONFIG *config)
+{
+    SMBTUNE_ENTRY   entries[SMBTUNE_MAX_ADAPTERS];
+    INT             count = SMBTune_ReadFile(path, entries);
+
+    for (INT i = 0; i < count; i++)
+    {
+        if (strcmp(entries[i].serial, serial) == 0)
+        {
+            config->bitRate = SMBTune_Clamp(entries[i].bitRate, bounds->minBitRate, bounds->maxBitRate);
+            config->writeTimeout = (WORD)SMBTune_Clamp(entries[i].writeTimeout, bounds->minTimeoutMs, bounds->maxTimeoutMs);
+            config->readTimeout = (WORD)SMBTune_Clamp(entries[i].readTimeout, bounds->minTimeoutMs, bounds->maxTimeoutMs);
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+INT SMBTune_Save(const char *path, const char *serial, const SMBUS_BUS_CONFIG *config)
+{
+    SMBTUNE_ENTRY   entries[SMBTUNE_MAX_ADAPTERS];
+    INT             count = SMBTune_ReadFile(path, entries);
+    INT             i;
+    FILE            *fp;
+
+    if (strlen(serial) >= sizeof(entries[0].serial))
+    {
+        return -1;
+    }
+
+    for (i = 0; i < count && strcmp(entries[i].serial, serial) != 0; i++)
+    {
+    }
+    if (i == count)
+    {
+        // A new adapter, the file is full if there is no room
+        if (count == SMBTUNE_MAX_ADAPTERS)
+        {
+            return -1;
+        }
+        strcpy(entries[count++].serial, serial);
+    }
+    entries[i].bitRate = config->bitRate;
+    entries[i].writeTimeout = config->writeTimeout;
+    entries[i].readTimeout = config->readTimeout;
+
+    fp = fopen(path, "w");
+    if (fp == NULL)
+    {
+        return -1;
+    }
+    for (i = 0; i < count; i++)
+    {
+        fprintf(fp, "%s %lu %u %u\n", entries[i].serial, (unsigned long)entries[i].bitRate, entries[i].writeTimeout, entries[i].readTimeout);
+    }
+
+    return (fclose(fp) == 0) ? 0 : -1;
+}
+
+INT SMBTune_LoadLast(const char *path, HID_SMBUS_DEVICE_STR serial, DWORD *deviceNum)
+{
+    FILE            *fp = fopen(path, "r");
+    unsigned long   index;
+    INT             result = -1;
+
+    if (fp == NULL)
+    {
+        return -1;
+    }
+    if (fscanf(fp, "%259s %lu", serial, &index) == 2)
+    {
+        *deviceNum = (DWORD)index;
+        result = 0;
+    }
+    fclose(fp);
+
+    return result;
+}
+
+INT SMBTune_SaveLast(const char *path, const char *serial, DWORD deviceNum)
+{
+    FILE *fp = fopen(path, "w");
+
+    if (fp == NULL)
+    {
+        return -1;
+    }
+    fprintf(fp, "%s %lu\n", serial, (unsigned long)deviceNum);
+
+    return (fclose(fp) == 0) ? 0 : -1;
+}
@@ -1,4 +1,8 @@
+#include <windows.h>
 #include "smbus.h"
+#include "smbtiming.h"
+#include "smbpec.h"
+#include "backend.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -7,223 +11,2291 @@
 #define VID 0x10C4
 #define PID 0xEA90
 
+// Marks the members of a merged read within SMBus_ReadBatch
+#define SMBUS_RESULT_PENDING        -2
+#define SMBUS_RESULT_MERGED         -3
+
+// Reads repeated after a PEC mismatch before giving up
+#define SMBUS_PEC_RETRIES           2
+
+// Writes read back per SMBus_ReadBatch call in SMBus_WriteVerifyBatch
+#define SMBUS_VERIFY_CHUNK          16
+
+// Bit rates auto-tuning steps through
+static const DWORD tuneBitRates[] = { 10000, 20000, 50000, 100000, 200000, 400000 };
+#define SMBUS_TUNE_RATES            ((INT)(sizeof(tuneBitRates) / sizeof(tuneBitRates[0])))
+
+// Registers with a TTL per handle, and the longest read kept
+#define SMBUS_CACHE_SIZE            32
+#define SMBUS_CACHE_MAX_BYTES       4
+
+// Write issued but not yet collected, with its timing slot
+typedef struct
+{
+    SMBTIMING_ENTRY     *timing;
+    LONGLONG            start;
+    BYTE                slaveAddress;
+} SMBUS_PENDING_WRITE;
+
+// Pin setup applied by SMBus_SetGpioConfig, replayed after a reopen
+typedef struct
+{
+    BYTE    direction;
+    BYTE    mode;
+    BYTE    function;
+    BYTE    clkDiv;
+} SMBUS_GPIO_CONFIG;
+
+// Auto-tuning of one handle, the window is judged and cleared every
+// windowTransfers transfers
+typedef struct
+{
+    BOOL                enabled;
+    SMBUS_TUNE_CONFIG   config;
+    INT                 rate;           // Index in tuneBitRates
+    INT                 lowest;
+    INT                 ceiling;        // Highest index that has not failed
+    WORD                timeoutFloor;   // Timeouts are not halved below this
+    DWORD               cleanWindows;   // In a row
+    BOOL                statusSeen;     // The current transfer's status was counted
+    DWORD               reads;          // Successful reads since the last sampled one
+    SMBUS_TUNE_STATS    window;
+    SMBUS_TUNE_STATS    stats;
+} SMBUS_TUNE_STATE;
+
+// What a failed transfer says about the adapter
+typedef enum
+{
+    SMBUS_FAULT_NONE,
+    SMBUS_FAULT_SLAVE,                  // NACK or slave timeout, the adapter is fine
+    SMBUS_FAULT_TRANSFER,               // Bus not free, arbitration lost, incomplete or stuck transfer
+    SMBUS_FAULT_ADAPTER                 // A library call failed
+} SMBUS_FAULT;
+
+// Circuit breaker for one slave address
+typedef struct
+{
+    DWORD   failures;                   // NACKs and timeouts in a row
+    BOOL    quarantined;
+    DWORD   probeTick;                  // Next transfer let through while quarantined
+    DWORD   skipped;
+    DWORD   quarantines;
+    DWORD   pecErrors;
+    SMBUS_SLAVE_CAPS caps;
+} SMBUS_SLAVE_STATE;
+
+// Last value of a register with a TTL
+typedef struct
+{
+    BYTE    slaveAddress;
+    BYTE    reg;
+    DWORD   ttlMs;
+    BOOL    valid;
+    BYTE    length;
+    BYTE    data[SMBUS_CACHE_MAX_BYTES];
+    DWORD   readTick;
+} SMBUS_CACHE_ENTRY;
+
+// Per-handle state tracked by the SMBus layer. SMBus_Open hands out the
+// session address as the device handle, so the handle stays valid when
+// recovery replaces the library handle behind it.
+typedef struct
+{
+    HID_SMBUS_DEVICE    handle;         // Library handle
+    CRITICAL_SECTION    lock;           // Held while recovery closes or replaces handle, and by latch calls
+    BOOL                inUse;
+    BOOL                opened;         // Open state as last known
+    BOOL                verified;       // Cleared by an I/O error, forces a HidSmbus_IsOpened query
+    BOOL                writePending;   // SMBus_WriteAsync issued one, SMBus_WaitWrite has not collected it
+    SMBUS_PENDING_WRITE pendingWrite;
+    HID_SMBUS_DEVICE_STR serial;        // Finds the adapter again after a reset
+    BOOL                configured;
+    SMBUS_BUS_CONFIG    config;
+    BOOL                gpioConfigured;
+    SMBUS_GPIO_CONFIG   gpio;
+    DWORD               faults;         // Adapter faults since the last good transfer
+    BOOL                reopening;      // Reset and closed, waiting to be opened again
+    DWORD               backoffMs;
+    DWORD               retryTick;      // Next reopen attempt
+    SMBUS_RECOVERY_STATS stats;
+    SMBUS_FAULT         lastFault;      // Set by the transfer that just failed
+    SMBUS_SLAVE_STATE   slaves[128];    // By 7-bit address
+    SMBUS_CACHE_ENTRY   cache[SMBUS_CACHE_SIZE];
+    DWORD               numCached;
+    SMBUS_CACHE_STATS   cacheStats;
+    SMBUS_TUNE_STATE    tune;
+} SMBUS_SESSION;
+
+static SMBUS_SESSION sessions[SMBUS_MAX_SESSIONS];
+
+// Enumeration cache, one entry per device index
+typedef struct
+{
+    HID_SMBUS_DEVICE_STR    serial;
+    HID_SMBUS_DEVICE_STR    path;
+    BOOL                    valid;          // Serial was read
+} SMBUS_DEVICE_ENTRY;
+
+static SMBUS_DEVICE_ENTRY   deviceCache[SMBUS_MAX_DEVICES];
+static DWORD                numCachedDevices;
+static BOOL                 cacheValid;
+
+// Device API, the DLL unless SMBus_SetBackend picked another
+static const SMBUS_BACKEND *backend = &backendDll;
+
+// Transfer status polling policy used by every write path
+static SMBUS_POLL_CONFIG pollConfig = { 0, 8, 1000 };
+
+// Reset after three faults in a row, retry the reopen from 10 ms up to 1 s
+static SMBUS_RECOVERY_CONFIG recoveryConfig = { 3, 10, 1000 };
+
+// Quarantine after three NACKs or timeouts in a row, probe once a second
+static SMBUS_BREAKER_CONFIG breakerConfig = { 3, 1000 };
+
+// Held while the enumeration cache is read or rebuilt and an adapter is
+// opened from it. Adapter threads may recover at once, and one of them may
+// open another adapter meanwhile. Taken again by the thread holding it.
+static volatile LONG enumLock;          // Thread id of the holder, 0 when free
+static DWORD enumDepth;
+
+static INT SMBus_WaitTransfer(HID_SMBUS_DEVICE device, SMBTIMING_ENTRY *timing, DWORD timeoutMs);
+static void SMBus_EnumLock(void);
+static void SMBus_EnumUnlock(void);
+static INT SMBus_UpdateDevices(BOOL force);
+static INT SMBus_FindSerial(const char *serial);
+static void SMBus_SessionError(HID_SMBUS_DEVICE device);
+static void SMBus_TuneStatus(HID_SMBUS_DEVICE device, HID_SMBUS_S0 status0, HID_SMBUS_S1 status1, WORD numRetries);
+
+// Session behind a handle from SMBus_Open or behind its library handle
+static SMBUS_SESSION *SMBus_FindSession(HID_SMBUS_DEVICE device)
+{
+    for (INT i = 0; i < SMBUS_MAX_SESSIONS; i++)
+    {
+        if (sessions[i].inUse && ((HID_SMBUS_DEVICE)&sessions[i] == device || sessions[i].handle == device))
+        {
+            return &sessions[i];
+        }
+    }
+
+    return NULL;
+}
+
+// Start tracking a handle that has just been opened
+static SMBUS_SESSION *SMBus_AddSession(HID_SMBUS_DEVICE device)
+{
+    SMBUS_SESSION *session = SMBus_FindSession(device);
+
+    for (INT i = 0; session == NULL && i < SMBUS_MAX_SESSIONS; i++)
+    {
+        if (!sessions[i].inUse)
+        {
+            session = &sessions[i];
+        }
+    }
+
+    // Table full, the handle falls back to HidSmbus_IsOpened on every call
+    if (session == NULL)
+    {
+        return NULL;
+    }
+
+    if (session->inUse)
+    {
+        DeleteCriticalSection(&session->lock);
+    }
+    memset(session, 0, sizeof(*session));
+    InitializeCriticalSection(&session->lock);
+    session->handle = device;
+    session->inUse = TRUE;
+    session->opened = TRUE;
+    session->verified = TRUE;
+
+    return session;
+}
+
+static INT SMBus_ApplyConfig(HID_SMBUS_DEVICE device, const SMBUS_BUS_CONFIG *config)
+{
+    if (backend->SetSmbusConfig(device, config->bitRate, config->address, config->autoReadRespond, config->writeTimeout,
+            config->readTimeout, config->sclLowTimeout, config->transferRetries) != HID_SMBUS_SUCCESS ||
+        backend->SetTimeouts(device, config->responseTimeout) != HID_SMBUS_SUCCESS)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+// Find the adapter again by serial after a reset, with the settings it had.
+// A miss doubles the wait before the next attempt.
+static INT SMBus_Reopen(SMBUS_SESSION *session)
+{
+    HID_SMBUS_DEVICE        handle;
+    HID_SMBUS_DEVICE_STR    openedSerial;
+    INT                     index;
+    BOOL                    found = FALSE;
+
+    SMBus_EnumLock();
+    if (SMBus_UpdateDevices(TRUE) >= 0 && (index = SMBus_FindSerial(session->serial)) >= 0)
+    {
+        found = (backend->Open(&handle, (DWORD)index, VID, PID) == HID_SMBUS_SUCCESS);
+    }
+    SMBus_EnumUnlock();
+
+    if (found)
+    {
+        if (backend->GetOpenedString(handle, openedSerial, HID_SMBUS_GET_SERIAL_STR) == HID_SMBUS_SUCCESS &&
+            strcmp(openedSerial, session->serial) == 0 &&
+            (!session->configured || SMBus_ApplyConfig(handle, &session->config) == 0) &&
+            (!session->gpioConfigured || backend->SetGpioConfig(handle, session->gpio.direction, session->gpio.mode,
+                session->gpio.function, session->gpio.clkDiv) == HID_SMBUS_SUCCESS))
+        {
+            session->handle = handle;
+            session->opened = TRUE;
+            session->verified = TRUE;
+            session->reopening = FALSE;
+            session->faults = 0;
+            session->backoffMs = 0;
+            session->stats.reopens++;
+            return 0;
+        }
+        backend->Close(handle);
+    }
+
+    session->backoffMs = (session->backoffMs == 0) ? recoveryConfig.minBackoffMs : session->backoffMs * 2;
+    if (session->backoffMs > recoveryConfig.maxBackoffMs)
+    {
+        session->backoffMs = recoveryConfig.maxBackoffMs;
+    }
+    session->retryTick = GetTickCount() + session->backoffMs;
+    session->stats.failedReopens++;
+    return -1;
+}
+
+// Recovery state machine, run on the thread that saw the failure:
+// cancel the transfer, and when that fails or faults keep coming, reset
+// the adapter and open it again. Until the reopen succeeds every call on
+// the handle fails at once instead of waiting out a timeout.
+static void SMBus_Fault(HID_SMBUS_DEVICE device, SMBUS_FAULT fault)
+{
+    SMBUS_SESSION *session = SMBus_FindSession(device);
+
+    if (session != NULL)
+    {
+        session->lastFault = fault;
+    }
+
+    // A slave that answers with a NACK proves the adapter works
+    if (fault == SMBUS_FAULT_SLAVE)
+    {
+        if (session != NULL)
+        {
+            session->faults = 0;
+        }
+        return;
+    }
+    if (session == NULL || session->reopening)
+    {
+        backend->CancelTransfer(device);
+        return;
+    }
+
+    session->faults++;
+    if (recoveryConfig.resetAfterFaults == 0 || session->faults < recoveryConfig.resetAfterFaults || session->serial[0] == '\0')
+    {
+        if (backend->CancelTransfer(device) == HID_SMBUS_SUCCESS)
+        {
+            session->stats.cancels++;
+            return;
+        }
+        if (recoveryConfig.resetAfterFaults == 0 || session->serial[0] == '\0')
+        {
+            return;
+        }
+    }
+
+    // The adapter drops off USB while it reboots, first reopen right away.
+    // Latch calls from other threads wait until the new handle is in place.
+    EnterCriticalSection(&session->lock);
+    backend->Reset(device);
+    backend->Close(device);
+    session->stats.resets++;
+    session->reopening = TRUE;
+    session->opened = FALSE;
+    session->verified = TRUE;
+    session->backoffMs = 0;
+    SMBus_Reopen(session);
+    LeaveCriticalSection(&session->lock);
+}
+
+// Classify a transfer that ended in HID_SMBUS_S0_ERROR from its detail
+static SMBUS_FAULT SMBus_ErrorFault(HID_SMBUS_S1 status1)
+{
+    switch (status1)
+    {
+    case HID_SMBUS_S1_ERROR_TIMEOUT_NACK:
+    case HID_SMBUS_S1_ERROR_SUCCESS_AFTER_RETRY:
+        return SMBUS_FAULT_SLAVE;
+    default:
+        return SMBUS_FAULT_TRANSFER;
+    }
+}
+
+// Ask the adapter why the last transfer failed
+static SMBUS_FAULT SMBus_QueryFault(HID_SMBUS_DEVICE device)
+{
+    HID_SMBUS_S0    status0;
+    HID_SMBUS_S1    status1;
+    WORD            numRetries;
+    WORD            bytesRead;
+
+    if (backend->TransferStatusRequest(device) != HID_SMBUS_SUCCESS ||
+        backend->GetTransferStatusResponse(device, &status0, &status1, &numRetries, &bytesRead) != HID_SMBUS_SUCCESS)
+    {
+        return SMBUS_FAULT_ADAPTER;
+    }
+    SMBus_TuneStatus(device, status0, status1, numRetries);
+
+    // No detail left, give the adapter the benefit of the doubt
+    return (status0 == HID_SMBUS_S0_ERROR) ? SMBus_ErrorFault(status1) : SMBUS_FAULT_SLAVE;
+}
+
+// A transfer went through, the fault streak is over
+static void SMBus_Healthy(HID_SMBUS_DEVICE device)
+{
+    SMBUS_SESSION *session = SMBus_FindSession(device);
+
+    if (session != NULL)
+    {
+        session->faults = 0;
+    }
+}
+
+// Whether a transfer to slaveAddress may use the bus. A quarantined
+// address fails at once, except for one probe per probe interval.
+static BOOL SMBus_SlaveReady(HID_SMBUS_DEVICE device, BYTE slaveAddress)
+{
+    SMBUS_SESSION       *session = SMBus_FindSession(device);
+    SMBUS_SLAVE_STATE   *slave;
+
+    if (session == NULL)
+    {
+        return TRUE;
+    }
+
+    session->lastFault = SMBUS_FAULT_NONE;
+    slave = &session->slaves[slaveAddress >> 1];
+    if (!slave->quarantined)
+    {
+        return TRUE;
+    }
+    if ((LONG)(GetTickCount() - slave->probeTick) < 0)
+    {
+        slave->skipped++;
+        return FALSE;
+    }
+
+    // Let this one through, the next probe waits for a full interval
+    slave->probeTick = GetTickCount() + breakerConfig.probeIntervalMs;
+    return TRUE;
+}
+
+// Update the breaker of slaveAddress once its transfer has finished. Only
+// slave faults count, a bus or adapter fault says nothing about the slave.
+static void SMBus_SlaveDone(HID_SMBUS_DEVICE device, BYTE slaveAddress, BOOL succeeded)
+{
+    SMBUS_SESSION       *session = SMBus_FindSession(device);
+    SMBUS_SLAVE_STATE   *slave;
+
+    if (session == NULL)
+    {
+        return;
+    }
+
+    slave = &session->slaves[slaveAddress >> 1];
+    if (succeeded)
+    {
+        slave->failures = 0;
+        slave->quarantined = FALSE;
+        return;
+    }
+    if (session->lastFault != SMBUS_FAULT_SLAVE)
+    {
+        return;
+    }
+
+    slave->failures++;
+    if (!slave->quarantined && breakerConfig.quarantineAfter != 0 && slave->failures >= breakerConfig.quarantineAfter)
+    {
+        slave->quarantined = TRUE;
+        slave->probeTick = GetTickCount() + breakerConfig.probeIntervalMs;
+        slave->quarantines++;
+    }
+}
+
+// Count what a transfer status says about the link. NACKs are left to
+// the breaker, they say more about the slave than about the wire.
+static void SMBus_TuneStatus(HID_SMBUS_DEVICE device, HID_SMBUS_S0 status0, HID_SMBUS_S1 status1, WORD numRetries)
+{
+    SMBUS_SESSION       *session = SMBus_FindSession(device);
+    SMBUS_TUNE_STATE    *tune;
+
+    if (session == NULL || !session->tune.enabled)
+    {
+        return;
+    }
+
+    tune = &session->tune;
+    tune->statusSeen = TRUE;
+    switch (status0)
+    {
+    case HID_SMBUS_S0_COMPLETE:
+        tune->window.retries += numRetries;
+        break;
+    case HID_SMBUS_S0_ERROR:
+        if (status1 == HID_SMBUS_S1_ERROR_SUCCESS_AFTER_RETRY)
+        {
+            tune->window.retries += (numRetries > 0) ? numRetries : 1;
+        }
+        else if (status1 != HID_SMBUS_S1_ERROR_TIMEOUT_NACK)
+        {
+            tune->window.errors++;
+            if (status1 != HID_SMBUS_S1_ERROR_ARB_LOST)
+            {
+                tune->window.timeouts++;
+            }
+        }
+        break;
+    case HID_SMBUS_S0_BUSY:
+        // Still busy past the deadline
+        tune->window.errors++;
+        tune->window.timeouts++;
+        break;
+    default:
+        break;
+    }
+}
+
+// Judge a full window and move the settings one step
+static void SMBus_TuneStep(HID_SMBUS_DEVICE device, SMBUS_SESSION *session)
+{
+    SMBUS_TUNE_STATE    *tune = &session->tune;
+    SMBUS_BUS_CONFIG    config = session->config;
+    WORD                timeout = config.readTimeout;
+
+    tune->stats.transfers += tune->window.transfers;
+    tune->stats.errors += tune->window.errors;
+    tune->stats.timeouts += tune->window.timeouts;
+    tune->stats.retries += tune->window.retries;
+
+    if (tune->window.errors * 1000 > tune->config.maxErrorPermille * tune->window.transfers)
+    {
+        // Too many errors, slow down and do not come back to this rate
+        tune->cleanWindows = 0;
+        if (tune->rate > tune->lowest)
+        {
+            tune->rate--;
+            tune->ceiling = tune->rate;
+        }
+        if (tune->window.timeouts > 0)
+        {
+            timeout = (timeout * 2 < tune->config.maxTimeoutMs) ? (WORD)(timeout * 2) : tune->config.maxTimeoutMs;
+            tune->timeoutFloor = timeout;
+        }
+    }
+    else if (tune->window.errors == 0 && tune->window.retries == 0 && ++tune->cleanWindows >= tune->config.stepUpWindows)
+    {
+        // Clean for long enough, speed up, or wait less once at the top
+        tune->cleanWindows = 0;
+        if (tune->rate < tune->ceiling)
+        {
+            tune->rate++;
+        }
+        else
+        {
+            timeout /= 2;
+            if (timeout < tune->config.minTimeoutMs || timeout < tune->timeoutFloor)
+            {
+                timeout = (tune->config.minTimeoutMs > tune->timeoutFloor) ? tune->config.minTimeoutMs : tune->timeoutFloor;
+            }
+        }
+    }
+    memset(&tune->window, 0, sizeof(tune->window));
+
+    config.bitRate = tuneBitRates[tune->rate];
+    config.readTimeout = timeout;
+    config.writeTimeout = timeout;
+    if (config.bitRate == session->config.bitRate && config.readTimeout == session->config.readTimeout &&
+        config.writeTimeout == session->config.writeTimeout)
+    {
+        return;
+    }
+    if (config.bitRate > session->config.bitRate || config.readTimeout < session->config.readTimeout)
+    {
+        tune->stats.stepsUp++;
+    }
+    else
+    {
+        tune->stats.stepsDown++;
+    }
+
+    // Between transfers, on the thread that does them
+    session->config = config;
+    if (SMBus_ApplyConfig(device, &config) != 0)
+    {
+        SMBus_SessionError(device);
+    }
+}
+
+// Count a finished transfer. Reads that did not poll their status only
+// show their retries when asked, which costs a round trip, so only one in
+// sampleEvery is. Both go to the library handle the session holds now.
+static void SMBus_TuneDone(HID_SMBUS_DEVICE device, BOOL read, BOOL succeeded)
+{
+    SMBUS_SESSION       *session = SMBus_FindSession(device);
+    SMBUS_TUNE_STATE    *tune;
+    HID_SMBUS_S0        status0;
+    HID_SMBUS_S1        status1;
+    WORD                numRetries;
+    WORD                bytesRead;
+
+    if (session == NULL || !session->tune.enabled)
+    {
+        return;
+    }
+
+    tune = &session->tune;
+    if (read && succeeded && !tune->statusSeen && tune->config.sampleEvery != 0 && ++tune->reads >= tune->config.sampleEvery)
+    {
+        tune->reads = 0;
+        if (backend->TransferStatusRequest(session->handle) == HID_SMBUS_SUCCESS &&
+            backend->GetTransferStatusResponse(session->handle, &status0, &status1, &numRetries, &bytesRead) == HID_SMBUS_SUCCESS &&
+            status0 == HID_SMBUS_S0_COMPLETE)
+        {
+            tune->window.retries += numRetries;
+        }
+    }
+    if (!succeeded && !tune->statusSeen && session->lastFault == SMBUS_FAULT_TRANSFER)
+    {
+        tune->window.errors++;
+    }
+    tune->statusSeen = FALSE;
+
+    tune->window.transfers++;
+    if (tune->window.transfers >= tune->config.windowTransfers)
+    {
+        SMBus_TuneStep(session->handle, session);
+    }
+}
+
+static SMBUS_CACHE_ENTRY *SMBus_CacheFind(SMBUS_SESSION *session, BYTE slaveAddress, BYTE reg)
+{
+    for (DWORD i = 0; i < session->numCached; i++)
+    {
+        if (session->cache[i].slaveAddress == slaveAddress && session->cache[i].reg == reg)
+        {
+            return &session->cache[i];
+        }
+    }
+
+    return NULL;
+}
+
+// Answer a single register read from the cache while its value is fresh
+static BOOL SMBus_CacheGet(HID_SMBUS_DEVICE device, BYTE *buffer, BYTE slaveAddress, WORD numBytesToRead, BYTE targetAddressSize, const BYTE *targetAddress)
+{
+    SMBUS_SESSION       *session = SMBus_FindSession(device);
+    SMBUS_CACHE_ENTRY   *entry;
+
+    if (session == NULL || session->numCached == 0 || targetAddressSize != 1)
+    {
+        return FALSE;
+    }
+    entry = SMBus_CacheFind(session, slaveAddress, targetAddress[0]);
+    if (entry == NULL)
+    {
+        return FALSE;
+    }
+
+    if (entry->valid && entry->length == numBytesToRead &&
+        (entry->ttlMs == SMBUS_TTL_CONSTANT || GetTickCount() - entry->readTick < entry->ttlMs))
+    {
+        memcpy(buffer, entry->data, numBytesToRead);
+        session->cacheStats.hits++;
+        return TRUE;
+    }
+
+    session->cacheStats.misses++;
+    return FALSE;
+}
+
+// Keep what a bus read of a register with a TTL returned
+static void SMBus_CachePut(HID_SMBUS_DEVICE device, const BYTE *buffer, BYTE slaveAddress, WORD numBytesRead, BYTE targetAddressSize, const BYTE *targetAddress)
+{
+    SMBUS_SESSION       *session = SMBus_FindSession(device);
+    SMBUS_CACHE_ENTRY   *entry;
+
+    if (session == NULL || session->numCached == 0 || targetAddressSize != 1 || numBytesRead > SMBUS_CACHE_MAX_BYTES)
+    {
+        return;
+    }
+    entry = SMBus_CacheFind(session, slaveAddress, targetAddress[0]);
+    if (entry == NULL)
+    {
+        return;
+    }
+
+    memcpy(entry->data, buffer, numBytesRead);
+    entry->length = (BYTE)numBytesRead;
+    entry->readTick = GetTickCount();
+    entry->valid = TRUE;
+}
+
+// A write to a register drops its cached value, the next read goes to the
+// slave and sees whatever the slave made of the write
+static void SMBus_CacheInvalidate(HID_SMBUS_DEVICE device, BYTE slaveAddress, BYTE reg)
+{
+    SMBUS_SESSION       *session = SMBus_FindSession(device);
+    SMBUS_CACHE_ENTRY   *entry;
+
+    if (session == NULL || session->numCached == 0)
+    {
+        return;
+    }
+    entry = SMBus_CacheFind(session, slaveAddress, reg);
+    if (entry != NULL)
+    {
+        entry->valid = FALSE;
+    }
+}
+
+// Forget the cached open state after a failed library call and recover
+static void SMBus_SessionError(HID_SMBUS_DEVICE device)
+{
+    SMBUS_SESSION *session = SMBus_FindSession(device);
+
+    if (session != NULL)
+    {
+        session->verified = FALSE;
+    }
+    SMBus_Fault(device, SMBUS_FAULT_ADAPTER);
+}
+
+// Latch calls usually come from a thread of their own next to the one
+// doing transfers, so a failed one only forces the next open check and
+// leaves cancelling and resetting to the transfer path
+static void SMBus_LatchError(HID_SMBUS_DEVICE device)
+{
+    SMBUS_SESSION *session = SMBus_FindSession(device);
+
+    if (session != NULL)
+    {
+        session->verified = FALSE;
+    }
+}
+
+// Library handle behind a handle from SMBus_Open. A reopen whose backoff
+// is over is attempted here, so the caller gets the new handle.
+static HID_SMBUS_DEVICE SMBus_Handle(HID_SMBUS_DEVICE device)
+{
+    SMBUS_SESSION *session = SMBus_FindSession(device);
+
+    if (session == NULL)
+    {
+        return device;
+    }
+    if (session->reopening && (LONG)(GetTickCount() - session->retryTick) >= 0)
+    {
+        EnterCriticalSection(&session->lock);
+        SMBus_Reopen(session);
+        LeaveCriticalSection(&session->lock);
+    }
+
+    return session->handle;
+}
+
+// Library handle for a latch or pin call, which may come from a thread of
+// its own while another one does transfers and recovery. The session lock
+// stays held until SMBus_LatchEnd, so the handle is not closed or replaced
+// meanwhile. No reopen is attempted here, that is left to the transfer
+// path. FALSE when the device is not opened.
+static BOOL SMBus_LatchBegin(HID_SMBUS_DEVICE *device, SMBUS_SESSION **session)
+{
+    *session = SMBus_FindSession(*device);
+    if (*session == NULL)
+    {
+        return SMBus_IsOpened(*device);
+    }
+
+    EnterCriticalSection(&(*session)->lock);
+    *device = (*session)->handle;
+
+    // Not reopening, so the open check cannot swap the handle either
+    return !(*session)->reopening && SMBus_IsOpened(*device);
+}
+
+static void SMBus_LatchEnd(SMBUS_SESSION *session)
+{
+    if (session != NULL)
+    {
+        LeaveCriticalSection(&session->lock);
+    }
+}
+
+BOOL SMBus_IsOpened(HID_SMBUS_DEVICE device)
+{
+    SMBUS_SESSION   *session;
+    BOOL            opened;
+
+    device = SMBus_Handle(device);
+    session = SMBus_FindSession(device);
+
+    // Fast path, state has been tracked since SMBus_Open
+    if (session != NULL && session->verified)
+    {
+        return session->opened;
+    }
+
+    // Unknown handle, or state invalidated by an I/O error
+    if (backend->IsOpened(device, &opened) != HID_SMBUS_SUCCESS)
+    {
+        opened = FALSE;
+    }
+    if (session != NULL)
+    {
+        session->opened = opened;
+        session->verified = TRUE;
+    }
+
+    return opened;
+}
+
+// Open by enumeration index and start tracking the handle
+static INT SMBus_OpenIndex(HID_SMBUS_DEVICE *device, DWORD deviceNum)
+{
+    HID_SMBUS_STATUS    status;
+    HID_SMBUS_DEVICE    handle;
+    SMBUS_SESSION       *session;
+
+    // Attempt open
+    status = backend->Open(&handle, deviceNum, VID, PID);
+    // Check status
+    if(status != HID_SMBUS_SUCCESS)
+    {
+        return -1;
+    }
+    session = SMBus_AddSession(handle);
+    *device = (session != NULL) ? (HID_SMBUS_DEVICE)session : handle;
+
+    // Success
+    return 0;
+}
+
+static void SMBus_EnumLock(void)
+{
+    LONG self = (LONG)GetCurrentThreadId();
+
+    if (enumLock == self)
+    {
+        enumDepth++;
+        return;
+    }
+    while (InterlockedCompareExchange(&enumLock, self, 0) != 0)
+    {
+        Sleep(0);
+    }
+    enumDepth = 1;
+}
+
+static void SMBus_EnumUnlock(void)
+{
+    if (--enumDepth == 0)
+    {
+        InterlockedExchange(&enumLock, 0);
+    }
+}
+
+// Rebuild the enumeration cache when the device count has changed.
+// Entries are matched by path, so only devices not seen before cost a
+// serial string query.
+static INT SMBus_UpdateDevices(BOOL force)
+{
+    SMBUS_DEVICE_ENTRY  previous[SMBUS_MAX_DEVICES];
+    DWORD               numPrevious = numCachedDevices;
+    DWORD               numDevices;
+
+    // Enumerate devices
+    if(backend->GetNumDevices(&numDevices, VID, PID) != HID_SMBUS_SUCCESS)
+    {
+        return -1;
+    }
+    if (numDevices > SMBUS_MAX_DEVICES)
+    {
+        numDevices = SMBUS_MAX_DEVICES;
+    }
+
+    // Same count, assume the same devices at the same indices
+    if (cacheValid && !force && numDevices == numCachedDevices)
+    {
+        return (INT)numDevices;
+    }
+
+    memcpy(previous, deviceCache, numPrevious * sizeof(SMBUS_DEVICE_ENTRY));
+    for (DWORD i = 0; i < numDevices; i++)
+    {
+        SMBUS_DEVICE_ENTRY  *entry = &deviceCache[i];
+        DWORD               j;
+
+        entry->valid = FALSE;
+        if(backend->GetString(i, VID, PID, entry->path, HID_SMBUS_GET_PATH_STR) != HID_SMBUS_SUCCESS)
+        {
+            continue;
+        }
+
+        // Reuse the serial of a device that only moved to another index
+        for (j = 0; j < numPrevious; j++)
+        {
+            if (previous[j].valid && strcmp(previous[j].path, entry->path) == 0)
+            {
+                strcpy(entry->serial, previous[j].serial);
+                entry->valid = TRUE;
+                break;
+            }
+        }
+        if (j == numPrevious &&
+            backend->GetString(i, VID, PID, entry->serial, HID_SMBUS_GET_SERIAL_STR) == HID_SMBUS_SUCCESS)
+        {
+            entry->valid = TRUE;
+        }
+    }
+    numCachedDevices = numDevices;
+    cacheValid = TRUE;
+
+    return (INT)numDevices;
+}
+
+static INT SMBus_FindSerial(const char *serial)
+{
+    for (DWORD i = 0; i < numCachedDevices; i++)
+    {
+        if (deviceCache[i].valid && strcmp(deviceCache[i].serial, serial) == 0)
+        {
+            return (INT)i;
+        }
+    }
+
+    return -1;
+}
+
+INT SMBus_RefreshDevices(BOOL force)
+{
+    INT result;
+
+    SMBus_EnumLock();
+    result = SMBus_UpdateDevices(force);
+    SMBus_EnumUnlock();
+
+    return result;
+}
+
+// The lookups and opens below run their ...Locked body with enumLock held
+static INT SMBus_LookupSerialLocked(const char *serial, DWORD *deviceNum, char *path)
+{
+    INT index;
+
+    // Refresh if the device count changed
+    if (SMBus_UpdateDevices(FALSE) < 0)
+    {
+        return -1;
+    }
+    index = SMBus_FindSerial(serial);
+    // Device not found
+    if (index < 0)
+    {
+        return -1;
+    }
+
+    *deviceNum = (DWORD)index;
+    if (path != NULL)
+    {
+        strcpy(path, deviceCache[index].path);
+    }
+    return 0;
+}
+
+INT SMBus_LookupSerial(const char *serial, DWORD *deviceNum, char *path)
+{
+    INT result;
+
+    SMBus_EnumLock();
+    result = SMBus_LookupSerialLocked(serial, deviceNum, path);
+    SMBus_EnumUnlock();
+
+    return result;
+}
+
+static INT SMBus_OpenLocked(HID_SMBUS_DEVICE *device)
+{
+    // Search for device
+    if (SMBus_UpdateDevices(FALSE) < 0)
+    {
+        return -1;
+    }
+    for (DWORD i = 0; i < numCachedDevices; i++)
+    {
+        if (deviceCache[i].valid)
+        {
+            return SMBus_OpenBySerial(device, deviceCache[i].serial);
+        }
+    }
+
+    // Device not found
+    return -1;
+}
+
 INT SMBus_Open(HID_SMBUS_DEVICE *device)
 {
-    INT                     deviceNum = -1;
-    DWORD                   numDevices;
-    HID_SMBUS_DEVICE_STR    deviceString;
-    HID_SMBUS_STATUS        status;
+    INT result;
+
+    SMBus_EnumLock();
+    result = SMBus_OpenLocked(device);
+    SMBus_EnumUnlock();
+
+    return result;
+}
+
+static INT SMBus_GetSerialsLocked(HID_SMBUS_DEVICE_STR *serials, INT maxSerials)
+{
+    INT count = 0;
+
+    // Enumerate devices
+    if (SMBus_UpdateDevices(FALSE) < 0)
+    {
+        return -1;
+    }
+
+    // Devices without a readable serial cannot be reopened by it, skip them
+    for (DWORD i = 0; i < numCachedDevices && count < maxSerials; i++)
+    {
+        if (deviceCache[i].valid)
+        {
+            strcpy(serials[count++], deviceCache[i].serial);
+        }
+    }
+
+    return count;
+}
+
+INT SMBus_GetSerials(HID_SMBUS_DEVICE_STR *serials, INT maxSerials)
+{
+    INT result;
+
+    SMBus_EnumLock();
+    result = SMBus_GetSerialsLocked(serials, maxSerials);
+    SMBus_EnumUnlock();
+
+    return result;
+}
+
+static INT SMBus_OpenBySerialLocked(HID_SMBUS_DEVICE *device, const char *serial)
+{
+    HID_SMBUS_DEVICE_STR    openedSerial;
+    DWORD                   deviceNum;
+    SMBUS_SESSION           *session;
+
+    // Two passes, the second after a full rescan in case devices were
+    // swapped without the count changing
+    for (INT pass = 0; pass < 2; pass++)
+    {
+        if (pass > 0 && SMBus_UpdateDevices(TRUE) < 0)
+        {
+            return -1;
+        }
+        if (SMBus_LookupSerialLocked(serial, &deviceNum, NULL) != 0)
+        {
+            continue;
+        }
+        if (SMBus_OpenIndex(device, deviceNum) != 0)
+        {
+            continue;
+        }
+
+        // The index may be stale, confirm it is the adapter asked for
+        if (backend->GetOpenedString(SMBus_Handle(*device), openedSerial, HID_SMBUS_GET_SERIAL_STR) == HID_SMBUS_SUCCESS &&
+            strcmp(openedSerial, serial) == 0)
+        {
+            session = SMBus_FindSession(*device);
+            if (session != NULL)
+            {
+                strcpy(session->serial, serial);
+            }
+            return 0;
+        }
+        SMBus_Close(*device);
+    }
+
+    // Device not found
+    return -1;
+}
+
+INT SMBus_OpenBySerial(HID_SMBUS_DEVICE *device, const char *serial)
+{
+    INT result;
+
+    SMBus_EnumLock();
+    result = SMBus_OpenBySerialLocked(device, serial);
+    SMBus_EnumUnlock();
+
+    return result;
+}
+
+static INT SMBus_OpenCachedLocked(HID_SMBUS_DEVICE *device, const char *serial, DWORD *deviceNum)
+{
+    HID_SMBUS_DEVICE_STR    openedSerial;
+    SMBUS_SESSION           *session;
+
+    // Straight to the index it had, enumeration costs two string queries per adapter
+    if (SMBus_OpenIndex(device, *deviceNum) == 0)
+    {
+        if (backend->GetOpenedString(SMBus_Handle(*device), openedSerial, HID_SMBUS_GET_SERIAL_STR) == HID_SMBUS_SUCCESS &&
+            strcmp(openedSerial, serial) == 0)
+        {
+            session = SMBus_FindSession(*device);
+            if (session != NULL)
+            {
+                strcpy(session->serial, serial);
+            }
+            return 0;
+        }
+        SMBus_Close(*device);
+    }
+
+    // Moved or replaced since, search for it
+    if (SMBus_OpenBySerialLocked(device, serial) != 0)
+    {
+        return -1;
+    }
+    SMBus_LookupSerialLocked(serial, deviceNum, NULL);
+
+    return 0;
+}
+
+INT SMBus_OpenCached(HID_SMBUS_DEVICE *device, const char *serial, DWORD *deviceNum)
+{
+    INT result;
+
+    SMBus_EnumLock();
+    result = SMBus_OpenCachedLocked(device, serial, deviceNum);
+    SMBus_EnumUnlock();
+
+    return result;
+}
+
+INT SMBus_Close(HID_SMBUS_DEVICE device)
+{
+    HID_SMBUS_STATUS status;
+    SMBUS_SESSION    *session = SMBus_FindSession(device);
+
+    // Stop tracking the handle, it is invalid whatever the outcome
+    if (session != NULL)
+    {
+        session->inUse = FALSE;
+        DeleteCriticalSection(&session->lock);
+        device = session->handle;
+        // Recovery already closed it and has not opened it again
+        if (session->reopening)
+        {
+            return 0;
+        }
+    }
+
+    // Attempt close
+    status = backend->Close(device);
+    // Check status
+    if(status != HID_SMBUS_SUCCESS)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+INT SMBus_Reset(HID_SMBUS_DEVICE device)
+{
+    HID_SMBUS_STATUS    status;
+
+    device = SMBus_Handle(device);
+    // Make sure that the device is opened
+    if(SMBus_IsOpened(device))
+    {
+        // Attempt reset
+        status = backend->Reset(device);
+        // Check status
+        if(status != HID_SMBUS_SUCCESS)
+        {
+            SMBus_SessionError(device);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+INT SMBus_Configure(HID_SMBUS_DEVICE device, DWORD bitRate, BYTE address, BOOL autoReadRespond, WORD writeTimeout, WORD readTimeout, BOOL sclLowTimeout, WORD transferRetries, DWORD responseTimeout)
+{
+    HID_SMBUS_STATUS    status;
+    SMBUS_SESSION       *session = SMBus_FindSession(device);
+    SMBUS_BUS_CONFIG    config = { bitRate, address, autoReadRespond, writeTimeout, readTimeout, sclLowTimeout, transferRetries, responseTimeout };
+
+    // Remembered even if it fails, recovery applies it on the next reopen
+    if (session != NULL)
+    {
+        session->config = config;
+        session->configured = TRUE;
+    }
+
+    device = SMBus_Handle(device);
+    // Make sure that the device is opened
+    if(SMBus_IsOpened(device))
+    {
+        // Attempt configuration
+        status =  backend->SetSmbusConfig(device, bitRate, address, autoReadRespond, writeTimeout, readTimeout, sclLowTimeout, transferRetries);
+        // Check status
+        if(status != HID_SMBUS_SUCCESS)
+        {
+            SMBus_SessionError(device);
+            return -1;
+        }
+
+        // Set response timeout
+        status = backend->SetTimeouts(device, responseTimeout);
+        // Check status
+        if(status != HID_SMBUS_SUCCESS)
+        {
+            SMBus_SessionError(device);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+INT SMBus_ConfigureIfChanged(HID_SMBUS_DEVICE device, const SMBUS_BUS_CONFIG *config)
+{
+    SMBUS_SESSION       *session = SMBus_FindSession(device);
+    SMBUS_BUS_CONFIG    current;
+    INT                 numWritten = 0;
+
+    // Remembered even if it fails, recovery applies it on the next reopen
+    if (session != NULL)
+    {
+        session->config = *config;
+        session->configured = TRUE;
+    }
+
+    device = SMBus_Handle(device);
+    // Make sure that the device is opened
+    if(!SMBus_IsOpened(device))
+    {
+        return 0;
+    }
+
+    // A setting that cannot be read back is written
+    if (backend->GetSmbusConfig(device, &current.bitRate, &current.address, &current.autoReadRespond, &current.writeTimeout,
+            &current.readTimeout, &current.sclLowTimeout, &current.transferRetries) != HID_SMBUS_SUCCESS ||
+        current.bitRate != config->bitRate || current.address != config->address ||
+        !current.autoReadRespond != !config->autoReadRespond || current.writeTimeout != config->writeTimeout ||
+        current.readTimeout != config->readTimeout || !current.sclLowTimeout != !config->sclLowTimeout ||
+        current.transferRetries != config->transferRetries)
+    {
+        if (backend->SetSmbusConfig(device, config->bitRate, config->address, config->autoReadRespond, config->writeTimeout,
+                config->readTimeout, config->sclLowTimeout, config->transferRetries) != HID_SMBUS_SUCCESS)
+        {
+            SMBus_SessionError(device);
+            return -1;
+        }
+        numWritten++;
+    }
+
+    if (backend->GetTimeouts(device, &current.responseTimeout) != HID_SMBUS_SUCCESS ||
+        current.responseTimeout != config->responseTimeout)
+    {
+        if (backend->SetTimeouts(device, config->responseTimeout) != HID_SMBUS_SUCCESS)
+        {
+            SMBus_SessionError(device);
+            return -1;
+        }
+        numWritten++;
+    }
+
+    return numWritten;
+}
+
+INT SMBus_SetGpioConfig(HID_SMBUS_DEVICE device, BYTE direction, BYTE mode, BYTE function, BYTE clkDiv)
+{
+    HID_SMBUS_STATUS    status;
+    SMBUS_SESSION       *session;
+    SMBUS_GPIO_CONFIG   config = { direction, mode, function, clkDiv };
+    INT                 result = 0;
+    BOOL                opened = SMBus_LatchBegin(&device, &session);
+
+    // Remembered even if it fails, recovery applies it on the next reopen
+    if (session != NULL)
+    {
+        session->gpio = config;
+        session->gpioConfigured = TRUE;
+    }
+
+    // Make sure that the device is opened
+    if(opened)
+    {
+        // Attempt pin configuration
+        status = backend->SetGpioConfig(device, direction, mode, function, clkDiv);
+        // Check status
+        if(status != HID_SMBUS_SUCCESS)
+        {
+            SMBus_LatchError(device);
+            result = -1;
+        }
+    }
+    SMBus_LatchEnd(session);
+
+    return result;
+}
+
+INT SMBus_GetGpioConfig(HID_SMBUS_DEVICE device, BYTE *direction, BYTE *mode, BYTE *function, BYTE *clkDiv)
+{
+    HID_SMBUS_STATUS    status;
+    SMBUS_SESSION       *session;
+    INT                 result = -1;
+
+    // Make sure that the device is opened
+    if(SMBus_LatchBegin(&device, &session))
+    {
+        // Read pin configuration
+        status = backend->GetGpioConfig(device, direction, mode, function, clkDiv);
+        // Check status
+        if(status != HID_SMBUS_SUCCESS)
+        {
+            SMBus_LatchError(device);
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+    SMBus_LatchEnd(session);
+
+    return result;
+}
+
+INT SMBus_ReadLatch(HID_SMBUS_DEVICE device, BYTE *latchValue)
+{
+    HID_SMBUS_STATUS    status;
+    SMBUS_SESSION       *session;
+    INT                 result = -1;
+
+    // Make sure that the device is opened
+    if(SMBus_LatchBegin(&device, &session))
+    {
+        // Read all eight pins at once
+        status = backend->ReadLatch(device, latchValue);
+        // Check status
+        if(status != HID_SMBUS_SUCCESS)
+        {
+            SMBus_LatchError(device);
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+    SMBus_LatchEnd(session);
+
+    return result;
+}
+
+INT SMBus_WriteLatch(HID_SMBUS_DEVICE device, BYTE latchValue, BYTE latchMask)
+{
+    HID_SMBUS_STATUS    status;
+    SMBUS_SESSION       *session;
+    INT                 result = -1;
+
+    // Make sure that the device is opened
+    if(SMBus_LatchBegin(&device, &session))
+    {
+        // Drive the pins in latchMask, the others keep their state
+        status = backend->WriteLatch(device, latchValue, latchMask);
+        // Check status
+        if(status != HID_SMBUS_SUCCESS)
+        {
+            SMBus_LatchError(device);
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+    SMBus_LatchEnd(session);
+
+    return result;
+}
+
+// Perform one address read on a device that is known to be opened.
+// Whole response reports are read straight into the caller buffer; only
+// a final report shorter than HID_SMBUS_MAX_READ_RESPONSE_SIZE goes
+// through a bounce buffer, as the library needs room for a full report.
+// With timeoutMs the transfer is polled to completion first and cancelled
+// once the time is up. Otherwise GetReadResponse waits for the data, up to
+// the response timeout set by SMBus_Configure.
+static INT SMBus_ReadStages(HID_SMBUS_DEVICE device, BYTE *buffer, BYTE slaveAddress, WORD numBytesToRead, BYTE targetAddressSize, BYTE *targetAddress, SMBUS_PROGRESS_CALLBACK progress, void *context, SMBTIMING_ENTRY *timing, DWORD timeoutMs)
+{
+    HID_SMBUS_STATUS    status;
+    HID_SMBUS_S0        status0;
+    BYTE                numBytesRead = 0;
+    WORD                totalNumBytesRead = 0;
+    BYTE                _buffer[HID_SMBUS_MAX_READ_RESPONSE_SIZE];
+    BOOL                direct;
+    LONGLONG            time = SMBTiming_Start(timing);
+
+    // Issue a read request
+    status = backend->AddressReadRequest(device, slaveAddress, numBytesToRead, targetAddressSize, targetAddress);
+    time = SMBTiming_Stop(timing, SMBTIMING_READ_REQUEST, time);
+    // Check status
+    if(status != HID_SMBUS_SUCCESS)
+    {
+        SMBus_SessionError(device);
+        return -1;
+    }
+
+    // Poll transfer status so a slave that never answers costs no more
+    // than the caller allowed
+    if (timeoutMs != 0)
+    {
+        if (SMBus_WaitTransfer(device, timing, timeoutMs) != 0)
+        {
+            return -1;
+        }
+        time = SMBTiming_Start(timing);
+    }
+
+    // Notify device that it should send a read response back
+    status = backend->ForceReadResponse(device, numBytesToRead);
+    time = SMBTiming_Stop(timing, SMBTIMING_FORCE_RESPONSE, time);
+    // Check status
+    if (status != HID_SMBUS_SUCCESS)
+    {
+        SMBus_SessionError(device);
+        return -1;
+    }
+
+    // Wait for a read response
+    do
+    {
+        direct = (numBytesToRead - totalNumBytesRead >= HID_SMBUS_MAX_READ_RESPONSE_SIZE);
+        status = backend->GetReadResponse(device, &status0, direct ? &buffer[totalNumBytesRead] : _buffer, HID_SMBUS_MAX_READ_RESPONSE_SIZE, &numBytesRead);
+        time = SMBTiming_Stop(timing, SMBTIMING_READ_RESPONSE, time);
+        // Check status
+        if (status != HID_SMBUS_SUCCESS)
+        {
+            SMBus_SessionError(device);
+            return -1;
+        }
+        if (status0 == HID_SMBUS_S0_ERROR)
+        {
+            SMBus_Fault(device, SMBus_QueryFault(device));
+            return -1;
+        }
+        if (numBytesRead > numBytesToRead - totalNumBytesRead)
+        {
+            numBytesRead = (BYTE)(numBytesToRead - totalNumBytesRead);
+        }
+        if (!direct)
+        {
+            memcpy(&buffer[totalNumBytesRead], _buffer, numBytesRead);
+        }
+        totalNumBytesRead += numBytesRead;
+
+        // Report partial progress
+        if (progress != NULL)
+        {
+            progress(totalNumBytesRead, numBytesToRead, context);
+        }
+    } while (totalNumBytesRead < numBytesToRead);
+
+    // Success
+    return totalNumBytesRead;
+}
+
+// Read with one more byte for the PEC and check it. A mismatch is noise
+// on the wire, not a slave or adapter fault, so only the read is repeated.
+static INT SMBus_ReadPec(HID_SMBUS_DEVICE device, SMBUS_SLAVE_STATE *slave, BYTE *buffer, BYTE slaveAddress, WORD numBytesToRead, BYTE targetAddressSize, BYTE *targetAddress, SMBUS_PROGRESS_CALLBACK progress, void *context, SMBTIMING_ENTRY *timing, DWORD timeoutMs)
+{
+    BYTE    block[HID_SMBUS_MAX_READ_REQUEST_SIZE];
+    BYTE    readAddress = slaveAddress | 0x01;
+    BYTE    pec;
+
+    if (numBytesToRead >= HID_SMBUS_MAX_READ_REQUEST_SIZE)
+    {
+        return -1;
+    }
+
+    // Write address and command, then the read address after the repeated start
+    pec = SMBPec_Update(0, &slaveAddress, 1);
+    pec = SMBPec_Update(pec, targetAddress, targetAddressSize);
+    pec = SMBPec_Update(pec, &readAddress, 1);
+
+    for (INT attempt = 0; ; attempt++)
+    {
+        if (SMBus_ReadStages(device, block, slaveAddress, numBytesToRead + 1, targetAddressSize, targetAddress, NULL, NULL, timing, timeoutMs) < 0)
+        {
+            return -1;
+        }
+        if (SMBPec_Update(pec, block, numBytesToRead) == block[numBytesToRead])
+        {
+            break;
+        }
+        slave->pecErrors++;
+        if (attempt >= SMBUS_PEC_RETRIES)
+        {
+            return -1;
+        }
+    }
+
+    memcpy(buffer, block, numBytesToRead);
+    if (progress != NULL)
+    {
+        progress(numBytesToRead, numBytesToRead, context);
+    }
+    return numBytesToRead;
+}
+
+// One read on the bus, with timing, fault and breaker bookkeeping
+static INT SMBus_BusRead(HID_SMBUS_DEVICE device, BYTE *buffer, BYTE slaveAddress, WORD numBytesToRead, BYTE targetAddressSize, BYTE *targetAddress, SMBUS_PROGRESS_CALLBACK progress, void *context, DWORD timeoutMs)
+{
+    SMBTIMING_ENTRY     *timing = SMBTiming_Entry(slaveAddress, (targetAddressSize > 0) ? targetAddress[0] : 0);
+    SMBUS_SESSION       *session = SMBus_FindSession(device);
+    SMBUS_SLAVE_STATE   *slave = (session != NULL) ? &session->slaves[slaveAddress >> 1] : NULL;
+    HID_SMBUS_DEVICE    owner = (session != NULL) ? (HID_SMBUS_DEVICE)session : device;
+    LONGLONG            start;
+    INT                 result;
+
+    // A quarantined slave costs no bus time
+    if (!SMBus_SlaveReady(device, slaveAddress))
+    {
+        return -1;
+    }
+
+    start = SMBTiming_Start(timing);
+    if (slave != NULL && slave->caps.pec)
+    {
+        result = SMBus_ReadPec(device, slave, buffer, slaveAddress, numBytesToRead, targetAddressSize, targetAddress, progress, context, timing, timeoutMs);
+    }
+    else
+    {
+        result = SMBus_ReadStages(device, buffer, slaveAddress, numBytesToRead, targetAddressSize, targetAddress, progress, context, timing, timeoutMs);
+    }
+    if (result < 0)
+    {
+        SMBTiming_Error(timing);
+    }
+    else
+    {
+        SMBTiming_Stop(timing, SMBTIMING_READ_TOTAL, start);
+        SMBus_Healthy(owner);
+    }
+
+    // Recovery may have replaced the library handle on the way, the
+    // bookkeeping goes to the session it was opened for
+    SMBus_SlaveDone(owner, slaveAddress, result >= 0);
+    SMBus_TuneDone(owner, TRUE, result >= 0);
+
+    return result;
+}
+
+static INT SMBus_ReadTransfer(HID_SMBUS_DEVICE device, BYTE *buffer, BYTE slaveAddress, WORD numBytesToRead, BYTE targetAddressSize, BYTE *targetAddress, SMBUS_PROGRESS_CALLBACK progress, void *context, DWORD timeoutMs)
+{
+    INT result;
+
+    // Registers with a TTL are read again only once it has run out
+    if (SMBus_CacheGet(device, buffer, slaveAddress, numBytesToRead, targetAddressSize, targetAddress))
+    {
+        if (progress != NULL)
+        {
+            progress(numBytesToRead, numBytesToRead, context);
+        }
+        return numBytesToRead;
+    }
+
+    result = SMBus_BusRead(device, buffer, slaveAddress, numBytesToRead, targetAddressSize, targetAddress, progress, context, timeoutMs);
+    if (result >= 0)
+    {
+        SMBus_CachePut(device, buffer, slaveAddress, (WORD)result, targetAddressSize, targetAddress);
+    }
+
+    return result;
+}
+
+// Caps of the slave a descriptor reads from, NULL when its reads may not
+// be merged with others
+static const SMBUS_SLAVE_CAPS *SMBus_MergeCaps(HID_SMBUS_DEVICE device, const SMBUS_READ_DESC *read)
+{
+    SMBUS_SESSION *session = SMBus_FindSession(device);
+
+    if (session == NULL || read->targetAddressSize != 1 || !session->slaves[read->slaveAddress >> 1].caps.autoIncrement)
+    {
+        return NULL;
+    }
+
+    return &session->slaves[read->slaveAddress >> 1].caps;
+}
+
+// Read reads[first] together with every waiting descriptor for the same
+// slave whose registers lie within maxGap of the range gathered so far,
+// as one block read, and scatter the block back into the descriptors
+static void SMBus_MergedRead(HID_SMBUS_DEVICE device, SMBUS_READ_DESC *reads, WORD numReads, WORD first, const SMBUS_SLAVE_CAPS *caps)
+{
+    BYTE    block[HID_SMBUS_MAX_READ_REQUEST_SIZE];
+    BYTE    targetAddress[HID_SMBUS_MAX_TARGET_ADDRESS_SIZE];
+    DWORD   step = (caps->bytesPerRegister != 0) ? caps->bytesPerRegister : 1;
+    DWORD   gap = caps->maxGap * step;
+    DWORD   lo = reads[first].targetAddress[0] * step;
+    DWORD   hi = lo + reads[first].numBytesToRead;
+    BOOL    grown = TRUE;
+    INT     result;
+
+    // Grow the byte range [lo, hi) until no waiting descriptor fits
+    reads[first].result = SMBUS_RESULT_MERGED;
+    while (grown)
+    {
+        grown = FALSE;
+        for (WORD i = first + 1; i < numReads; i++)
+        {
+            DWORD start = reads[i].targetAddress[0] * step;
+            DWORD end = start + reads[i].numBytesToRead;
+            DWORD newLo = (start < lo) ? start : lo;
+            DWORD newHi = (end > hi) ? end : hi;
+
+            if (reads[i].result != SMBUS_RESULT_PENDING || reads[i].slaveAddress != reads[first].slaveAddress ||
+                reads[i].targetAddressSize != 1 || start > hi + gap || end + gap < lo ||
+                newHi - newLo > HID_SMBUS_MAX_READ_REQUEST_SIZE)
+            {
+                continue;
+            }
+            reads[i].result = SMBUS_RESULT_MERGED;
+            lo = newLo;
+            hi = newHi;
+            grown = TRUE;
+        }
+    }
+
+    targetAddress[0] = (BYTE)(lo / step);
+    result = SMBus_BusRead(device, block, reads[first].slaveAddress, (WORD)(hi - lo), 1, targetAddress, NULL, NULL, 0);
+
+    for (WORD i = first; i < numReads; i++)
+    {
+        if (reads[i].result != SMBUS_RESULT_MERGED)
+        {
+            continue;
+        }
+        if (result < 0)
+        {
+            reads[i].result = -1;
+            continue;
+        }
+        memcpy(reads[i].buffer, &block[reads[i].targetAddress[0] * step - lo], reads[i].numBytesToRead);
+        reads[i].result = reads[i].numBytesToRead;
+        SMBus_CachePut(device, reads[i].buffer, reads[i].slaveAddress, reads[i].numBytesToRead, 1, reads[i].targetAddress);
+    }
+}
+
+INT SMBus_Read(HID_SMBUS_DEVICE device, BYTE *buffer, BYTE slaveAddress, WORD numBytesToRead, BYTE targetAddressSize, BYTE *targetAddress)
+{
+    device = SMBus_Handle(device);
+    // Make sure that the device is opened
+    if(SMBus_IsOpened(device))
+    {
+        return SMBus_ReadTransfer(device, buffer, slaveAddress, numBytesToRead, targetAddressSize, targetAddress, NULL, NULL, 0);
+    }
+
+    return -1;
+}
+
+INT SMBus_ReadBlock(HID_SMBUS_DEVICE device, BYTE *buffer, BYTE slaveAddress, WORD numBytesToRead, BYTE targetAddressSize, BYTE *targetAddress, SMBUS_PROGRESS_CALLBACK progress, void *context)
+{
+    // A single address read request is limited by the device
+    if (numBytesToRead < HID_SMBUS_MIN_READ_REQUEST_SIZE || numBytesToRead > HID_SMBUS_MAX_READ_REQUEST_SIZE)
+    {
+        return -1;
+    }
+    device = SMBus_Handle(device);
+
+    // Make sure that the device is opened
+    if(SMBus_IsOpened(device))
+    {
+        return SMBus_ReadTransfer(device, buffer, slaveAddress, numBytesToRead, targetAddressSize, targetAddress, progress, context, 0);
+    }
+
+    return -1;
+}
+
+INT SMBus_ReadTimeout(HID_SMBUS_DEVICE device, BYTE *buffer, BYTE slaveAddress, WORD numBytesToRead, BYTE targetAddressSize, BYTE *targetAddress, DWORD timeoutMs)
+{
+    if (numBytesToRead < HID_SMBUS_MIN_READ_REQUEST_SIZE || numBytesToRead > HID_SMBUS_MAX_READ_REQUEST_SIZE || timeoutMs == 0)
+    {
+        return -1;
+    }
+    device = SMBus_Handle(device);
+
+    // Make sure that the device is opened
+    if(SMBus_IsOpened(device))
+    {
+        return SMBus_ReadTransfer(device, buffer, slaveAddress, numBytesToRead, targetAddressSize, targetAddress, NULL, NULL, timeoutMs);
+    }
+
+    return -1;
+}
+
+INT SMBus_ReadBatch(HID_SMBUS_DEVICE device, SMBUS_READ_DESC *reads, WORD numReads)
+{
+    INT                 numSucceeded = 0;
+    HID_SMBUS_DEVICE    handle;
+
+    // Make sure that the device is opened, once for the whole batch.
+    // Callers read the results whatever the return value.
+    if(!SMBus_IsOpened(device))
+    {
+        for (WORD i = 0; i < numReads; i++)
+        {
+            reads[i].result = -1;
+        }
+        return -1;
+    }
+
+    for (WORD i = 0; i < numReads; i++)
+    {
+        reads[i].result = SMBUS_RESULT_PENDING;
+    }
+
+    // Issue each transfer back to back; the CP2112 runs one SMBus
+    // transfer at a time, so the next request goes out as soon as the
+    // previous read response has been drained
+    for (WORD i = 0; i < numReads; i++)
+    {
+        const SMBUS_SLAVE_CAPS *caps;
+
+        // Already read as part of a merged read
+        if (reads[i].result != SMBUS_RESULT_PENDING)
+        {
+            continue;
+        }
+
+        // Recovery may have replaced the handle part way through, the
+        // rest of the batch fails at once while it is reopening
+        handle = SMBus_Handle(device);
+        if (!SMBus_IsOpened(handle))
+        {
+            reads[i].result = -1;
+            continue;
+        }
+
+        // Slaves that auto-increment get neighbouring registers in one read
+        caps = SMBus_MergeCaps(handle, &reads[i]);
+        if (caps != NULL && reads[i].numBytesToRead <= HID_SMBUS_MAX_READ_REQUEST_SIZE &&
+            !SMBus_CacheGet(handle, reads[i].buffer, reads[i].slaveAddress, reads[i].numBytesToRead, 1, reads[i].targetAddress))
+        {
+            SMBus_MergedRead(handle, reads, numReads, i, caps);
+        }
+        else if (caps != NULL && reads[i].numBytesToRead <= HID_SMBUS_MAX_READ_REQUEST_SIZE)
+        {
+            reads[i].result = reads[i].numBytesToRead;
+        }
+        else
+        {
+            reads[i].result = SMBus_ReadTransfer(handle, reads[i].buffer, reads[i].slaveAddress, reads[i].numBytesToRead, reads[i].targetAddressSize, reads[i].targetAddress, NULL, NULL, 0);
+        }
+    }
+
+    for (WORD i = 0; i < numReads; i++)
+    {
+        if (reads[i].result == reads[i].numBytesToRead)
+        {
+            numSucceeded++;
+        }
+    }
+
+    // Number of descriptors that returned all requested bytes
+    return numSucceeded;
+}
+
+void SMBus_SetBackend(const SMBUS_BACKEND *newBackend)
+{
+    // Handles and cached enumeration belong to the previous backend
+    for (INT i = 0; i < SMBUS_MAX_SESSIONS; i++)
+    {
+        if (sessions[i].inUse)
+        {
+            DeleteCriticalSection(&sessions[i].lock);
+        }
+    }
+    memset(sessions, 0, sizeof(sessions));
+    cacheValid = FALSE;
+    numCachedDevices = 0;
+    backend = newBackend;
+}
+
+const SMBUS_BACKEND *SMBus_GetBackend(void)
+{
+    return backend;
+}
 
-    // Search for device
-    if(HidSmbus_GetNumDevices(&numDevices, VID, PID) == HID_SMBUS_SUCCESS)
+void SMBus_SetPollConfig(const SMBUS_POLL_CONFIG *config)
+{
+    pollConfig = *config;
+}
+
+void SMBus_SetRecoveryConfig(const SMBUS_RECOVERY_CONFIG *config)
+{
+    recoveryConfig = *config;
+}
+
+INT SMBus_GetRecoveryStats(HID_SMBUS_DEVICE device, SMBUS_RECOVERY_STATS *stats)
+{
+    SMBUS_SESSION *session = SMBus_FindSession(device);
+
+    if (session == NULL)
+    {
+        return -1;
+    }
+
+    *stats = session->stats;
+    return 0;
+}
+
+INT SMBus_GetBusConfig(HID_SMBUS_DEVICE device, SMBUS_BUS_CONFIG *config)
+{
+    SMBUS_SESSION *session = SMBus_FindSession(device);
+
+    if (session == NULL || !session->configured)
+    {
+        return -1;
+    }
+
+    *config = session->config;
+    return 0;
+}
+
+INT SMBus_GetSerial(HID_SMBUS_DEVICE device, HID_SMBUS_DEVICE_STR serial)
+{
+    SMBUS_SESSION *session = SMBus_FindSession(device);
+
+    if (session == NULL || session->serial[0] == '\0')
+    {
+        return -1;
+    }
+
+    strcpy(serial, session->serial);
+    return 0;
+}
+
+INT SMBus_SetAutoTune(HID_SMBUS_DEVICE device, const SMBUS_TUNE_CONFIG *config)
+{
+    SMBUS_SESSION       *session = SMBus_FindSession(device);
+    SMBUS_TUNE_STATE    *tune;
+
+    if (session == NULL || (config != NULL && (!session->configured || config->windowTransfers == 0)))
+    {
+        return -1;
+    }
+
+    tune = &session->tune;
+    memset(tune, 0, sizeof(*tune));
+    if (config == NULL)
+    {
+        return 0;
+    }
+
+    // Steps within the bounds, starting from the rate configured
+    tune->lowest = -1;
+    tune->ceiling = -1;
+    for (INT i = 0; i < SMBUS_TUNE_RATES; i++)
     {
-        for (DWORD i = 0; i < numDevices; i++)
+        if (tuneBitRates[i] >= config->minBitRate && tuneBitRates[i] <= config->maxBitRate)
         {
-            if(HidSmbus_GetString(i, VID, PID, deviceString, HID_SMBUS_GET_SERIAL_STR) == HID_SMBUS_SUCCESS)
+            if (tune->lowest < 0)
             {
-                deviceNum = i;
-                break;
+                tune->lowest = i;
             }
+            tune->ceiling = i;
         }
     }
-
-    // Device not found
-    if(deviceNum == -1)
+    if (tune->lowest < 0)
     {
         return -1;
     }
-    // Device found
-    else
+    tune->rate = tune->lowest;
+    while (tune->rate < tune->ceiling && tuneBitRates[tune->rate + 1] <= session->config.bitRate)
     {
-        // Attempt open
-        status = HidSmbus_Open(device, deviceNum, VID, PID);
-        // Check status
-        if(status != HID_SMBUS_SUCCESS)
-        {
-            return -1;
-        }
+        tune->rate++;
     }
 
-    // Success
+    tune->config = *config;
+    tune->enabled = TRUE;
     return 0;
 }
 
-INT SMBus_Close(HID_SMBUS_DEVICE device)
+INT SMBus_GetTuneStats(HID_SMBUS_DEVICE device, SMBUS_TUNE_STATS *stats)
 {
-    HID_SMBUS_STATUS status;
+    SMBUS_SESSION *session = SMBus_FindSession(device);
 
-    // Attempt close
-    status = HidSmbus_Close(device);
-    // Check status
-    if(status != HID_SMBUS_SUCCESS)
+    if (session == NULL || !session->tune.enabled)
     {
         return -1;
     }
 
+    // With the window in progress, so short runs show something
+    *stats = session->tune.stats;
+    stats->transfers += session->tune.window.transfers;
+    stats->errors += session->tune.window.errors;
+    stats->timeouts += session->tune.window.timeouts;
+    stats->retries += session->tune.window.retries;
     return 0;
 }
 
-INT SMBus_Reset(HID_SMBUS_DEVICE device)
+void SMBus_SetBreakerConfig(const SMBUS_BREAKER_CONFIG *config)
 {
-    BOOL                opened;
-    HID_SMBUS_STATUS    status;
+    breakerConfig = *config;
+}
 
-    // Make sure that the device is opened
-    if(HidSmbus_IsOpened(device, &opened) == HID_SMBUS_SUCCESS && opened)
+INT SMBus_GetSlaveHealth(HID_SMBUS_DEVICE device, BYTE slaveAddress, SMBUS_SLAVE_HEALTH *health)
+{
+    SMBUS_SESSION       *session = SMBus_FindSession(device);
+    SMBUS_SLAVE_STATE   *slave;
+
+    if (session == NULL)
     {
-        // Attempt reset
-        status = HidSmbus_Reset(device);
-        // Check status
-        if(status != HID_SMBUS_SUCCESS)
-        {
-            return -1;
-        }
+        return -1;
     }
 
+    slave = &session->slaves[slaveAddress >> 1];
+    health->failures = slave->failures;
+    health->quarantined = slave->quarantined;
+    health->skipped = slave->skipped;
+    health->quarantines = slave->quarantines;
+    health->pecErrors = slave->pecErrors;
     return 0;
 }
 
-INT SMBus_Configure(HID_SMBUS_DEVICE device, DWORD bitRate, BYTE address, BOOL autoReadRespond, WORD writeTimeout, WORD readTimeout, BOOL sclLowTimeout, WORD transferRetries, DWORD responseTimeout)
+INT SMBus_SetRegisterTtl(HID_SMBUS_DEVICE device, BYTE slaveAddress, BYTE reg, DWORD ttlMs)
 {
-    BOOL                opened;
-    HID_SMBUS_STATUS    status;
+    SMBUS_SESSION       *session = SMBus_FindSession(device);
+    SMBUS_CACHE_ENTRY   *entry;
 
-    // Make sure that the device is opened
-    if(HidSmbus_IsOpened(device, &opened) == HID_SMBUS_SUCCESS && opened)
+    if (session == NULL)
     {
-        // Attempt configuration
-        status =  HidSmbus_SetSmbusConfig(device, bitRate, address, autoReadRespond, writeTimeout, readTimeout, sclLowTimeout, transferRetries);
-        // Check status
-        if(status != HID_SMBUS_SUCCESS)
+        return -1;
+    }
+    entry = SMBus_CacheFind(session, slaveAddress, reg);
+
+    // Volatile registers are not kept, move the last entry into the gap
+    if (ttlMs == SMBUS_TTL_VOLATILE)
+    {
+        if (entry != NULL)
         {
-            return -1;
+            *entry = session->cache[--session->numCached];
         }
+        return 0;
+    }
 
-        // Set response timeout
-        status = HidSmbus_SetTimeouts(device, responseTimeout);
-        // Check status
-        if(status != HID_SMBUS_SUCCESS)
+    if (entry == NULL)
+    {
+        if (session->numCached >= SMBUS_CACHE_SIZE)
         {
             return -1;
         }
+        entry = &session->cache[session->numCached++];
+        entry->slaveAddress = slaveAddress;
+        entry->reg = reg;
+    }
+    entry->ttlMs = ttlMs;
+    entry->valid = FALSE;
+    return 0;
+}
+
+void SMBus_InvalidateCache(HID_SMBUS_DEVICE device, BYTE slaveAddress)
+{
+    SMBUS_SESSION *session = SMBus_FindSession(device);
+
+    if (session == NULL)
+    {
+        return;
+    }
+    for (DWORD i = 0; i < session->numCached; i++)
+    {
+        if (session->cache[i].slaveAddress == slaveAddress)
+        {
+            session->cache[i].valid = FALSE;
+        }
+    }
+}
+
+INT SMBus_SetSlaveCaps(HID_SMBUS_DEVICE device, BYTE slaveAddress, const SMBUS_SLAVE_CAPS *caps)
+{
+    SMBUS_SESSION *session = SMBus_FindSession(device);
+
+    if (session == NULL)
+    {
+        return -1;
     }
 
+    session->slaves[slaveAddress >> 1].caps = *caps;
     return 0;
 }
 
-INT SMBus_Read(HID_SMBUS_DEVICE device, BYTE *buffer, BYTE slaveAddress, WORD numBytesToRead, BYTE targetAddressSize, BYTE *targetAddress)
+INT SMBus_GetCacheStats(HID_SMBUS_DEVICE device, SMBUS_CACHE_STATS *stats)
+{
+    SMBUS_SESSION *session = SMBus_FindSession(device);
+
+    if (session == NULL)
+    {
+        return -1;
+    }
+
+    *stats = session->cacheStats;
+    return 0;
+}
+
+HID_SMBUS_DEVICE SMBus_GetHandle(HID_SMBUS_DEVICE device)
+{
+    return SMBus_Handle(device);
+}
+
+// Poll transfer status until the outstanding transfer completes, backing
+// off between polls instead of spinning on the USB bus
+static INT SMBus_WaitTransfer(HID_SMBUS_DEVICE device, SMBTIMING_ENTRY *timing, DWORD timeoutMs)
 {
-    BOOL                opened;
     HID_SMBUS_STATUS    status;
     HID_SMBUS_S0        status0;
     HID_SMBUS_S1        status1;
-    BYTE                numBytesRead = 0;
-    BYTE                totalNumBytesRead = 0;
     WORD                numRetries;
     WORD                bytesRead;
-    BYTE                _buffer[HID_SMBUS_MAX_READ_RESPONSE_SIZE];
+    DWORD               interval = pollConfig.pollIntervalMs;
+    DWORD               start = GetTickCount();
+    LONGLONG            time;
 
-    // Make sure that the device is opened
-    if(HidSmbus_IsOpened(device, &opened) == HID_SMBUS_SUCCESS && opened)
+    for (;;)
     {
-        // Issue a read request
-        status = HidSmbus_AddressReadRequest(device, slaveAddress, numBytesToRead, targetAddressSize, targetAddress);
+        time = SMBTiming_Start(timing);
+        // Issue transfer status request
+        status = backend->TransferStatusRequest(device);
         // Check status
-        if(status != HID_SMBUS_SUCCESS)
+        if (status != HID_SMBUS_SUCCESS)
         {
+            SMBus_SessionError(device);
             return -1;
         }
 
-        // // Issue transfer status request
-        // status = HidSmbus_TransferStatusRequest(device);
-        // // Check status
-        // if (status != HID_SMBUS_SUCCESS)
-        // {
-        //     return -1;
-        // }
-        // // Wait for transfer status response
-        // status = HidSmbus_GetTransferStatusResponse(device, &status0, &status1, &numRetries, &bytesRead);
-        // // Check status
-        // if (status != HID_SMBUS_SUCCESS)
-        // {
-        //     return -1;
-        // }
-
-        // Notify device that it should send a read response back
-        status = HidSmbus_ForceReadResponse(device, numBytesToRead);
+        // Wait for transfer status response
+        status = backend->GetTransferStatusResponse(device, &status0, &status1, &numRetries, &bytesRead);
         // Check status
         if (status != HID_SMBUS_SUCCESS)
         {
+            SMBus_SessionError(device);
             return -1;
         }
+        time = SMBTiming_Stop(timing, SMBTIMING_STATUS_POLL, time);
 
-        // Wait for a read response
-        do
+        if (status0 == HID_SMBUS_S0_COMPLETE)
         {
-            status = HidSmbus_GetReadResponse(device, &status0, _buffer, HID_SMBUS_MAX_READ_RESPONSE_SIZE, &numBytesRead);
-            // Check status
-            if (status != HID_SMBUS_SUCCESS)
-            {
-                return -1;
-            }
-            memcpy(&buffer[totalNumBytesRead], _buffer, numBytesRead);
-            totalNumBytesRead += numBytesRead;
-        } while (totalNumBytesRead < numBytesToRead);
+            SMBus_TuneStatus(device, status0, status1, numRetries);
+            return 0;
+        }
+        if (status0 == HID_SMBUS_S0_ERROR)
+        {
+            SMBus_TuneStatus(device, status0, status1, numRetries);
+            SMBus_Fault(device, SMBus_ErrorFault(status1));
+            return -1;
+        }
+        // No transfer to wait for, its status was collected already or a
+        // reopen dropped it. The adapter is fine, so this is no fault.
+        if (status0 == HID_SMBUS_S0_IDLE)
+        {
+            return -1;
+        }
+        // Still busy past the deadline, the transfer is stuck
+        if (GetTickCount() - start >= timeoutMs)
+        {
+            SMBus_TuneStatus(device, HID_SMBUS_S0_BUSY, status1, numRetries);
+            SMBus_Fault(device, SMBUS_FAULT_TRANSFER);
+            return -1;
+        }
+
+        // Still busy, back off before the next poll
+        Sleep(interval);
+        SMBTiming_Stop(timing, SMBTIMING_POLL_SLEEP, time);
+        interval = (interval == 0) ? 1 : interval * 2;
+        if (interval > pollConfig.maxPollIntervalMs)
+        {
+            interval = pollConfig.maxPollIntervalMs;
+        }
     }
-    else
+}
+
+// Issue a write request, timed against its command code
+static INT SMBus_StartWrite(HID_SMBUS_DEVICE device, BYTE *buffer, BYTE slaveAddress, BYTE numBytesToWrite, SMBUS_PENDING_WRITE *pending)
+{
+    HID_SMBUS_STATUS    status;
+    SMBUS_SESSION       *session = SMBus_FindSession(device);
+    HID_SMBUS_DEVICE    owner = (session != NULL) ? (HID_SMBUS_DEVICE)session : device;
+    BYTE                pecBuffer[HID_SMBUS_MAX_WRITE_REQUEST_SIZE];
+
+    // A quarantined slave costs no bus time
+    if (!SMBus_SlaveReady(device, slaveAddress))
     {
         return -1;
     }
 
-    // Success
-    return totalNumBytesRead;
+    pending->timing = SMBTiming_Entry(slaveAddress, (numBytesToWrite > 0) ? buffer[0] : 0);
+    pending->start = SMBTiming_Start(pending->timing);
+    pending->slaveAddress = slaveAddress;
+    if (numBytesToWrite > 0)
+    {
+        SMBus_CacheInvalidate(device, slaveAddress, buffer[0]);
+    }
+
+    // The PEC goes out as one more data byte. A slave that finds it wrong
+    // NACKs it, which fails the write like any other NACK.
+    if (session != NULL && session->slaves[slaveAddress >> 1].caps.pec)
+    {
+        if (numBytesToWrite >= HID_SMBUS_MAX_WRITE_REQUEST_SIZE)
+        {
+            SMBTiming_Error(pending->timing);
+            return -1;
+        }
+        memcpy(pecBuffer, buffer, numBytesToWrite);
+        pecBuffer[numBytesToWrite] = SMBPec_Update(SMBPec_Update(0, &slaveAddress, 1), buffer, numBytesToWrite);
+        buffer = pecBuffer;
+        numBytesToWrite++;
+    }
+
+    // Issue write request
+    status = backend->WriteRequest(device, slaveAddress, buffer, numBytesToWrite);
+    SMBTiming_Stop(pending->timing, SMBTIMING_WRITE_REQUEST, pending->start);
+    // Check status
+    if (status != HID_SMBUS_SUCCESS)
+    {
+        SMBus_SessionError(device);
+        SMBTiming_Error(pending->timing);
+        SMBus_SlaveDone(owner, slaveAddress, FALSE);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Wait for a write issued by SMBus_StartWrite to complete
+static INT SMBus_FinishWrite(HID_SMBUS_DEVICE device, const SMBUS_PENDING_WRITE *pending)
+{
+    SMBUS_SESSION       *session = SMBus_FindSession(device);
+    HID_SMBUS_DEVICE    owner = (session != NULL) ? (HID_SMBUS_DEVICE)session : device;
+    INT                 result = SMBus_WaitTransfer(device, pending->timing, pollConfig.timeoutMs);
+
+    if (result != 0)
+    {
+        SMBTiming_Error(pending->timing);
+    }
+    else
+    {
+        SMBTiming_Stop(pending->timing, SMBTIMING_WRITE_TOTAL, pending->start);
+        SMBus_Healthy(owner);
+    }
+
+    // Resolved before the wait, which may reopen and replace the handle
+    SMBus_SlaveDone(owner, pending->slaveAddress, result == 0);
+    SMBus_TuneDone(owner, FALSE, result == 0);
+
+    return result;
 }
 
 INT SMBus_Write(HID_SMBUS_DEVICE device, BYTE *buffer, BYTE slaveAddress, BYTE numBytesToWrite)
 {
-    BOOL                opened;
-    HID_SMBUS_STATUS    status;
-    HID_SMBUS_S0        status0;
-    HID_SMBUS_S1        status1;
-    WORD                numRetries;
-    WORD                bytesRead;
+    SMBUS_PENDING_WRITE pending;
 
+    device = SMBus_Handle(device);
     // Make sure that the device is opened
-    if (HidSmbus_IsOpened(device, &opened) == HID_SMBUS_SUCCESS && opened)
+    if (SMBus_IsOpened(device))
     {
-        // Issue write request
-        status = HidSmbus_WriteRequest(device, slaveAddress, buffer, numBytesToWrite);
-        // Check status
-        if (status != HID_SMBUS_SUCCESS)
+        if (SMBus_StartWrite(device, buffer, slaveAddress, numBytesToWrite, &pending) != 0)
         {
             return -1;
         }
 
         // Wait for transfer to complete
-        do
+        return SMBus_FinishWrite(device, &pending);
+    }
+
+    return -1;
+}
+
+INT SMBus_WriteAsync(HID_SMBUS_DEVICE device, BYTE *buffer, BYTE slaveAddress, BYTE numBytesToWrite)
+{
+    SMBUS_SESSION       *session = SMBus_FindSession(device);
+    SMBUS_PENDING_WRITE pending;
+
+    device = SMBus_Handle(device);
+    // One write in flight per handle, the last one has to be collected first
+    if (session != NULL && session->writePending)
+    {
+        return -1;
+    }
+
+    // Make sure that the device is opened
+    if (SMBus_IsOpened(device))
+    {
+        // Issue write request, completion is collected by SMBus_WaitWrite
+        if (SMBus_StartWrite(device, buffer, slaveAddress, numBytesToWrite, &pending) == 0)
+        {
+            if (session != NULL)
+            {
+                session->pendingWrite = pending;
+                session->writePending = TRUE;
+            }
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+INT SMBus_WaitWrite(HID_SMBUS_DEVICE device)
+{
+    SMBUS_SESSION       *session = SMBus_FindSession(device);
+    SMBUS_PENDING_WRITE pending = { NULL, 0, 0 };
+
+    // Untracked handles are waited for without timing
+    if (session != NULL)
+    {
+        // Nothing issued, or SMBus_WriteAsync failed
+        if (!session->writePending)
+        {
+            return -1;
+        }
+        pending = session->pendingWrite;
+        session->writePending = FALSE;
+    }
+    device = SMBus_Handle(device);
+
+    return SMBus_FinishWrite(device, &pending);
+}
+
+INT SMBus_WriteBatch(HID_SMBUS_DEVICE device, SMBUS_WRITE_DESC *writes, WORD numWrites)
+{
+    INT                 numSucceeded = 0;
+    SMBUS_PENDING_WRITE pendingWrite;
+    HID_SMBUS_DEVICE    handle = SMBus_Handle(device);
+
+    // Make sure that the device is opened, once for the whole batch
+    if (!SMBus_IsOpened(handle))
+    {
+        for (WORD i = 0; i < numWrites; i++)
+        {
+            writes[i].result = -1;
+        }
+        return -1;
+    }
+
+    // One write after the other; the CP2112 runs one SMBus transfer at a
+    // time, so each one is collected before the next request goes out.
+    // The batch only saves the open check per write.
+    for (WORD i = 0; i < numWrites; i++)
+    {
+        // On the handle recovery may have replaced
+        handle = SMBus_Handle(device);
+        writes[i].result = SMBus_StartWrite(handle, writes[i].buffer, writes[i].slaveAddress, writes[i].numBytesToWrite, &pendingWrite);
+        if (writes[i].result == 0)
+        {
+            writes[i].result = SMBus_FinishWrite(handle, &pendingWrite);
+            numSucceeded += (writes[i].result == 0);
+        }
+    }
+
+    // Number of descriptors that completed
+    return numSucceeded;
+}
+
+INT SMBus_WriteVerifyBatch(HID_SMBUS_DEVICE device, SMBUS_WRITE_DESC *writes, WORD numWrites)
+{
+    SMBUS_READ_DESC     readbacks[SMBUS_VERIFY_CHUNK];
+    BYTE                data[SMBUS_VERIFY_CHUNK][HID_SMBUS_MAX_WRITE_REQUEST_SIZE];
+    WORD                index[SMBUS_VERIFY_CHUNK];
+    INT                 numVerified = 0;
+
+    for (WORD first = 0; first < numWrites; first += SMBUS_VERIFY_CHUNK)
+    {
+        WORD count = (numWrites - first < SMBUS_VERIFY_CHUNK) ? numWrites - first : SMBUS_VERIFY_CHUNK;
+        WORD numReadbacks = 0;
+
+        // The writes first, one at a time as the adapter runs them
+        if (SMBus_WriteBatch(device, &writes[first], count) < 0)
+        {
+            return -1;
+        }
+
+        // Read back every register that took data, as one batch so
+        // neighbouring registers of an auto-increment slave share a read
+        for (WORD i = first; i < first + count; i++)
+        {
+            if (writes[i].result != 0 || writes[i].numBytesToWrite < 2)
+            {
+                numVerified += (writes[i].result == 0);
+                continue;
+            }
+            readbacks[numReadbacks].slaveAddress = writes[i].slaveAddress;
+            readbacks[numReadbacks].targetAddressSize = 1;
+            readbacks[numReadbacks].targetAddress[0] = writes[i].buffer[0];
+            readbacks[numReadbacks].numBytesToRead = writes[i].numBytesToWrite - 1;
+            readbacks[numReadbacks].buffer = data[numReadbacks];
+            index[numReadbacks++] = i;
+        }
+        if (numReadbacks > 0 && SMBus_ReadBatch(device, readbacks, numReadbacks) < 0)
         {
-            // Issue transfer status request
-            status = HidSmbus_TransferStatusRequest(device);
-            // Check status
-            if (status != HID_SMBUS_SUCCESS)
+            for (WORD r = 0; r < numReadbacks; r++)
             {
-                return -1;
+                readbacks[r].result = -1;
             }
+        }
+
+        // Compare against what was written
+        for (WORD r = 0; r < numReadbacks; r++)
+        {
+            SMBUS_WRITE_DESC *write = &writes[index[r]];
 
-            // Wait for transfer status response
-            status = HidSmbus_GetTransferStatusResponse(device, &status0, &status1, &numRetries, &bytesRead);
-            // Check status
-            if (status != HID_SMBUS_SUCCESS)
+            if (readbacks[r].result != readbacks[r].numBytesToRead)
+            {
+                write->result = -1;
+            }
+            else if (memcmp(data[r], &write->buffer[1], readbacks[r].numBytesToRead) != 0)
+            {
+                write->result = SMBUS_WRITE_MISMATCH;
+            }
+            else
             {
-                return -1;
+                numVerified++;
             }
-        } while (status0 != HID_SMBUS_S0_COMPLETE);
+        }
     }
-    else
+
+    // Number of descriptors written and read back unchanged
+    return numVerified;
+}
+
+INT SMBus_WriteVerify(HID_SMBUS_DEVICE device, BYTE *buffer, BYTE slaveAddress, BYTE numBytesToWrite)
+{
+    SMBUS_WRITE_DESC write = { slaveAddress, numBytesToWrite, buffer, -1 };
+
+    if (SMBus_WriteVerifyBatch(device, &write, 1) < 0)
     {
         return -1;
     }
 
-    // Success
-    return 0;
+    return write.result;
 }
@@ -0,0 +1,369 @@
+#include "telemetry.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+INT Telemetry_RingInit(TELEMETRY_RING *ring, TELEMETRY_SAMPLE *storage, DWORD capacity)
+{
+    // Indices are masked, so the capacity must be a power of two
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0)
+    {
+        return -1;
+    }
+
+    ring->samples = storage;
+    ring->capacity = capacity;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->dropped = 0;
+    ring->shared = FALSE;
+    ring->dataEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (ring->dataEvent == NULL)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+INT Telemetry_RingInitShared(TELEMETRY_RING *ring, TELEMETRY_SAMPLE *storage, DWORD capacity)
+{
+    if (Telemetry_RingInit(ring, storage, capacity) != 0)
+    {
+        return -1;
+    }
+
+    InitializeCriticalSection(&ring->producerLock);
+    ring->shared = TRUE;
+
+    return 0;
+}
+
+void Telemetry_RingFree(TELEMETRY_RING *ring)
+{
+    if (ring->shared)
+    {
+        DeleteCriticalSection(&ring->producerLock);
+        ring->shared = FALSE;
+    }
+    if (ring->dataEvent != NULL)
+    {
+        CloseHandle(ring->dataEvent);
+        ring->dataEvent = NULL;
+    }
+}
+
+static BOOL Telemetry_RingPut(TELEMETRY_RING *ring, const TELEMETRY_SAMPLE *sample)
+{
+    DWORD head = (DWORD)ring->head;
+    DWORD tail = (DWORD)ring->tail;
+
+    // Never block the producer, count the loss instead
+    if (head - tail >= ring->capacity)
+    {
+        InterlockedIncrement(&ring->dropped);
+        return FALSE;
+    }
+
+    ring->samples[head & (ring->capacity - 1)] = *sample;
+    // Publish the record before the new head
+    MemoryBarrier();
+    ring->head = (LONG)(head + 1);
+
+    return TRUE;
+}
+
+BOOL Telemetry_RingPush(TELEMETRY_RING *ring, const TELEMETRY_SAMPLE *sample)
+{
+    BOOL pushed;
+
+    // Producers only hold the lock for the copy, the consumer never takes it
+    if (ring->shared)
+    {
+        EnterCriticalSection(&ring->producerLock);
+        pushed = Telemetry_RingPut(ring, sample);
+        LeaveCriticalSection(&ring->producerLock);
+    }
+    else
+    {
+        pushed = Telemetry_RingPut(ring, sample);
+    }
+    if (pushed)
+    {
+        SetEvent(ring->dataEvent);
+    }
+
+    return pushed;
+}
+
+BOOL Telemetry_RingPop(TELEMETRY_RING *ring, TELEMETRY_SAMPLE *sample)
+{
+    DWORD tail = (DWORD)ring->tail;
+    DWORD head = (DWORD)ring->head;
+
+    if (head == tail)
+    {
+        return FALSE;
+    }
+
+    // Read the record only after observing the head that published it
+    MemoryBarrier();
+    *sample = ring->samples[tail & (ring->capacity - 1)];
+    MemoryBarrier();
+    ring->tail = (LONG)(tail + 1);
+
+    return TRUE;
+}
+
+BOOL Telemetry_RingWait(TELEMETRY_RING *ring, DWORD timeoutMs)
+{
+    if (ring->head != ring->tail)
+    {
+        return TRUE;
+    }
+
+    return WaitForSingleObject(ring->dataEvent, timeoutMs) == WAIT_OBJECT_0;
+}
+
+// Read period and slack of one register in QPC counts
+static void Telemetry_Rate(const TELEMETRY_ACQUISITION *acq, INT i, LONGLONG frequency, LONGLONG *period, LONGLONG *slack)
+{
+    DWORD periodMs = (acq->rates != NULL) ? acq->rates[i].periodMs : acq->periodMs;
+    DWORD slackMs = (acq->rates != NULL) ? acq->rates[i].slackMs : 0;
+
+    *period = (LONGLONG)periodMs * frequency / 1000;
+    *slack = (LONGLONG)slackMs * frequency / 1000;
+}
+
+// Arm the timer for the earliest deadline
+static void Telemetry_ArmTimer(TELEMETRY_ACQUISITION *acq, LONGLONG frequency)
+{
+    LARGE_INTEGER   now, dueTime;
+    LONGLONG        next = LLONG_MAX;
+
+    for (INT i = 0; i < acq->numRegisters; i++)
+    {
+        if (acq->nextDue[i] < next)
+        {
+            next = acq->nextDue[i];
+        }
+    }
+
+    // Relative due time in 100 ns units, 0 fires right away
+    QueryPerformanceCounter(&now);
+    dueTime.QuadPart = 0;
+    if (next == LLONG_MAX)
+    {
+        // Only read-once registers left, nothing more to schedule
+        return;
+    }
+    if (next > now.QuadPart)
+    {
+        dueTime.QuadPart = -(LONGLONG)((next - now.QuadPart) * 10000000 / frequency);
+    }
+    SetWaitableTimer(acq->timer, &dueTime, 0, NULL, NULL, FALSE);
+}
+
+static DWORD WINAPI Telemetry_Thread(LPVOID param)
+{
+    TELEMETRY_ACQUISITION   *acq = (TELEMETRY_ACQUISITION *)param;
+    HANDLE                  waitHandles[3] = { acq->stopEvent, acq->timer, acq->triggerEvent };
+    TELEMETRY_SAMPLE        sample;
+    SMBUS_READ_DESC         pass[TELEMETRY_MAX_WORDS];
+    INT                     passIndex[TELEMETRY_MAX_WORDS];
+    LARGE_INTEGER           freq, start, now;
+    DWORD                   wait;
+
+    memset(&sample, 0, sizeof(sample));
+    sample.source = acq->source;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&start);
+    // A common epoch keeps timestamps from several threads comparable
+    if (acq->epoch != 0)
+    {
+        start.QuadPart = acq->epoch;
+    }
+
+    // Every register is due on the first pass
+    QueryPerformanceCounter(&now);
+    for (INT i = 0; i < acq->numRegisters; i++)
+    {
+        acq->nextDue[i] = now.QuadPart;
+    }
+    Telemetry_ArmTimer(acq, freq.QuadPart);
+
+    // One pass per deadline or trigger until asked to stop
+    while ((wait = WaitForMultipleObjects(3, waitHandles, FALSE, INFINITE)) == WAIT_OBJECT_0 + 1 || wait == WAIT_OBJECT_0 + 2)
+    {
+        INT     numDue = 0;
+        BOOL    batchOk;
+        WORD    triggered = (WORD)InterlockedExchange(&acq->triggered, 0);
+
+        // Everything due by now, plus reads whose slack lets them come along
+        // and the ones triggered out of schedule
+        QueryPerformanceCounter(&now);
+        for (INT i = 0; i < acq->numRegisters; i++)
+        {
+            LONGLONG period, slack;
+
+            Telemetry_Rate(acq, i, freq.QuadPart, &period, &slack);
+            if (acq->nextDue[i] - slack <= now.QuadPart || (triggered & (1 << i)))
+            {
+                pass[numDue] = acq->reads[i];
+                passIndex[numDue++] = i;
+            }
+        }
+        if (triggered != 0)
+        {
+            InterlockedIncrement(&acq->triggers);
+        }
+        if (numDue == 0)
+        {
+            Telemetry_ArmTimer(acq, freq.QuadPart);
+            continue;
+        }
+
+        sample.timestampUs = (ULONGLONG)(now.QuadPart - start.QuadPart) * 1000000 / (ULONGLONG)freq.QuadPart;
+        sample.freshMask = 0;
+
+        // A batch that failed as a whole leaves no result to trust
+        batchOk = (SMBus_ReadBatch(acq->device, pass, (WORD)numDue) >= 0);
+        for (INT k = 0; k < numDue; k++)
+        {
+            INT         i = passIndex[k];
+            LONGLONG    period, slack;
+
+            if (!batchOk)
+            {
+                pass[k].result = -1;
+            }
+            if (pass[k].result == 2)
+            {
+                sample.raw[i] = (WORD)((acq->data[i][1] << 8) | acq->data[i][0]);
+                sample.validMask |= (WORD)(1 << i);
+                sample.freshMask |= (WORD)(1 << i);
+            }
+            else
+            {
+                sample.raw[i] = 0;
+                sample.validMask &= (WORD)~(1 << i);
+            }
+
+            // Stay on the register's own grid, resync if a whole period went by.
+            // A triggered read that was not due leaves the schedule alone.
+            Telemetry_Rate(acq, i, freq.QuadPart, &period, &slack);
+            if (acq->nextDue[i] - slack > now.QuadPart)
+            {
+                continue;
+            }
+            if (period == 0)
+            {
+                // Read-once registers retry at the base period until they answer
+                acq->nextDue[i] = (pass[k].result == 2) ? LLONG_MAX : now.QuadPart + (LONGLONG)acq->periodMs * freq.QuadPart / 1000;
+                continue;
+            }
+            acq->nextDue[i] += period;
+            if (acq->nextDue[i] <= now.QuadPart)
+            {
+                InterlockedIncrement(&acq->missed);
+                acq->nextDue[i] = now.QuadPart + period;
+            }
+        }
+        InterlockedIncrement(&acq->passes);
+        Telemetry_ArmTimer(acq, freq.QuadPart);
+
+        for (INT i = 0; i < acq->numRings; i++)
+        {
+            Telemetry_RingPush(acq->rings[i], &sample);
+        }
+        sample.sequence++;
+    }
+
+    return 0;
+}
+
+INT Telemetry_Start(TELEMETRY_ACQUISITION *acq)
+{
+    acq->thread = NULL;
+    acq->stopEvent = NULL;
+    acq->timer = NULL;
+    acq->triggerEvent = NULL;
+    acq->triggered = 0;
+    acq->passes = 0;
+    acq->missed = 0;
+    acq->triggers = 0;
+    if (acq->numRegisters < 1 || acq->numRegisters > TELEMETRY_MAX_WORDS || acq->numRings > TELEMETRY_MAX_CONSUMERS || acq->periodMs == 0)
+    {
+        return -1;
+    }
+
+    // Build the descriptors once, each pass copies the due ones
+    for (INT i = 0; i < acq->numRegisters; i++)
+    {
+        acq->reads[i].slaveAddress = acq->slaveAddress;
+        acq->reads[i].targetAddressSize = 1;
+        acq->reads[i].targetAddress[0] = acq->registers[i];
+        acq->reads[i].numBytesToRead = 2;
+        acq->reads[i].buffer = acq->data[i];
+        acq->reads[i].result = -1;
+    }
+
+    // A one-shot waitable timer rearmed for the next deadline on the QPC
+    // clock, so the schedule does not drift with the time spent on the bus
+    acq->stopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    acq->timer = CreateWaitableTimer(NULL, FALSE, NULL);
+    acq->triggerEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (acq->stopEvent == NULL || acq->timer == NULL || acq->triggerEvent == NULL)
+    {
+        Telemetry_Stop(acq);
+        return -1;
+    }
+
+    acq->thread = CreateThread(NULL, 0, Telemetry_Thread, acq, 0, NULL);
+    if (acq->thread == NULL)
+    {
+        Telemetry_Stop(acq);
+        return -1;
+    }
+
+    return 0;
+}
+
+void Telemetry_Stop(TELEMETRY_ACQUISITION *acq)
+{
+    if (acq->thread != NULL)
+    {
+        SetEvent(acq->stopEvent);
+        WaitForSingleObject(acq->thread, INFINITE);
+        CloseHandle(acq->thread);
+        acq->thread = NULL;
+    }
+    if (acq->timer != NULL)
+    {
+        CancelWaitableTimer(acq->timer);
+        CloseHandle(acq->timer);
+        acq->timer = NULL;
+    }
+    if (acq->triggerEvent != NULL)
+    {
+        CloseHandle(acq->triggerEvent);
+        acq->triggerEvent = NULL;
+    }
+    if (acq->stopEvent != NULL)
+    {
+        CloseHandle(acq->stopEvent);
+        acq->stopEvent = NULL;
+    }
+}
+
+void Telemetry_Trigger(TELEMETRY_ACQUISITION *acq, WORD registerMask)
+{
+    // Masks pile up until the thread gets to them, one pass reads them all
+    InterlockedOr(&acq->triggered, registerMask);
+    if (acq->triggerEvent != NULL)
+    {
+        SetEvent(acq->triggerEvent);
+    }
+}
@@ -0,0 +1,1174 @@
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Longest line: header, a 61 byte hex payload or two escaped strings
+#define TRACE_LINE_SIZE             1024
+
+typedef struct
+{
+    char    text[TRACE_LINE_SIZE];
+    INT     length;
+} TRACE_LINE;
+
+// Calls of one device in trace order
+typedef struct
+{
+    char        **lines;
+    DWORD       count;
+    DWORD       capacity;
+    DWORD       next;
+    ULONGLONG   lastUs;                 // Trace time of the last call replayed
+    LONGLONG    lastTime;               // QPC count it was replayed at
+} TRACE_QUEUE;
+
+static FILE                 *traceFile;
+static LONGLONG             traceStart;
+static LONGLONG             traceFrequency;
+
+// Recording
+static const SMBUS_BACKEND  *recInner;
+static HID_SMBUS_DEVICE     recHandles[TRACE_MAX_DEVICES];
+static INT                  recNumHandles;
+
+// Replay, queues[0] holds the calls made without a handle
+static char                 *replayText;
+static TRACE_QUEUE          queues[TRACE_MAX_DEVICES + 1];
+static BYTE                 replayHandles[TRACE_MAX_DEVICES];
+static BOOL                 replayRealTime;
+static volatile LONG        mismatches;
+
+static void Trace_StartClock(void)
+{
+    LARGE_INTEGER value;
+
+    QueryPerformanceFrequency(&value);
+    traceFrequency = value.QuadPart;
+    QueryPerformanceCounter(&value);
+    traceStart = value.QuadPart;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Line formatting
+/////////////////////////////////////////////////////////////////////////////
+
+static void Trace_Begin(TRACE_LINE *line, INT dev, const char *call, HID_SMBUS_STATUS status)
+{
+    LARGE_INTEGER now;
+
+    QueryPerformanceCounter(&now);
+    line->length = sprintf(line->text, "%llu %d %s %d",
+        (unsigned long long)((now.QuadPart - traceStart) * 1000000 / traceFrequency), dev, call, status);
+}
+
+static void Trace_Num(TRACE_LINE *line, DWORD value)
+{
+    line->length += sprintf(line->text + line->length, " %lu", (unsigned long)value);
+}
+
+static void Trace_Hex(TRACE_LINE *line, const BYTE *data, INT count)
+{
+    line->text[line->length++] = ' ';
+    if (count <= 0)
+    {
+        line->text[line->length++] = '-';
+    }
+    for (INT i = 0; i < count; i++)
+    {
+        line->length += sprintf(line->text + line->length, "%02x", data[i]);
+    }
+    line->text[line->length] = '\0';
+}
+
+// Spaces, '%' and control characters as %XX so a string stays one field
+static void Trace_Str(TRACE_LINE *line, const char *string)
+{
+    line->text[line->length++] = ' ';
+    if (*string == '\0')
+    {
+        line->text[line->length++] = '%';
+        line->text[line->length++] = '%';
+    }
+    for (; *string != '\0' && line->length < TRACE_LINE_SIZE / 2; string++)
+    {
+        if ((BYTE)*string <= ' ' || *string == '%')
+        {
+            line->length += sprintf(line->text + line->length, "%%%02X", (BYTE)*string);
+        }
+        else
+        {
+            line->text[line->length++] = *string;
+        }
+    }
+    line->text[line->length] = '\0';
+}
+
+// One fputs per line, the CRT lock keeps lines from different threads whole
+static void Trace_End(TRACE_LINE *line)
+{
+    line->text[line->length++] = '\n';
+    line->text[line->length] = '\0';
+    fputs(line->text, traceFile);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Recording backend
+/////////////////////////////////////////////////////////////////////////////
+
+static INT Rec_Id(HID_SMBUS_DEVICE device)
+{
+    for (INT i = 0; i < recNumHandles; i++)
+    {
+        if (recHandles[i] == device)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+INT Trace_Record(const char *path, const SMBUS_BACKEND *inner)
+{
+    Trace_Close();
+    traceFile = fopen(path, "w");
+    if (traceFile == NULL)
+    {
+        return -1;
+    }
+
+    recInner = inner;
+    recNumHandles = 0;
+    Trace_StartClock();
+    fprintf(traceFile, "# smbus trace 1, backend %s\n", inner->name);
+    return 0;
+}
+
+static HID_SMBUS_STATUS WINAPI Rec_GetNumDevices(DWORD *numDevices, WORD vid, WORD pid)
+{
+    TRACE_LINE          line;
+    HID_SMBUS_STATUS    status;
+
+    *numDevices = 0;
+    status = recInner->GetNumDevices(numDevices, vid, pid);
+    Trace_Begin(&line, -1, "num_devices", status);
+    Trace_Num(&line, *numDevices);
+    Trace_End(&line);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rec_GetString(DWORD deviceNum, WORD vid, WORD pid, char *deviceString, DWORD options)
+{
+    TRACE_LINE          line;
+    HID_SMBUS_STATUS    status;
+
+    deviceString[0] = '\0';
+    status = recInner->GetString(deviceNum, vid, pid, deviceString, options);
+    Trace_Begin(&line, -1, "get_string", status);
+    Trace_Num(&line, deviceNum);
+    Trace_Num(&line, options);
+    Trace_Str(&line, deviceString);
+    Trace_End(&line);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rec_GetOpenedString(HID_SMBUS_DEVICE device, char *deviceString, DWORD options)
+{
+    TRACE_LINE          line;
+    HID_SMBUS_STATUS    status;
+
+    deviceString[0] = '\0';
+    status = recInner->GetOpenedString(device, deviceString, options);
+    Trace_Begin(&line, Rec_Id(device), "get_opened_string", status);
+    Trace_Num(&line, options);
+    Trace_Str(&line, deviceString);
+    Trace_End(&line);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rec_Open(HID_SMBUS_DEVICE *device, DWORD deviceNum, WORD vid, WORD pid)
+{
+    TRACE_LINE          line;
+    HID_SMBUS_STATUS    status;
+    INT                 id = -1;
+
+    status = recInner->Open(device, deviceNum, vid, pid);
+    if (status == HID_SMBUS_SUCCESS)
+    {
+        id = Rec_Id(*device);
+        if (id < 0 && recNumHandles < TRACE_MAX_DEVICES)
+        {
+            id = recNumHandles;
+            recHandles[recNumHandles++] = *device;
+        }
+    }
+    Trace_Begin(&line, -1, "open", status);
+    Trace_Num(&line, deviceNum);
+    line.length += sprintf(line.text + line.length, " %d", id);
+    Trace_End(&line);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rec_Close(HID_SMBUS_DEVICE device)
+{
+    TRACE_LINE          line;
+    HID_SMBUS_STATUS    status = recInner->Close(device);
+
+    Trace_Begin(&line, Rec_Id(device), "close", status);
+    Trace_End(&line);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rec_IsOpened(HID_SMBUS_DEVICE device, BOOL *opened)
+{
+    TRACE_LINE          line;
+    HID_SMBUS_STATUS    status;
+
+    *opened = FALSE;
+    status = recInner->IsOpened(device, opened);
+    Trace_Begin(&line, Rec_Id(device), "is_opened", status);
+    Trace_Num(&line, *opened);
+    Trace_End(&line);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rec_ReadRequest(HID_SMBUS_DEVICE device, BYTE slaveAddress, WORD numBytesToRead)
+{
+    TRACE_LINE          line;
+    HID_SMBUS_STATUS    status = recInner->ReadRequest(device, slaveAddress, numBytesToRead);
+
+    Trace_Begin(&line, Rec_Id(device), "read_request", status);
+    Trace_Num(&line, slaveAddress);
+    Trace_Num(&line, numBytesToRead);
+    Trace_End(&line);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rec_AddressReadRequest(HID_SMBUS_DEVICE device, BYTE slaveAddress, WORD numBytesToRead, BYTE targetAddressSize, BYTE targetAddress[16])
+{
+    TRACE_LINE          line;
+    HID_SMBUS_STATUS    status = recInner->AddressReadRequest(device, slaveAddress, numBytesToRead, targetAddressSize, targetAddress);
+
+    Trace_Begin(&line, Rec_Id(device), "address_read_request", status);
+    Trace_Num(&line, slaveAddress);
+    Trace_Num(&line, numBytesToRead);
+    Trace_Hex(&line, targetAddress, (targetAddressSize <= HID_SMBUS_MAX_TARGET_ADDRESS_SIZE) ? targetAddressSize : 0);
+    Trace_End(&line);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rec_ForceReadResponse(HID_SMBUS_DEVICE device, WORD numBytesToRead)
+{
+    TRACE_LINE          line;
+    HID_SMBUS_STATUS    status = recInner->ForceReadResponse(device, numBytesToRead);
+
+    Trace_Begin(&line, Rec_Id(device), "force_read_response", status);
+    Trace_Num(&line, numBytesToRead);
+    Trace_End(&line);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rec_GetReadResponse(HID_SMBUS_DEVICE device, HID_SMBUS_S0 *status0, BYTE *buffer, BYTE bufferSize, BYTE *numBytesRead)
+{
+    TRACE_LINE          line;
+    HID_SMBUS_STATUS    status;
+
+    *status0 = HID_SMBUS_S0_IDLE;
+    *numBytesRead = 0;
+    status = recInner->GetReadResponse(device, status0, buffer, bufferSize, numBytesRead);
+    Trace_Begin(&line, Rec_Id(device), "get_read_response", status);
+    Trace_Num(&line, *status0);
+    Trace_Hex(&line, buffer, (*numBytesRead <= bufferSize) ? *numBytesRead : 0);
+    Trace_End(&line);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rec_WriteRequest(HID_SMBUS_DEVICE device, BYTE slaveAddress, BYTE *buffer, BYTE numBytesToWrite)
+{
+    TRACE_LINE          line;
+    HID_SMBUS_STATUS    status = recInner->WriteRequest(device, slaveAddress, buffer, numBytesToWrite);
+
+    Trace_Begin(&line, Rec_Id(device), "write_request", status);
+    Trace_Num(&line, slaveAddress);
+    Trace_Hex(&line, buffer, (numBytesToWrite <= HID_SMBUS_MAX_WRITE_REQUEST_SIZE) ? numBytesToWrite : 0);
+    Trace_End(&line);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rec_TransferStatusRequest(HID_SMBUS_DEVICE device)
+{
+    TRACE_LINE          line;
+    HID_SMBUS_STATUS    status = recInner->TransferStatusRequest(device);
+
+    Trace_Begin(&line, Rec_Id(device), "transfer_status_request", status);
+    Trace_End(&line);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rec_GetTransferStatusResponse(HID_SMBUS_DEVICE device, HID_SMBUS_S0 *status0, HID_SMBUS_S1 *status1, WORD *numRetries, WORD *bytesRead)
+{
+    TRACE_LINE          line;
+    HID_SMBUS_STATUS    status;
+
+    *status0 = HID_SMBUS_S0_IDLE;
+    *status1 = 0;
+    *numRetries = 0;
+    *bytesRead = 0;
+    status = recInner->GetTransferStatusResponse(device, status0, status1, numRetries, bytesRead);
+    Trace_Begin(&line, Rec_Id(device), "get_transfer_status_response", status);
+    Trace_Num(&line, *status0);
+    Trace_Num(&line, *status1);
+    Trace_Num(&line, *numRetries);
+    Trace_Num(&line, *bytesRead);
+    Trace_End(&line);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rec_CancelTransfer(HID_SMBUS_DEVICE device)
+{
+    TRACE_LINE          line;
+    HID_SMBUS_STATUS    status = recInner->CancelTransfer(device);
+
+    Trace_Begin(&line, Rec_Id(device), "cancel_transfer", status);
+    Trace_End(&line);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rec_CancelIo(HID_SMBUS_DEVICE device)
+{
+    TRACE_LINE          line;
+    HID_SMBUS_STATUS    status = recInner->CancelIo(device);
+
+    Trace_Begin(&line, Rec_Id(device), "cancel_io", status);
+    Trace_End(&line);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rec_SetTimeouts(HID_SMBUS_DEVICE device, DWORD responseTimeout)
+{
+    TRACE_LINE          line;
+    HID_SMBUS_STATUS    status = recInner->SetTimeouts(device, responseTimeout);
+
+    Trace_Begin(&line, Rec_Id(device), "set_timeouts", status);
+    Trace_Num(&line, responseTimeout);
+    Trace_End(&line);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rec_GetTimeouts(HID_SMBUS_DEVICE device, DWORD *responseTimeout)
+{
+    TRACE_LINE          line;
+    HID_SMBUS_STATUS    status;
+
+    *responseTimeout = 0;
+    status = recInner->GetTimeouts(device, responseTimeout);
+    Trace_Begin(&line, Rec_Id(device), "get_timeouts", status);
+    Trace_Num(&line, *responseTimeout);
+    Trace_End(&line);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rec_SetSmbusConfig(HID_SMBUS_DEVICE device, DWORD bitRate, BYTE address, BOOL autoReadRespond, WORD writeTimeout, WORD readTimeout, BOOL sclLowTimeout, WORD transferRetries)
+{
+    TRACE_LINE          line;
+    HID_SMBUS_STATUS    status = recInner->SetSmbusConfig(device, bitRate, address, autoReadRespond, writeTimeout, readTimeout, sclLowTimeout, transferRetries);
+
+    Trace_Begin(&line, Rec_Id(device), "set_smbus_config", status);
+    Trace_Num(&line, bitRate);
+    Trace_Num(&line, address);
+    Trace_Num(&line, autoReadRespond);
+    Trace_Num(&line, writeTimeout);
+    Trace_Num(&line, readTimeout);
+    Trace_Num(&line, sclLowTimeout);
+    Trace_Num(&line, transferRetries);
+    Trace_End(&line);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rec_GetSmbusConfig(HID_SMBUS_DEVICE device, DWORD *bitRate, BYTE *address, BOOL *autoReadRespond, WORD *writeTimeout, WORD *readTimeout, BOOL *sclLowTimeout, WORD *transferRetries)
+{
+    TRACE_LINE          line;
+    HID_SMBUS_STATUS    status;
+
+    *bitRate = 0;
+    *address = 0;
+    *autoReadRespond = FALSE;
+    *writeTimeout = 0;
+    *readTimeout = 0;
+    *sclLowTimeout = FALSE;
+    *transferRetries = 0;
+    status = recInner->GetSmbusConfig(device, bitRate, address, autoReadRespond, writeTimeout, readTimeout, sclLowTimeout, transferRetries);
+    Trace_Begin(&line, Rec_Id(device), "get_smbus_config", status);
+    Trace_Num(&line, *bitRate);
+    Trace_Num(&line, *address);
+    Trace_Num(&line, *autoReadRespond);
+    Trace_Num(&line, *writeTimeout);
+    Trace_Num(&line, *readTimeout);
+    Trace_Num(&line, *sclLowTimeout);
+    Trace_Num(&line, *transferRetries);
+    Trace_End(&line);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rec_Reset(HID_SMBUS_DEVICE device)
+{
+    TRACE_LINE          line;
+    HID_SMBUS_STATUS    status = recInner->Reset(device);
+
+    Trace_Begin(&line, Rec_Id(device), "reset", status);
+    Trace_End(&line);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rec_SetGpioConfig(HID_SMBUS_DEVICE device, BYTE direction, BYTE mode, BYTE function, BYTE clkDiv)
+{
+    TRACE_LINE          line;
+    HID_SMBUS_STATUS    status = recInner->SetGpioConfig(device, direction, mode, function, clkDiv);
+
+    Trace_Begin(&line, Rec_Id(device), "set_gpio_config", status);
+    Trace_Num(&line, direction);
+    Trace_Num(&line, mode);
+    Trace_Num(&line, function);
+    Trace_Num(&line, clkDiv);
+    Trace_End(&line);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rec_GetGpioConfig(HID_SMBUS_DEVICE device, BYTE *direction, BYTE *mode, BYTE *function, BYTE *clkDiv)
+{
+    TRACE_LINE          line;
+    HID_SMBUS_STATUS    status;
+
+    *direction = *mode = *function = *clkDiv = 0;
+    status = recInner->GetGpioConfig(device, direction, mode, function, clkDiv);
+    Trace_Begin(&line, Rec_Id(device), "get_gpio_config", status);
+    Trace_Num(&line, *direction);
+    Trace_Num(&line, *mode);
+    Trace_Num(&line, *function);
+    Trace_Num(&line, *clkDiv);
+    Trace_End(&line);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rec_ReadLatch(HID_SMBUS_DEVICE device, BYTE *latchValue)
+{
+    TRACE_LINE          line;
+    HID_SMBUS_STATUS    status;
+
+    *latchValue = 0;
+    status = recInner->ReadLatch(device, latchValue);
+    Trace_Begin(&line, Rec_Id(device), "read_latch", status);
+    Trace_Num(&line, *latchValue);
+    Trace_End(&line);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rec_WriteLatch(HID_SMBUS_DEVICE device, BYTE latchValue, BYTE latchMask)
+{
+    TRACE_LINE          line;
+    HID_SMBUS_STATUS    status = recInner->WriteLatch(device, latchValue, latchMask);
+
+    Trace_Begin(&line, Rec_Id(device), "write_latch", status);
+    Trace_Num(&line, latchValue);
+    Trace_Num(&line, latchMask);
+    Trace_End(&line);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rec_GetPartNumber(HID_SMBUS_DEVICE device, BYTE *partNumber, BYTE *version)
+{
+    TRACE_LINE          line;
+    HID_SMBUS_STATUS    status;
+
+    *partNumber = 0;
+    *version = 0;
+    status = recInner->GetPartNumber(device, partNumber, version);
+    Trace_Begin(&line, Rec_Id(device), "get_part_number", status);
+    Trace_Num(&line, *partNumber);
+    Trace_Num(&line, *version);
+    Trace_End(&line);
+    return status;
+}
+
+const SMBUS_BACKEND backendTraceRecord =
+{
+    "record",
+    Rec_GetNumDevices,
+    Rec_GetString,
+    Rec_GetOpenedString,
+    Rec_Open,
+    Rec_Close,
+    Rec_IsOpened,
+    Rec_ReadRequest,
+    Rec_AddressReadRequest,
+    Rec_ForceReadResponse,
+    Rec_GetReadResponse,
+    Rec_WriteRequest,
+    Rec_TransferStatusRequest,
+    Rec_GetTransferStatusResponse,
+    Rec_CancelTransfer,
+    Rec_CancelIo,
+    Rec_SetTimeouts,
+    Rec_GetTimeouts,
+    Rec_SetSmbusConfig,
+    Rec_GetSmbusConfig,
+    Rec_Reset,
+    Rec_SetGpioConfig,
+    Rec_GetGpioConfig,
+    Rec_ReadLatch,
+    Rec_WriteLatch,
+    Rec_GetPartNumber
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// Replay backend
+/////////////////////////////////////////////////////////////////////////////
+
+static INT Trace_Append(TRACE_QUEUE *queue, char *line)
+{
+    if (queue->count == queue->capacity)
+    {
+        DWORD   capacity = (queue->capacity == 0) ? 256 : queue->capacity * 2;
+        char    **lines = realloc(queue->lines, capacity * sizeof(char *));
+
+        if (lines == NULL)
+        {
+            return -1;
+        }
+        queue->lines = lines;
+        queue->capacity = capacity;
+    }
+
+    queue->lines[queue->count++] = line;
+    return 0;
+}
+
+INT Trace_Replay(const char *path, BOOL realTime)
+{
+    FILE    *fp;
+    long    size;
+    char    *line;
+
+    Trace_Close();
+    fp = fopen(path, "rb");
+    if (fp == NULL)
+    {
+        return -1;
+    }
+
+    // Whole trace in memory, lines are split in place
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    replayText = malloc((size_t)size + 1);
+    if (replayText == NULL || fread(replayText, 1, (size_t)size, fp) != (size_t)size)
+    {
+        fclose(fp);
+        Trace_Close();
+        return -1;
+    }
+    fclose(fp);
+    replayText[size] = '\0';
+
+    for (line = strtok(replayText, "\r\n"); line != NULL; line = strtok(NULL, "\r\n"))
+    {
+        char    *p;
+        long    dev;
+
+        if (line[0] == '#')
+        {
+            continue;
+        }
+        strtoull(line, &p, 10);
+        dev = strtol(p, &p, 10);
+        if (dev < -1 || dev >= TRACE_MAX_DEVICES || Trace_Append(&queues[dev + 1], line) != 0)
+        {
+            Trace_Close();
+            return -1;
+        }
+    }
+
+    replayRealTime = realTime;
+    mismatches = 0;
+    Trace_StartClock();
+    return 0;
+}
+
+static INT Rep_Id(HID_SMBUS_DEVICE device)
+{
+    BYTE *handle = (BYTE *)device;
+
+    if (handle < replayHandles || handle >= replayHandles + TRACE_MAX_DEVICES)
+    {
+        return -2;
+    }
+
+    return (INT)(handle - replayHandles);
+}
+
+// Take the next call of a device if it is the one expected. fields is left
+// at the recorded arguments and results.
+static BOOL Rep_Next(INT dev, const char *call, const char **fields, HID_SMBUS_STATUS *status)
+{
+    TRACE_QUEUE *queue;
+    char        *p;
+    ULONGLONG   us;
+    size_t      length = strlen(call);
+
+    if (dev < -1 || dev >= TRACE_MAX_DEVICES || queues[dev + 1].next >= queues[dev + 1].count)
+    {
+        InterlockedIncrement(&mismatches);
+        return FALSE;
+    }
+    queue = &queues[dev + 1];
+
+    us = strtoull(queue->lines[queue->next], &p, 10);
+    strtol(p, &p, 10);
+    while (*p == ' ')
+    {
+        p++;
+    }
+    if (strncmp(p, call, length) != 0 || p[length] != ' ')
+    {
+        InterlockedIncrement(&mismatches);
+        return FALSE;
+    }
+    *status = (HID_SMBUS_STATUS)strtol(p + length, &p, 10);
+    *fields = p;
+
+    // Keep the recorded spacing between this device's calls
+    if (replayRealTime)
+    {
+        LARGE_INTEGER now;
+
+        QueryPerformanceCounter(&now);
+        if (queue->next > 0 && us > queue->lastUs)
+        {
+            LONGLONG due = queue->lastTime + (LONGLONG)(us - queue->lastUs) * traceFrequency / 1000000;
+
+            while (now.QuadPart < due)
+            {
+                LONGLONG remainingMs = (due - now.QuadPart) * 1000 / traceFrequency;
+
+                if (remainingMs > 1)
+                {
+                    Sleep((DWORD)(remainingMs - 1));
+                }
+                QueryPerformanceCounter(&now);
+            }
+        }
+        queue->lastUs = us;
+        queue->lastTime = now.QuadPart;
+    }
+
+    queue->next++;
+    return TRUE;
+}
+
+static DWORD Rep_Num(const char **fields)
+{
+    char    *end;
+    DWORD   value = (DWORD)strtoul(*fields, &end, 10);
+
+    *fields = end;
+    return value;
+}
+
+// Recorded argument, counted as a mismatch when the caller passed another
+static void Rep_Expect(const char **fields, DWORD actual)
+{
+    if (Rep_Num(fields) != actual)
+    {
+        InterlockedIncrement(&mismatches);
+    }
+}
+
+static INT Rep_Hex(const char **fields, BYTE *data, INT maxCount)
+{
+    const char  *p = *fields;
+    INT         count = 0;
+
+    while (*p == ' ')
+    {
+        p++;
+    }
+    if (*p == '-')
+    {
+        *fields = p + 1;
+        return 0;
+    }
+    while (p[0] != '\0' && p[0] != ' ' && p[1] != '\0' && p[1] != ' ')
+    {
+        char hex[3] = { p[0], p[1], '\0' };
+
+        if (count < maxCount)
+        {
+            data[count] = (BYTE)strtoul(hex, NULL, 16);
+        }
+        count++;
+        p += 2;
+    }
+    *fields = p;
+
+    return count;
+}
+
+static void Rep_ExpectHex(const char **fields, const BYTE *actual, INT count)
+{
+    BYTE    recorded[HID_SMBUS_MAX_WRITE_REQUEST_SIZE];
+    INT     numRecorded = Rep_Hex(fields, recorded, sizeof(recorded));
+
+    if (numRecorded != count || (count <= (INT)sizeof(recorded) && memcmp(recorded, actual, count) != 0))
+    {
+        InterlockedIncrement(&mismatches);
+    }
+}
+
+static void Rep_Str(const char **fields, char *string)
+{
+    const char  *p = *fields;
+    INT         length = 0;
+
+    while (*p == ' ')
+    {
+        p++;
+    }
+    while (*p != '\0' && *p != ' ' && length < HID_SMBUS_DEVICE_STRLEN - 1)
+    {
+        if (p[0] == '%' && p[1] == '%')
+        {
+            p += 2;
+        }
+        else if (p[0] == '%' && p[1] != '\0' && p[2] != '\0')
+        {
+            char hex[3] = { p[1], p[2], '\0' };
+
+            string[length++] = (char)strtoul(hex, NULL, 16);
+            p += 3;
+        }
+        else
+        {
+            string[length++] = *p++;
+        }
+    }
+    string[length] = '\0';
+    *fields = p;
+}
+
+static HID_SMBUS_STATUS WINAPI Rep_GetNumDevices(DWORD *numDevices, WORD vid, WORD pid)
+{
+    const char          *fields;
+    HID_SMBUS_STATUS    status;
+
+    if (!Rep_Next(-1, "num_devices", &fields, &status))
+    {
+        return HID_SMBUS_DEVICE_IO_FAILED;
+    }
+    *numDevices = Rep_Num(&fields);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rep_GetString(DWORD deviceNum, WORD vid, WORD pid, char *deviceString, DWORD options)
+{
+    const char          *fields;
+    HID_SMBUS_STATUS    status;
+
+    if (!Rep_Next(-1, "get_string", &fields, &status))
+    {
+        return HID_SMBUS_DEVICE_IO_FAILED;
+    }
+    Rep_Expect(&fields, deviceNum);
+    Rep_Expect(&fields, options);
+    Rep_Str(&fields, deviceString);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rep_GetOpenedString(HID_SMBUS_DEVICE device, char *deviceString, DWORD options)
+{
+    const char          *fields;
+    HID_SMBUS_STATUS    status;
+
+    if (!Rep_Next(Rep_Id(device), "get_opened_string", &fields, &status))
+    {
+        return HID_SMBUS_DEVICE_IO_FAILED;
+    }
+    Rep_Expect(&fields, options);
+    Rep_Str(&fields, deviceString);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rep_Open(HID_SMBUS_DEVICE *device, DWORD deviceNum, WORD vid, WORD pid)
+{
+    const char          *fields;
+    char                *end;
+    HID_SMBUS_STATUS    status;
+    long                id;
+
+    if (!Rep_Next(-1, "open", &fields, &status))
+    {
+        return HID_SMBUS_DEVICE_IO_FAILED;
+    }
+    Rep_Expect(&fields, deviceNum);
+    id = strtol(fields, &end, 10);
+    if (status == HID_SMBUS_SUCCESS)
+    {
+        if (id < 0 || id >= TRACE_MAX_DEVICES)
+        {
+            return HID_SMBUS_DEVICE_IO_FAILED;
+        }
+        *device = &replayHandles[id];
+    }
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rep_Close(HID_SMBUS_DEVICE device)
+{
+    const char          *fields;
+    HID_SMBUS_STATUS    status;
+
+    if (!Rep_Next(Rep_Id(device), "close", &fields, &status))
+    {
+        return HID_SMBUS_DEVICE_IO_FAILED;
+    }
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rep_IsOpened(HID_SMBUS_DEVICE device, BOOL *opened)
+{
+    const char          *fields;
+    HID_SMBUS_STATUS    status;
+
+    if (!Rep_Next(Rep_Id(device), "is_opened", &fields, &status))
+    {
+        return HID_SMBUS_DEVICE_IO_FAILED;
+    }
+    *opened = (BOOL)Rep_Num(&fields);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rep_ReadRequest(HID_SMBUS_DEVICE device, BYTE slaveAddress, WORD numBytesToRead)
+{
+    const char          *fields;
+    HID_SMBUS_STATUS    status;
+
+    if (!Rep_Next(Rep_Id(device), "read_request", &fields, &status))
+    {
+        return HID_SMBUS_DEVICE_IO_FAILED;
+    }
+    Rep_Expect(&fields, slaveAddress);
+    Rep_Expect(&fields, numBytesToRead);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rep_AddressReadRequest(HID_SMBUS_DEVICE device, BYTE slaveAddress, WORD numBytesToRead, BYTE targetAddressSize, BYTE targetAddress[16])
+{
+    const char          *fields;
+    HID_SMBUS_STATUS    status;
+
+    if (!Rep_Next(Rep_Id(device), "address_read_request", &fields, &status))
+    {
+        return HID_SMBUS_DEVICE_IO_FAILED;
+    }
+    Rep_Expect(&fields, slaveAddress);
+    Rep_Expect(&fields, numBytesToRead);
+    Rep_ExpectHex(&fields, targetAddress, (targetAddressSize <= HID_SMBUS_MAX_TARGET_ADDRESS_SIZE) ? targetAddressSize : 0);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rep_ForceReadResponse(HID_SMBUS_DEVICE device, WORD numBytesToRead)
+{
+    const char          *fields;
+    HID_SMBUS_STATUS    status;
+
+    if (!Rep_Next(Rep_Id(device), "force_read_response", &fields, &status))
+    {
+        return HID_SMBUS_DEVICE_IO_FAILED;
+    }
+    Rep_Expect(&fields, numBytesToRead);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rep_GetReadResponse(HID_SMBUS_DEVICE device, HID_SMBUS_S0 *status0, BYTE *buffer, BYTE bufferSize, BYTE *numBytesRead)
+{
+    const char          *fields;
+    HID_SMBUS_STATUS    status;
+    INT                 count;
+
+    *numBytesRead = 0;
+    if (!Rep_Next(Rep_Id(device), "get_read_response", &fields, &status))
+    {
+        return HID_SMBUS_DEVICE_IO_FAILED;
+    }
+    *status0 = (HID_SMBUS_S0)Rep_Num(&fields);
+    count = Rep_Hex(&fields, buffer, bufferSize);
+    *numBytesRead = (BYTE)((count <= bufferSize) ? count : bufferSize);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rep_WriteRequest(HID_SMBUS_DEVICE device, BYTE slaveAddress, BYTE *buffer, BYTE numBytesToWrite)
+{
+    const char          *fields;
+    HID_SMBUS_STATUS    status;
+
+    if (!Rep_Next(Rep_Id(device), "write_request", &fields, &status))
+    {
+        return HID_SMBUS_DEVICE_IO_FAILED;
+    }
+    Rep_Expect(&fields, slaveAddress);
+    Rep_ExpectHex(&fields, buffer, numBytesToWrite);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rep_TransferStatusRequest(HID_SMBUS_DEVICE device)
+{
+    const char          *fields;
+    HID_SMBUS_STATUS    status;
+
+    if (!Rep_Next(Rep_Id(device), "transfer_status_request", &fields, &status))
+    {
+        return HID_SMBUS_DEVICE_IO_FAILED;
+    }
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rep_GetTransferStatusResponse(HID_SMBUS_DEVICE device, HID_SMBUS_S0 *status0, HID_SMBUS_S1 *status1, WORD *numRetries, WORD *bytesRead)
+{
+    const char          *fields;
+    HID_SMBUS_STATUS    status;
+
+    if (!Rep_Next(Rep_Id(device), "get_transfer_status_response", &fields, &status))
+    {
+        return HID_SMBUS_DEVICE_IO_FAILED;
+    }
+    *status0 = (HID_SMBUS_S0)Rep_Num(&fields);
+    *status1 = (HID_SMBUS_S1)Rep_Num(&fields);
+    *numRetries = (WORD)Rep_Num(&fields);
+    *bytesRead = (WORD)Rep_Num(&fields);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rep_CancelTransfer(HID_SMBUS_DEVICE device)
+{
+    const char          *fields;
+    HID_SMBUS_STATUS    status;
+
+    if (!Rep_Next(Rep_Id(device), "cancel_transfer", &fields, &status))
+    {
+        return HID_SMBUS_DEVICE_IO_FAILED;
+    }
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rep_CancelIo(HID_SMBUS_DEVICE device)
+{
+    const char          *fields;
+    HID_SMBUS_STATUS    status;
+
+    if (!Rep_Next(Rep_Id(device), "cancel_io", &fields, &status))
+    {
+        return HID_SMBUS_DEVICE_IO_FAILED;
+    }
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rep_SetTimeouts(HID_SMBUS_DEVICE device, DWORD responseTimeout)
+{
+    const char          *fields;
+    HID_SMBUS_STATUS    status;
+
+    if (!Rep_Next(Rep_Id(device), "set_timeouts", &fields, &status))
+    {
+        return HID_SMBUS_DEVICE_IO_FAILED;
+    }
+    Rep_Expect(&fields, responseTimeout);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rep_GetTimeouts(HID_SMBUS_DEVICE device, DWORD *responseTimeout)
+{
+    const char          *fields;
+    HID_SMBUS_STATUS    status;
+
+    if (!Rep_Next(Rep_Id(device), "get_timeouts", &fields, &status))
+    {
+        return HID_SMBUS_DEVICE_IO_FAILED;
+    }
+    *responseTimeout = Rep_Num(&fields);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rep_SetSmbusConfig(HID_SMBUS_DEVICE device, DWORD bitRate, BYTE address, BOOL autoReadRespond, WORD writeTimeout, WORD readTimeout, BOOL sclLowTimeout, WORD transferRetries)
+{
+    const char          *fields;
+    HID_SMBUS_STATUS    status;
+
+    if (!Rep_Next(Rep_Id(device), "set_smbus_config", &fields, &status))
+    {
+        return HID_SMBUS_DEVICE_IO_FAILED;
+    }
+    Rep_Expect(&fields, bitRate);
+    Rep_Expect(&fields, address);
+    Rep_Expect(&fields, autoReadRespond);
+    Rep_Expect(&fields, writeTimeout);
+    Rep_Expect(&fields, readTimeout);
+    Rep_Expect(&fields, sclLowTimeout);
+    Rep_Expect(&fields, transferRetries);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rep_GetSmbusConfig(HID_SMBUS_DEVICE device, DWORD *bitRate, BYTE *address, BOOL *autoReadRespond, WORD *writeTimeout, WORD *readTimeout, BOOL *sclLowTimeout, WORD *transferRetries)
+{
+    const char          *fields;
+    HID_SMBUS_STATUS    status;
+
+    if (!Rep_Next(Rep_Id(device), "get_smbus_config", &fields, &status))
+    {
+        return HID_SMBUS_DEVICE_IO_FAILED;
+    }
+    *bitRate = Rep_Num(&fields);
+    *address = (BYTE)Rep_Num(&fields);
+    *autoReadRespond = (BOOL)Rep_Num(&fields);
+    *writeTimeout = (WORD)Rep_Num(&fields);
+    *readTimeout = (WORD)Rep_Num(&fields);
+    *sclLowTimeout = (BOOL)Rep_Num(&fields);
+    *transferRetries = (WORD)Rep_Num(&fields);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rep_Reset(HID_SMBUS_DEVICE device)
+{
+    const char          *fields;
+    HID_SMBUS_STATUS    status;
+
+    if (!Rep_Next(Rep_Id(device), "reset", &fields, &status))
+    {
+        return HID_SMBUS_DEVICE_IO_FAILED;
+    }
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rep_SetGpioConfig(HID_SMBUS_DEVICE device, BYTE direction, BYTE mode, BYTE function, BYTE clkDiv)
+{
+    const char          *fields;
+    HID_SMBUS_STATUS    status;
+
+    if (!Rep_Next(Rep_Id(device), "set_gpio_config", &fields, &status))
+    {
+        return HID_SMBUS_DEVICE_IO_FAILED;
+    }
+    Rep_Expect(&fields, direction);
+    Rep_Expect(&fields, mode);
+    Rep_Expect(&fields, function);
+    Rep_Expect(&fields, clkDiv);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rep_GetGpioConfig(HID_SMBUS_DEVICE device, BYTE *direction, BYTE *mode, BYTE *function, BYTE *clkDiv)
+{
+    const char          *fields;
+    HID_SMBUS_STATUS    status;
+
+    if (!Rep_Next(Rep_Id(device), "get_gpio_config", &fields, &status))
+    {
+        return HID_SMBUS_DEVICE_IO_FAILED;
+    }
+    *direction = (BYTE)Rep_Num(&fields);
+    *mode = (BYTE)Rep_Num(&fields);
+    *function = (BYTE)Rep_Num(&fields);
+    *clkDiv = (BYTE)Rep_Num(&fields);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rep_ReadLatch(HID_SMBUS_DEVICE device, BYTE *latchValue)
+{
+    const char          *fields;
+    HID_SMBUS_STATUS    status;
+
+    if (!Rep_Next(Rep_Id(device), "read_latch", &fields, &status))
+    {
+        return HID_SMBUS_DEVICE_IO_FAILED;
+    }
+    *latchValue = (BYTE)Rep_Num(&fields);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rep_WriteLatch(HID_SMBUS_DEVICE device, BYTE latchValue, BYTE latchMask)
+{
+    const char          *fields;
+    HID_SMBUS_STATUS    status;
+
+    if (!Rep_Next(Rep_Id(device), "write_latch", &fields, &status))
+    {
+        return HID_SMBUS_DEVICE_IO_FAILED;
+    }
+    Rep_Expect(&fields, latchValue);
+    Rep_Expect(&fields, latchMask);
+    return status;
+}
+
+static HID_SMBUS_STATUS WINAPI Rep_GetPartNumber(HID_SMBUS_DEVICE device, BYTE *partNumber, BYTE *version)
+{
+    const char          *fields;
+    HID_SMBUS_STATUS    status;
+
+    if (!Rep_Next(Rep_Id(device), "get_part_number", &fields, &status))
+    {
+        return HID_SMBUS_DEVICE_IO_FAILED;
+    }
+    *partNumber = (BYTE)Rep_Num(&fields);
+    *version = (BYTE)Rep_Num(&fields);
+    return status;
+}
+
+const SMBUS_BACKEND backendTraceReplay =
+{
+    "replay",
+    Rep_GetNumDevices,
+    Rep_GetString,
+    Rep_GetOpenedString,
+    Rep_Open,
+    Rep_Close,
+    Rep_IsOpened,
+    Rep_ReadRequest,
+    Rep_AddressReadRequest,
+    Rep_ForceReadResponse,
+    Rep_GetReadResponse,
+    Rep_WriteRequest,
+    Rep_TransferStatusRequest,
+    Rep_GetTransferStatusResponse,
+    Rep_CancelTransfer,
+    Rep_CancelIo,
+    Rep_SetTimeouts,
+    Rep_GetTimeouts,
+    Rep_SetSmbusConfig,
+    Rep_GetSmbusConfig,
+    Rep_Reset,
+    Rep_SetGpioConfig,
+    Rep_GetGpioConfig,
+    Rep_ReadLatch,
+    Rep_WriteLatch,
+    Rep_GetPartNumber
+};
+
+LONG Trace_Mismatches(void)
+{
+    return mismatches;
+}
+
+void Trace_Close(void)
+{
+    if (traceFile != NULL)
+    {
+        fclose(traceFile);
+        traceFile = NULL;
+    }
+    for (INT i = 0; i <= TRACE_MAX_DEVICES; i++)
+    {
+        free(queues[i].lines);
+    }
+    memset(queues, 0, sizeof(queues));
+    free(replayText);
+    replayText = NULL;
+}
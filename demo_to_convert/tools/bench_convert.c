@@ -0,0 +1,106 @@
+// Block conversion throughput, scalar against SSE2 and AVX2
+//
+// Converts a buffer of pseudo-random raw words with every path the CPU
+// supports, checks each result matches the scalar one bit for bit and
+// reports the rate in millions of words per second.
+//
+// gcc -O2 -Iinclude tools/bench_convert.c src/convert.c -o bench_convert.exe
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+#include "convert.h"
+
+#define DEFAULT_WORDS               (1024 * 1024)
+#define PASSES                      20
+
+static const char *pathNames[] = { "scalar", "sse2", "avx2" };
+
+static WORD  *raw;
+static float *expected;
+static float *result;
+
+static double Bench_Run(int kind, size_t count)
+{
+    LARGE_INTEGER   frequency, start, stop;
+
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+    for (int pass = 0; pass < PASSES; pass++)
+    {
+        switch (kind)
+        {
+        case 0:
+            Convert_LinearFixed(raw, result, count, 32.0f, -40.0f);
+            break;
+        case 1:
+            Convert_Linear11(raw, result, count);
+            break;
+        default:
+            Convert_Linear16(raw, result, count, -9);
+            break;
+        }
+    }
+    QueryPerformanceCounter(&stop);
+
+    // Million words per second
+    return (double)count * PASSES * frequency.QuadPart / (stop.QuadPart - start.QuadPart) / 1e6;
+}
+
+int main(int argc, char* argv[])
+{
+    static const char *kindNames[] = { "fixed /32-40", "LINEAR11", "LINEAR16 2^-9" };
+    size_t          count = DEFAULT_WORDS;
+    CONVERT_PATH    best = Convert_GetPath();
+
+    if (argc > 1)
+    {
+        count = strtoul(argv[1], NULL, 0);
+    }
+
+    raw = malloc(count * sizeof(WORD));
+    expected = malloc(count * sizeof(float));
+    result = malloc(count * sizeof(float));
+    if (!raw || !expected || !result)
+    {
+        fprintf(stderr, "ERROR: Out of memory.\r\n");
+        return -1;
+    }
+
+    srand(1);
+    for (size_t i = 0; i < count; i++)
+    {
+        raw[i] = (WORD)((rand() << 8) ^ rand());
+    }
+
+    printf("%zu words, %d passes, best path %s\r\n", count, PASSES, pathNames[best]);
+    for (int kind = 0; kind < 3; kind++)
+    {
+        double scalarRate = 0;
+
+        for (int path = CONVERT_SCALAR; path <= (int)best; path++)
+        {
+            double rate;
+
+            Convert_SetPath((CONVERT_PATH)path);
+            rate = Bench_Run(kind, count);
+            if (path == CONVERT_SCALAR)
+            {
+                scalarRate = rate;
+                memcpy(expected, result, count * sizeof(float));
+            }
+            else if (memcmp(expected, result, count * sizeof(float)) != 0)
+            {
+                fprintf(stderr, "ERROR: %s %s differs from scalar.\r\n", kindNames[kind], pathNames[path]);
+                return -1;
+            }
+            printf("%-14s %-6s %9.1f Mword/s  x%.2f\r\n", kindNames[kind], pathNames[path], rate, rate / scalarRate);
+        }
+    }
+
+    free(raw);
+    free(expected);
+    free(result);
+    return 0;
+}
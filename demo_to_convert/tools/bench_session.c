@@ -0,0 +1,75 @@
+// Per-read cost of the device-open check
+//
+// Times SMBus_Read with the open state queried from the library before
+// every transfer (the old behaviour) against SMBus_Read using the
+// session state tracked since SMBus_Open.
+//
+// gcc -Iinclude tools/bench_session.c src/smbus.c src/smbpec.c src/smbtiming.c src/backend.c src/simbus.c src/trace.c -Llib -lSLABHIDtoSMBus -o bench_session.exe
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <windows.h>
+#include "smbus.h"
+
+#define BITRATE_HZ                  100000
+#define ACK_ADDRESS                 0x02
+#define AUTO_RESPOND                FALSE
+#define WRITE_TIMEOUT_MS            10
+#define READ_TIMEOUT_MS             10
+#define TRANSFER_RETRIES            0
+#define SCL_LOW_TIMEOUT             TRUE
+#define RESPONSE_TIMEOUT_MS         100
+
+#define LVDC4816_SLAVE_ADDRESS0x60_W    0xC8
+#define NUM_READS                   1000
+
+static double ElapsedUs(LARGE_INTEGER start, LARGE_INTEGER end, LARGE_INTEGER freq)
+{
+    return (double)(end.QuadPart - start.QuadPart) * 1e6 / (double)freq.QuadPart;
+}
+
+int main(int argc, char* argv[])
+{
+    HID_SMBUS_DEVICE    m_hidSmbus;
+    BYTE                buffer[HID_SMBUS_MAX_READ_RESPONSE_SIZE];
+    BYTE                targetAddress[16] = { 0x8D };
+    BOOL                opened;
+    INT                 numReads;
+    LARGE_INTEGER       freq, start, end;
+    double              queriedUs, cachedUs;
+
+    argc = Backend_ParseArgs(argc, argv);
+    numReads = (argc > 1) ? atoi(argv[1]) : NUM_READS;
+
+    if(SMBus_Open(&m_hidSmbus) != 0 ||
+       SMBus_Configure(m_hidSmbus, BITRATE_HZ, ACK_ADDRESS, AUTO_RESPOND, WRITE_TIMEOUT_MS, READ_TIMEOUT_MS, SCL_LOW_TIMEOUT, TRANSFER_RETRIES, RESPONSE_TIMEOUT_MS) != 0)
+    {
+        fprintf(stderr,"ERROR: Could not open device.\r\n");
+        return -1;
+    }
+    QueryPerformanceFrequency(&freq);
+
+    // Before: library open query ahead of every read
+    QueryPerformanceCounter(&start);
+    for (INT i = 0; i < numReads; i++)
+    {
+        SMBus_GetBackend()->IsOpened(SMBus_GetHandle(m_hidSmbus), &opened);
+        SMBus_Read(m_hidSmbus, buffer, LVDC4816_SLAVE_ADDRESS0x60_W, 2, 1, targetAddress);
+    }
+    QueryPerformanceCounter(&end);
+    queriedUs = ElapsedUs(start, end, freq) / numReads;
+
+    // After: session state only
+    QueryPerformanceCounter(&start);
+    for (INT i = 0; i < numReads; i++)
+    {
+        SMBus_Read(m_hidSmbus, buffer, LVDC4816_SLAVE_ADDRESS0x60_W, 2, 1, targetAddress);
+    }
+    QueryPerformanceCounter(&end);
+    cachedUs = ElapsedUs(start, end, freq) / numReads;
+
+    fprintf(stderr, "reads=%d queried_us=%.2f cached_us=%.2f saved_us=%.2f\r\n", numReads, queriedUs, cachedUs, queriedUs - cachedUs);
+
+    SMBus_Close(m_hidSmbus);
+    return 0;
+}
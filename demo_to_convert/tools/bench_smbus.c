@@ -0,0 +1,228 @@
+// SMBus throughput and latency sweep
+//
+// Runs every combination of bit rate, response timeout, operation and
+// transfer size against one slave register and prints one CSV row per
+// combination on stdout. Lines starting with '#' describe the adapter,
+// firmware and library so runs can be compared across versions.
+//
+//   bench_smbus [-s serial] [-a slave] [-r reg] [-n count] [-w] [-sim n]
+//
+// Writes are only run with -w, they send numBytes-1 zero bytes to reg and
+// on to the following registers, so point -r at something harmless.
+//
+// gcc -O2 -Iinclude tools/bench_smbus.c src/smbus.c src/smbpec.c src/smbtiming.c src/backend.c src/simbus.c src/trace.c -Llib -lSLABHIDtoSMBus -o bench_smbus.exe
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+#include "smbus.h"
+#include "trace.h"
+
+#define ACK_ADDRESS                 0x02
+#define AUTO_RESPOND                FALSE
+#define WRITE_TIMEOUT_MS            10
+#define READ_TIMEOUT_MS             10
+#define TRANSFER_RETRIES            0
+#define SCL_LOW_TIMEOUT             TRUE
+
+#define DEFAULT_SLAVE_ADDRESS_W     0xC8
+#define DEFAULT_REGISTER            0x88
+#define DEFAULT_COUNT               200
+#define WARMUP_COUNT                5
+#define MAX_COUNT                   100000
+
+static const DWORD bitRates[] = { 10000, 100000, 400000 };
+static const DWORD responseTimeouts[] = { 10, 100, 1000 };
+static const WORD readSizes[] = { 1, 2, 4, 8, 16, 32, 61, 62, 122, 128, 256, 512 };
+static const WORD writeSizes[] = { 2, 3, 4, 8, 16, 32, 61 };
+
+#define COUNT_OF(a)                 (sizeof(a) / sizeof((a)[0]))
+
+static double latencies[MAX_COUNT];
+
+static int Bench_CompareDouble(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of a sorted array
+static double Bench_Percentile(const double *sorted, INT count, INT percent)
+{
+    INT rank = (count * percent + 99) / 100;
+
+    return (rank > 0) ? sorted[rank - 1] : 0;
+}
+
+static void Bench_Run(HID_SMBUS_DEVICE device, BYTE slaveAddress, BYTE reg, BOOL write, WORD numBytes, INT count, DWORD bitRate, DWORD responseTimeout)
+{
+    BYTE            buffer[HID_SMBUS_MAX_READ_REQUEST_SIZE];
+    BYTE            targetAddress[HID_SMBUS_MAX_TARGET_ADDRESS_SIZE];
+    LARGE_INTEGER   frequency, start, stop, begin, end;
+    INT             numOk = 0;
+    INT             numErrors = 0;
+    double          elapsed;
+
+    QueryPerformanceFrequency(&frequency);
+    memset(buffer, 0, sizeof(buffer));
+    targetAddress[0] = reg;
+    buffer[0] = reg;
+
+    QueryPerformanceCounter(&begin);
+    for (INT i = -WARMUP_COUNT; i < count; i++)
+    {
+        INT result;
+
+        QueryPerformanceCounter(&start);
+        if (write)
+        {
+            result = (SMBus_Write(device, buffer, slaveAddress, (BYTE)numBytes) == 0) ? numBytes : -1;
+        }
+        else
+        {
+            result = SMBus_ReadBlock(device, buffer, slaveAddress, numBytes, 1, targetAddress, NULL, NULL);
+        }
+        QueryPerformanceCounter(&stop);
+
+        // Warm-up transfers are not counted and restart the wall clock
+        if (i < 0)
+        {
+            begin = stop;
+            continue;
+        }
+        if (result == numBytes)
+        {
+            latencies[numOk++] = (double)(stop.QuadPart - start.QuadPart) * 1e6 / frequency.QuadPart;
+        }
+        else
+        {
+            numErrors++;
+        }
+    }
+    QueryPerformanceCounter(&end);
+    elapsed = (double)(end.QuadPart - begin.QuadPart) / frequency.QuadPart;
+
+    qsort(latencies, numOk, sizeof(latencies[0]), Bench_CompareDouble);
+    printf("%lu,%lu,%s,%u,%d,%d,%.1f,%.0f,%.0f,%.0f,%.0f\n",
+        bitRate, responseTimeout, write ? "write" : "read", numBytes, numOk, numErrors,
+        numOk / elapsed, numOk * (double)numBytes / elapsed,
+        Bench_Percentile(latencies, numOk, 50), Bench_Percentile(latencies, numOk, 99),
+        (numOk > 0) ? latencies[numOk - 1] : 0);
+    fflush(stdout);
+}
+
+static void Bench_PrintVersions(HID_SMBUS_DEVICE device)
+{
+    HID_SMBUS_DEVICE_STR    serial;
+    BYTE                    partNumber, version;
+    BYTE                    major, minor;
+    BOOL                    release;
+
+    if (SMBus_GetBackend()->GetOpenedString(SMBus_GetHandle(device), serial, HID_SMBUS_GET_SERIAL_STR) == HID_SMBUS_SUCCESS)
+    {
+        printf("# serial %s\n", serial);
+    }
+    if (SMBus_GetBackend()->GetPartNumber(SMBus_GetHandle(device), &partNumber, &version) == HID_SMBUS_SUCCESS)
+    {
+        printf("# part 0x%02X firmware %u\n", partNumber, version);
+    }
+    if (HidSmbus_GetLibraryVersion(&major, &minor, &release) == HID_SMBUS_SUCCESS)
+    {
+        printf("# SLABHIDtoSMBus %u.%u%s\n", major, minor, release ? "" : " debug");
+    }
+    if (HidSmbus_GetHidLibraryVersion(&major, &minor, &release) == HID_SMBUS_SUCCESS)
+    {
+        printf("# SLABHIDDevice %u.%u%s\n", major, minor, release ? "" : " debug");
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    HID_SMBUS_DEVICE    device;
+    const char          *serial = NULL;
+    BYTE                slaveAddress = DEFAULT_SLAVE_ADDRESS_W;
+    BYTE                reg = DEFAULT_REGISTER;
+    INT                 count = DEFAULT_COUNT;
+    BOOL                writes = FALSE;
+
+    argc = Backend_ParseArgs(argc, argv);
+    if (argc < 0)
+    {
+        fprintf(stderr, "ERROR: Could not open trace.\r\n");
+        return -1;
+    }
+    for (INT i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-w") == 0)
+        {
+            writes = TRUE;
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "-s") == 0)
+        {
+            serial = argv[++i];
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "-a") == 0)
+        {
+            slaveAddress = (BYTE)strtoul(argv[++i], NULL, 0);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "-r") == 0)
+        {
+            reg = (BYTE)strtoul(argv[++i], NULL, 0);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "-n") == 0)
+        {
+            count = atoi(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-s serial] [-a slave] [-r reg] [-n count] [-w]\r\n", argv[0]);
+            return -1;
+        }
+    }
+    if (count < 1 || count > MAX_COUNT)
+    {
+        fprintf(stderr, "ERROR: count must be 1..%d.\r\n", MAX_COUNT);
+        return -1;
+    }
+
+    // Open device
+    if ((serial != NULL ? SMBus_OpenBySerial(&device, serial) : SMBus_Open(&device)) != 0)
+    {
+        fprintf(stderr, "ERROR: Could not open device.\r\n");
+        return -1;
+    }
+
+    Bench_PrintVersions(device);
+    printf("# backend %s\n", SMBus_GetBackend()->name);
+    printf("# slave 0x%02X reg 0x%02X count %d\n", slaveAddress, reg, count);
+    printf("bitrate_hz,response_timeout_ms,op,bytes,ok,errors,tx_per_s,bytes_per_s,p50_us,p99_us,max_us\n");
+
+    for (DWORD b = 0; b < COUNT_OF(bitRates); b++)
+    {
+        for (DWORD t = 0; t < COUNT_OF(responseTimeouts); t++)
+        {
+            // Configure device
+            if (SMBus_Configure(device, bitRates[b], ACK_ADDRESS, AUTO_RESPOND, WRITE_TIMEOUT_MS, READ_TIMEOUT_MS, SCL_LOW_TIMEOUT, TRANSFER_RETRIES, responseTimeouts[t]) != 0)
+            {
+                fprintf(stderr, "ERROR: Could not configure %lu Hz, %lu ms.\r\n", bitRates[b], responseTimeouts[t]);
+                continue;
+            }
+
+            for (DWORD s = 0; s < COUNT_OF(readSizes); s++)
+            {
+                Bench_Run(device, slaveAddress, reg, FALSE, readSizes[s], count, bitRates[b], responseTimeouts[t]);
+            }
+            for (DWORD s = 0; writes && s < COUNT_OF(writeSizes); s++)
+            {
+                Bench_Run(device, slaveAddress, reg, TRUE, writeSizes[s], count, bitRates[b], responseTimeouts[t]);
+            }
+        }
+    }
+
+    SMBus_Close(device);
+    Trace_Close();
+    return 0;
+}
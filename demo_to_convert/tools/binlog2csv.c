@@ -0,0 +1,94 @@
+// Decode a binary telemetry log into the CSV columns of outputA.csv
+//
+// binlog2csv <input.bin> <output.csv>
+//
+// gcc -Iinclude tools/binlog2csv.c src/binlog.c src/csvlog.c -o binlog2csv.exe
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+#include "binlog.h"
+
+#define RECORDS_PER_READ            4096
+
+static CSV_LOG          csvLog;
+static CSVLOG_COLUMN    columns[BINLOG_MAX_CHANNELS];
+static char             header[BINLOG_MAX_CHANNELS * (BINLOG_NAME_LEN + 1)];
+
+int main(int argc, char* argv[])
+{
+    FILE                *fp;
+    BINLOG_HEADER       binHeader;
+    BYTE                *records;
+    size_t              numRecords;
+    TELEMETRY_SAMPLE    sample;
+    ULONGLONG           total = 0;
+
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: binlog2csv <input.bin> <output.csv>\r\n");
+        return -1;
+    }
+
+    fp = fopen(argv[1], "rb");
+    if (fp == NULL || BinLog_ReadHeader(fp, &binHeader) != 0)
+    {
+        fprintf(stderr, "ERROR: %s is not a telemetry log.\r\n", argv[1]);
+        return -1;
+    }
+
+    // The header carries the column map, no knowledge of the DUT needed here
+    for (INT i = 0; i < binHeader.numChannels; i++)
+    {
+        columns[i].word = binHeader.channels[i].word;
+        columns[i].format = (CSVLOG_FORMAT)binHeader.channels[i].format;
+        columns[i].divisor = binHeader.channels[i].divisor;
+        columns[i].offset = binHeader.channels[i].offset;
+        if (i > 0)
+        {
+            strcat(header, ",");
+        }
+        strncat(header, binHeader.channels[i].name, BINLOG_NAME_LEN);
+    }
+    csvLog.path = argv[2];
+    csvLog.header = header;
+    csvLog.columns = columns;
+    csvLog.numColumns = binHeader.numChannels;
+    if (CsvLog_Open(&csvLog) != 0)
+    {
+        fprintf(stderr, "ERROR: Could not open %s.\r\n", argv[2]);
+        fclose(fp);
+        return -1;
+    }
+
+    records = malloc((size_t)binHeader.recordSize * RECORDS_PER_READ);
+    if (records == NULL)
+    {
+        CsvLog_Close(&csvLog);
+        fclose(fp);
+        return -1;
+    }
+    memset(&sample, 0, sizeof(sample));
+
+    // Whole records only, a torn tail is ignored
+    fseek(fp, binHeader.headerSize, SEEK_SET);
+    while ((numRecords = fread(records, binHeader.recordSize, RECORDS_PER_READ, fp)) > 0)
+    {
+        for (size_t i = 0; i < numRecords; i++)
+        {
+            BinLog_DecodeRecord(&binHeader, &records[i * binHeader.recordSize], &sample);
+            if (sample.validMask != 0)
+            {
+                CsvLog_WriteSample(&csvLog, &sample);
+                total++;
+            }
+        }
+    }
+
+    fprintf(stderr, "%llu records decoded.\r\n", total);
+    free(records);
+    CsvLog_Close(&csvLog);
+    fclose(fp);
+    return 0;
+}
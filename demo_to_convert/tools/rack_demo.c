@@ -0,0 +1,172 @@
+// Poll the LVDC4816 behind every CP2112 on the host
+//
+// Each adapter gets its own acquisition thread, all of them feed one
+// shared ring and this thread splits the samples into one CSV per
+// adapter serial (rack_<serial>.csv).
+//
+// gcc -Iinclude tools/rack_demo.c src/rack.c src/smbus.c src/smbpec.c src/smbtiming.c src/backend.c src/simbus.c src/trace.c src/telemetry.c src/csvlog.c src/lvdc4816.c -Llib -lSLABHIDtoSMBus -o rack_demo.exe
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+#include "smbus.h"
+#include "telemetry.h"
+#include "csvlog.h"
+#include "lvdc4816.h"
+#include "rack.h"
+#include "trace.h"
+
+#define BITRATE_HZ                  100000
+#define ACK_ADDRESS                 0x02
+#define AUTO_RESPOND                FALSE
+#define WRITE_TIMEOUT_MS            10
+#define READ_TIMEOUT_MS             10
+#define TRANSFER_RETRIES            0
+#define SCL_LOW_TIMEOUT             TRUE
+#define RESPONSE_TIMEOUT_MS         100
+#define SAMPLE_PERIOD_MS            500
+#define SINK_RING_SIZE              1024
+#define CSV_FLUSH_BYTES             4096
+#define CSV_FLUSH_INTERVAL_MS       5000
+#define CSV_ROTATE_BYTES            (64ull * 1024 * 1024)
+
+#define LVDC4816_SLAVE_ADDRESS_W    0xC8
+
+RACK rack;
+TELEMETRY_RING sink;
+TELEMETRY_SAMPLE sinkSamples[SINK_RING_SIZE];
+CSVLOG_COLUMN csvColumns[LVDC4816_NUM_TELEMETRY];
+CSV_LOG csvLogs[RACK_MAX_ADAPTERS];
+char csvPaths[RACK_MAX_ADAPTERS][HID_SMBUS_DEVICE_STRLEN + 16];
+DWORD sampleCounts[RACK_MAX_ADAPTERS];
+volatile LONG running = 1;
+
+// Ctrl+C ends the sampling loop so buffered rows are flushed on the way out
+static BOOL WINAPI ConsoleHandler(DWORD ctrlType)
+{
+    InterlockedExchange(&running, 0);
+    return TRUE;
+}
+
+int main(int argc, char* argv[])
+{
+    TELEMETRY_SAMPLE    sample;
+    INT                 numOpened;
+    DWORD               lastReport;
+
+    // "-sim 4" runs the rack without hardware
+    if (Backend_ParseArgs(argc, argv) < 0)
+    {
+        fprintf(stderr,"\r\nERROR: Could not open trace.\r\n");
+        return -1;
+    }
+
+    // Open every adapter
+    numOpened = Rack_Open(&rack);
+    if (numOpened <= 0)
+    {
+        fprintf(stderr,"\r\nERROR: Could not open any device.\r\n");
+        Rack_Close(&rack);
+        return -1;
+    }
+    fprintf(stderr,"\r\n%d of %d devices opened.\r\n", numOpened, rack.numAdapters);
+
+    // Configure each adapter and give it a log of its own
+    LVDC4816_TelemetryColumns(csvColumns);
+    for (INT i = 0; i < rack.numAdapters; i++)
+    {
+        RACK_ADAPTER *adapter = &rack.adapters[i];
+
+        if (!adapter->opened)
+        {
+            fprintf(stderr,"ERROR: Could not open device %s.\r\n", adapter->serial);
+            continue;
+        }
+        if (SMBus_Configure(adapter->device, BITRATE_HZ, ACK_ADDRESS, AUTO_RESPOND, WRITE_TIMEOUT_MS, READ_TIMEOUT_MS, SCL_LOW_TIMEOUT, TRANSFER_RETRIES, RESPONSE_TIMEOUT_MS) != 0)
+        {
+            fprintf(stderr,"ERROR: Could not configure device %s.\r\n", adapter->serial);
+            SMBus_Close(adapter->device);
+            adapter->opened = FALSE;
+            continue;
+        }
+
+        snprintf(csvPaths[i], sizeof(csvPaths[i]), "rack_%s.csv", adapter->serial);
+        csvLogs[i].path = csvPaths[i];
+        csvLogs[i].header = &lvdc4816TelemetryHeader[1];
+        csvLogs[i].columns = csvColumns;
+        csvLogs[i].numColumns = LVDC4816_NUM_TELEMETRY;
+        csvLogs[i].flushBytes = CSV_FLUSH_BYTES;
+        csvLogs[i].flushIntervalMs = CSV_FLUSH_INTERVAL_MS;
+        csvLogs[i].rotateBytes = CSV_ROTATE_BYTES;
+        if (CsvLog_Open(&csvLogs[i]) != 0)
+        {
+            fprintf(stderr,"ERROR: Could not open %s.\r\n", csvLogs[i].path);
+            SMBus_Close(adapter->device);
+            adapter->opened = FALSE;
+            continue;
+        }
+        fprintf(stderr,"Device %s logging to %s.\r\n", adapter->serial, csvLogs[i].path);
+    }
+
+    // One thread per adapter, all feeding the shared sink
+    Telemetry_RingInitShared(&sink, sinkSamples, SINK_RING_SIZE);
+    rack.slaveAddress = LVDC4816_SLAVE_ADDRESS_W;
+    rack.registers = lvdc4816TelemetryRegs;
+    rack.numRegisters = LVDC4816_NUM_TELEMETRY;
+    rack.periodMs = SAMPLE_PERIOD_MS;
+    rack.rates = lvdc4816TelemetryRates;
+    rack.sink = &sink;
+    if (Rack_Start(&rack) <= 0)
+    {
+        fprintf(stderr,"ERROR: Could not start acquisition.\r\n");
+        Rack_Close(&rack);
+        return -1;
+    }
+
+    SetConsoleCtrlHandler(ConsoleHandler, TRUE);
+    lastReport = GetTickCount();
+    while(running)
+    {
+        if (Telemetry_RingWait(&sink, CSV_FLUSH_INTERVAL_MS) && Telemetry_RingPop(&sink, &sample))
+        {
+            CsvLog_WriteSample(&csvLogs[sample.source], &sample);
+            sampleCounts[sample.source]++;
+        }
+
+        // Periodic per-adapter summary, also flushes idle logs
+        if (GetTickCount() - lastReport >= CSV_FLUSH_INTERVAL_MS)
+        {
+            lastReport = GetTickCount();
+            for (INT i = 0; i < rack.numAdapters; i++)
+            {
+                if (rack.adapters[i].opened)
+                {
+                    CsvLog_Poll(&csvLogs[i]);
+                    fprintf(stderr, "%s: %lu samples\r\n", rack.adapters[i].serial, sampleCounts[i]);
+                }
+            }
+            fprintf(stderr, "Dropped: %ld\r\n", sink.dropped);
+        }
+    }
+
+    // Success
+    fprintf(stderr, "Done! Exiting...\r\n");
+    Rack_Stop(&rack);
+    // Drain what the workers pushed before they stopped
+    while (Telemetry_RingPop(&sink, &sample))
+    {
+        CsvLog_WriteSample(&csvLogs[sample.source], &sample);
+    }
+    for (INT i = 0; i < rack.numAdapters; i++)
+    {
+        if (rack.adapters[i].opened)
+        {
+            CsvLog_Close(&csvLogs[i]);
+        }
+    }
+    Telemetry_RingFree(&sink);
+    Rack_Close(&rack);
+    Trace_Close();
+    return 0;
+}
@@ -0,0 +1,184 @@
+// Steady-state register poller
+//
+// Keeps depth reads of one slave register queued on an SMBAsync I/O
+// thread for a number of seconds. Every read is a transaction borrowed
+// from an SMBPool and returned once its completion has been handled, so
+// the loop does no heap work while it runs. Prints the read rate, the
+// failures and how close the pool came to running dry.
+//
+//   smbus_poll [-s serial] [-a slave] [-r reg] [-b bytes] [-d depth] [-t seconds] [-sim n]
+//
+// gcc -O2 -Iinclude tools/smbus_poll.c src/smbpool.c src/smbasync.c src/smbus.c src/smbpec.c src/smbtiming.c src/backend.c src/simbus.c src/trace.c -Llib -lSLABHIDtoSMBus -o smbus_poll.exe
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+#include "smbus.h"
+#include "smbasync.h"
+#include "smbpool.h"
+#include "trace.h"
+
+#define BITRATE_HZ                  100000
+#define ACK_ADDRESS                 0x02
+#define AUTO_RESPOND                FALSE
+#define WRITE_TIMEOUT_MS            10
+#define READ_TIMEOUT_MS             10
+#define TRANSFER_RETRIES            0
+#define SCL_LOW_TIMEOUT             TRUE
+#define RESPONSE_TIMEOUT_MS         100
+
+#define DEFAULT_SLAVE_ADDRESS_W     0xC8
+#define DEFAULT_REGISTER            0x88
+#define DEFAULT_BYTES               2
+#define DEFAULT_DEPTH               4
+#define DEFAULT_SECONDS             10
+#define POOL_SIZE                   16
+#define READ_DEADLINE_MS            100
+#define DRAIN_TIMEOUT_MS            1000
+
+static SMBUS_TRANSACTION    storage[POOL_SIZE];
+static SMBUS_POOL           pool;
+static SMBUS_ASYNC          async;
+
+// Borrow a transaction for the next read and queue it, FALSE when the
+// pool is empty or the queue refused it
+static BOOL Poll_Submit(BYTE slaveAddress, BYTE reg, WORD numBytes)
+{
+    SMBUS_TRANSACTION *transaction = SMBPool_Borrow(&pool);
+
+    if (transaction == NULL)
+    {
+        return FALSE;
+    }
+
+    transaction->async.slaveAddress = slaveAddress;
+    transaction->async.targetAddressSize = 1;
+    transaction->async.targetAddress[0] = reg;
+    transaction->async.numBytesToRead = numBytes;
+    if (SMBAsync_Submit(&async, &transaction->async) == 0)
+    {
+        SMBPool_Return(&pool, transaction);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+int main(int argc, char* argv[])
+{
+    const char          *serial = NULL;
+    BYTE                slaveAddress = DEFAULT_SLAVE_ADDRESS_W;
+    BYTE                reg = DEFAULT_REGISTER;
+    WORD                numBytes = DEFAULT_BYTES;
+    INT                 depth = DEFAULT_DEPTH;
+    INT                 seconds = DEFAULT_SECONDS;
+    INT                 inFlight = 0;
+    LONG                numOk = 0;
+    SMBUS_ASYNC_READ    *read;
+    DWORD               start, elapsed;
+
+    argc = Backend_ParseArgs(argc, argv);
+    if (argc < 0)
+    {
+        fprintf(stderr, "ERROR: Could not open trace.\r\n");
+        return -1;
+    }
+    for (INT i = 1; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "-s") == 0)
+        {
+            serial = argv[++i];
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "-a") == 0)
+        {
+            slaveAddress = (BYTE)strtoul(argv[++i], NULL, 0);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "-r") == 0)
+        {
+            reg = (BYTE)strtoul(argv[++i], NULL, 0);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "-b") == 0)
+        {
+            numBytes = (WORD)atoi(argv[++i]);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "-d") == 0)
+        {
+            depth = atoi(argv[++i]);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "-t") == 0)
+        {
+            seconds = atoi(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-s serial] [-a slave] [-r reg] [-b bytes] [-d depth] [-t seconds]\r\n", argv[0]);
+            return -1;
+        }
+    }
+    if (numBytes < HID_SMBUS_MIN_READ_REQUEST_SIZE || numBytes > HID_SMBUS_MAX_READ_REQUEST_SIZE ||
+        depth < 1 || depth > POOL_SIZE || seconds < 1)
+    {
+        fprintf(stderr, "ERROR: bytes must be %d..%d, depth 1..%d and seconds at least 1.\r\n",
+            HID_SMBUS_MIN_READ_REQUEST_SIZE, HID_SMBUS_MAX_READ_REQUEST_SIZE, POOL_SIZE);
+        return -1;
+    }
+
+    // Open and configure device
+    if ((serial != NULL ? SMBus_OpenBySerial(&async.device, serial) : SMBus_Open(&async.device)) != 0 ||
+        SMBus_Configure(async.device, BITRATE_HZ, ACK_ADDRESS, AUTO_RESPOND, WRITE_TIMEOUT_MS, READ_TIMEOUT_MS, SCL_LOW_TIMEOUT, TRANSFER_RETRIES, RESPONSE_TIMEOUT_MS) != 0)
+    {
+        fprintf(stderr, "ERROR: Could not open device.\r\n");
+        return -1;
+    }
+
+    async.defaultTimeoutMs = READ_DEADLINE_MS;
+    if (SMBPool_Init(&pool, storage, POOL_SIZE) != 0 || SMBAsync_Start(&async) != 0)
+    {
+        fprintf(stderr, "ERROR: Could not start the I/O thread.\r\n");
+        SMBus_Close(async.device);
+        return -1;
+    }
+
+    // Every completion hands its transaction back and queues the next read
+    start = GetTickCount();
+    while (inFlight < depth && Poll_Submit(slaveAddress, reg, numBytes))
+    {
+        inFlight++;
+    }
+    while (inFlight > 0)
+    {
+        elapsed = GetTickCount() - start;
+        read = SMBAsync_GetCompletion(&async, (elapsed < (DWORD)seconds * 1000) ? READ_DEADLINE_MS : DRAIN_TIMEOUT_MS);
+        if (read == NULL)
+        {
+            if (elapsed >= (DWORD)seconds * 1000 + DRAIN_TIMEOUT_MS)
+            {
+                break;
+            }
+            continue;
+        }
+
+        inFlight--;
+        numOk += (read->result == numBytes);
+        SMBPool_Return(&pool, SMBPool_FromAsync(read));
+        if (GetTickCount() - start < (DWORD)seconds * 1000 && Poll_Submit(slaveAddress, reg, numBytes))
+        {
+            inFlight++;
+        }
+    }
+    elapsed = GetTickCount() - start;
+
+    SMBAsync_Stop(&async);
+    printf("%ld reads, %ld failed, %.1f reads/s\n", numOk, async.numFailed, numOk * 1000.0 / (elapsed > 0 ? elapsed : 1));
+    printf("pool %lu of %d, low water %lu free, %ld empty borrows\n", pool.numFree, POOL_SIZE, pool.minFree, pool.numExhausted);
+
+    // Reads abandoned by a drain timeout never came back to the pool
+    if (inFlight == 0)
+    {
+        SMBPool_Free(&pool);
+    }
+    SMBus_Close(async.device);
+    Trace_Close();
+    return 0;
+}
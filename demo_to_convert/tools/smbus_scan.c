@@ -0,0 +1,92 @@
+// List the slaves that answer on the bus of one CP2112
+//
+// Probes every address from 0x02 to 0xFE and prints the 8-bit write
+// address of each slave that ACKs. The adapter configuration is the same
+// afterwards as before the scan.
+//
+//   smbus_scan [-s serial] [-w command] [-sim n]
+//
+// -w probes with a one byte write of command instead of a read, for
+// slaves that do not ACK a read without a command first.
+//
+// gcc -O2 -Iinclude tools/smbus_scan.c src/smbscan.c src/smbus.c src/smbpec.c src/smbtiming.c src/backend.c src/simbus.c src/trace.c -Llib -lSLABHIDtoSMBus -o smbus_scan.exe
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+#include "smbus.h"
+#include "smbscan.h"
+#include "trace.h"
+
+#define BITRATE_HZ                  100000
+#define ACK_ADDRESS                 0x02
+#define AUTO_RESPOND                FALSE
+#define WRITE_TIMEOUT_MS            10
+#define READ_TIMEOUT_MS             10
+#define TRANSFER_RETRIES            0
+#define SCL_LOW_TIMEOUT             TRUE
+#define RESPONSE_TIMEOUT_MS         100
+
+SMBUS_SCAN scan;
+
+int main(int argc, char* argv[])
+{
+    HID_SMBUS_DEVICE    device;
+    const char          *serial = NULL;
+
+    argc = Backend_ParseArgs(argc, argv);
+    if (argc < 0)
+    {
+        fprintf(stderr, "ERROR: Could not open trace.\r\n");
+        return -1;
+    }
+    for (INT i = 1; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "-s") == 0)
+        {
+            serial = argv[++i];
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "-w") == 0)
+        {
+            scan.writeProbe = TRUE;
+            scan.probeCommand = (BYTE)strtoul(argv[++i], NULL, 0);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-s serial] [-w command]\r\n", argv[0]);
+            return -1;
+        }
+    }
+
+    // Open and configure device
+    if ((serial != NULL ? SMBus_OpenBySerial(&device, serial) : SMBus_Open(&device)) != 0 ||
+        SMBus_Configure(device, BITRATE_HZ, ACK_ADDRESS, AUTO_RESPOND, WRITE_TIMEOUT_MS, READ_TIMEOUT_MS, SCL_LOW_TIMEOUT, TRANSFER_RETRIES, RESPONSE_TIMEOUT_MS) != 0)
+    {
+        fprintf(stderr, "ERROR: Could not open device.\r\n");
+        return -1;
+    }
+
+    if (SMBScan_Run(device, &scan) < 0)
+    {
+        fprintf(stderr, "ERROR: Could not scan the bus.\r\n");
+        SMBus_Close(device);
+        return -1;
+    }
+    for (INT i = 0; i < 128; i++)
+    {
+        if (scan.result[i] == SMBSCAN_PRESENT)
+        {
+            printf("0x%02X\n", i << 1);
+        }
+        else if (scan.result[i] == SMBSCAN_ERROR)
+        {
+            printf("0x%02X error\n", i << 1);
+        }
+    }
+    fprintf(stderr, "%d found, %d errors, %lu ms\r\n", scan.numPresent, scan.numErrors, scan.elapsedMs);
+
+    SMBus_Close(device);
+    Trace_Close();
+    return 0;
+}
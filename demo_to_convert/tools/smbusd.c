@@ -0,0 +1,107 @@
+// Shared CP2112 access for several processes
+//
+// Owns the adapters and runs SMBus transfers for the clients connected
+// to its pipe, see smbclient.h. Adapters are opened and configured the
+// first time a client asks for one and stay open until the daemon exits,
+// so clients that come and go skip enumeration and configuration.
+//
+//   smbusd [-pipe name] [-sim n]
+//
+// gcc -O2 -Iinclude tools/smbusd.c src/smbserver.c src/smbus.c src/smbpec.c src/smbtiming.c src/backend.c src/simbus.c src/trace.c -Llib -lSLABHIDtoSMBus -o smbusd.exe
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+#include "smbus.h"
+#include "smbserver.h"
+#include "trace.h"
+
+#define BITRATE_HZ                  100000
+#define ACK_ADDRESS                 0x02
+#define AUTO_RESPOND                FALSE
+#define WRITE_TIMEOUT_MS            10
+#define READ_TIMEOUT_MS             10
+#define TRANSFER_RETRIES            0
+#define SCL_LOW_TIMEOUT             TRUE
+#define RESPONSE_TIMEOUT_MS         100
+
+SMBSERVER server;
+HANDLE stopEvent;
+
+static const char *priorityNames[SMBIPC_NUM_PRIORITIES] = { "urgent", "periodic", "bulk" };
+
+// Ctrl+C stops the daemon, open connections are dropped
+static BOOL WINAPI ConsoleHandler(DWORD ctrlType)
+{
+    SetEvent(stopEvent);
+    return TRUE;
+}
+
+int main(int argc, char* argv[])
+{
+    argc = Backend_ParseArgs(argc, argv);
+    if (argc < 0)
+    {
+        fprintf(stderr, "ERROR: Could not open trace.\r\n");
+        return -1;
+    }
+    for (INT i = 1; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "-pipe") == 0)
+        {
+            server.pipeName = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-pipe name]\r\n", argv[0]);
+            return -1;
+        }
+    }
+
+    server.config.bitRate = BITRATE_HZ;
+    server.config.address = ACK_ADDRESS;
+    server.config.autoReadRespond = AUTO_RESPOND;
+    server.config.writeTimeout = WRITE_TIMEOUT_MS;
+    server.config.readTimeout = READ_TIMEOUT_MS;
+    server.config.sclLowTimeout = SCL_LOW_TIMEOUT;
+    server.config.transferRetries = TRANSFER_RETRIES;
+    server.config.responseTimeout = RESPONSE_TIMEOUT_MS;
+
+    stopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (stopEvent == NULL || SMBServer_Start(&server) != 0)
+    {
+        fprintf(stderr, "ERROR: Could not start, is another smbusd running?\r\n");
+        return -1;
+    }
+    fprintf(stderr, "Serving %s, Ctrl+C to stop.\r\n", (server.pipeName != NULL) ? server.pipeName : SMBIPC_PIPE_NAME);
+
+    SetConsoleCtrlHandler(ConsoleHandler, TRUE);
+    WaitForSingleObject(stopEvent, INFINITE);
+
+    // Counters are read before the adapters are closed
+    fprintf(stderr, "%ld connections, %ld refused\r\n", server.connections, server.refused);
+    for (INT i = 0; i < server.numAdapters; i++)
+    {
+        SMBSERVER_ADAPTER *adapter = &server.adapters[i];
+
+        fprintf(stderr, "%s: %ld requests in %ld rounds, %ld batches, %ld bulk pieces\r\n", adapter->serial,
+            adapter->requests, adapter->rounds, adapter->batches, adapter->pieces);
+
+        // Latency per class to hold against the SLOs
+        for (INT p = 0; p < SMBIPC_NUM_PRIORITIES; p++)
+        {
+            const SMBTIMING_HISTOGRAM *latency = &adapter->latency[p];
+
+            if (latency->count > 0)
+            {
+                fprintf(stderr, "  %-8s %ld requests, p50 %lu us, p99 %lu us, max %ld us, %ld aged rounds\r\n", priorityNames[p], latency->count,
+                    SMBTiming_Percentile(latency, 50), SMBTiming_Percentile(latency, 99), latency->maxUs, adapter->aged[p]);
+            }
+        }
+    }
+    SMBServer_Stop(&server);
+    CloseHandle(stopEvent);
+    Trace_Close();
+    return 0;
+}